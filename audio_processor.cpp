@@ -0,0 +1,296 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "audio_processor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Gain that brings the loudest channel of each frame down to the ceiling,
+// PROCESSOR_CEILING / max(peak, PROCESSOR_CEILING) is 1 below it.
+static void GetRequiredGains(const float *frames, unsigned count, unsigned channels, float *gains)
+{
+    unsigned i = 0;
+#if defined(__AVX2__)
+    const __m256 ceiling = _mm256_set1_ps(PROCESSOR_CEILING), sign = _mm256_set1_ps(-0.f);
+    if (channels == 1) {
+        for (; i + 8 <= count; i += 8) {
+            __m256 peak = _mm256_andnot_ps(sign, _mm256_loadu_ps(&frames[i]));
+            _mm256_storeu_ps(&gains[i], _mm256_div_ps(ceiling, _mm256_max_ps(peak, ceiling)));
+        }
+    } else if (channels == 2) {
+        for (; i + 8 <= count; i += 8) {
+            __m256 low = _mm256_andnot_ps(sign, _mm256_loadu_ps(&frames[2 * i]));
+            __m256 high = _mm256_andnot_ps(sign, _mm256_loadu_ps(&frames[2 * i + 8]));
+            // Per lane maximum of both channels, the 64-bit permute restores frame order.
+            __m256 peak = _mm256_max_ps(_mm256_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+            peak = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(peak), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_ps(&gains[i], _mm256_div_ps(ceiling, _mm256_max_ps(peak, ceiling)));
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128 ceiling = _mm_set1_ps(PROCESSOR_CEILING), sign = _mm_set1_ps(-0.f);
+    if (channels == 1) {
+        for (; i + 4 <= count; i += 4) {
+            __m128 peak = _mm_andnot_ps(sign, _mm_loadu_ps(&frames[i]));
+            _mm_storeu_ps(&gains[i], _mm_div_ps(ceiling, _mm_max_ps(peak, ceiling)));
+        }
+    } else if (channels == 2) {
+        for (; i + 4 <= count; i += 4) {
+            __m128 low = _mm_andnot_ps(sign, _mm_loadu_ps(&frames[2 * i]));
+            __m128 high = _mm_andnot_ps(sign, _mm_loadu_ps(&frames[2 * i + 4]));
+            __m128 peak = _mm_max_ps(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_ps(&gains[i], _mm_div_ps(ceiling, _mm_max_ps(peak, ceiling)));
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t ceiling = vdupq_n_f32(PROCESSOR_CEILING);
+    if (channels == 1) {
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t peak = vabsq_f32(vld1q_f32(&frames[i]));
+            vst1q_f32(&gains[i], vdivq_f32(ceiling, vmaxq_f32(peak, ceiling)));
+        }
+    } else if (channels == 2) {
+        for (; i + 4 <= count; i += 4) {
+            float32x4x2_t stereo = vld2q_f32(&frames[2 * i]);
+            float32x4_t peak = vmaxq_f32(vabsq_f32(stereo.val[0]), vabsq_f32(stereo.val[1]));
+            vst1q_f32(&gains[i], vdivq_f32(ceiling, vmaxq_f32(peak, ceiling)));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float peak = PROCESSOR_CEILING;
+        for (unsigned channel = 0; channel < channels; channel++) {
+            peak = std::max(peak, std::fabs(frames[i * channels + channel]));
+        }
+        gains[i] = PROCESSOR_CEILING / peak;
+    }
+}
+
+static void ApplyGains(const float *frames, const float *gains, unsigned count, unsigned channels, float *output)
+{
+    unsigned i = 0;
+#if defined(__AVX2__)
+    if (channels == 1) {
+        for (; i + 8 <= count; i += 8) {
+            _mm256_storeu_ps(&output[i], _mm256_mul_ps(_mm256_loadu_ps(&frames[i]), _mm256_loadu_ps(&gains[i])));
+        }
+    } else if (channels == 2) {
+        for (; i + 8 <= count; i += 8) {
+            __m256 gain = _mm256_loadu_ps(&gains[i]);
+            // Unpacks duplicate gains within 128-bit lanes, the lane permute puts them in frame order.
+            __m256 low = _mm256_unpacklo_ps(gain, gain), high = _mm256_unpackhi_ps(gain, gain);
+            _mm256_storeu_ps(&output[2 * i], _mm256_mul_ps(_mm256_loadu_ps(&frames[2 * i]), _mm256_permute2f128_ps(low, high, 0x20)));
+            _mm256_storeu_ps(&output[2 * i + 8], _mm256_mul_ps(_mm256_loadu_ps(&frames[2 * i + 8]), _mm256_permute2f128_ps(low, high, 0x31)));
+        }
+    }
+#elif defined(__SSE2__)
+    if (channels == 1) {
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(&output[i], _mm_mul_ps(_mm_loadu_ps(&frames[i]), _mm_loadu_ps(&gains[i])));
+        }
+    } else if (channels == 2) {
+        for (; i + 4 <= count; i += 4) {
+            __m128 gain = _mm_loadu_ps(&gains[i]);
+            _mm_storeu_ps(&output[2 * i], _mm_mul_ps(_mm_loadu_ps(&frames[2 * i]), _mm_unpacklo_ps(gain, gain)));
+            _mm_storeu_ps(&output[2 * i + 4], _mm_mul_ps(_mm_loadu_ps(&frames[2 * i + 4]), _mm_unpackhi_ps(gain, gain)));
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (channels == 1) {
+        for (; i + 4 <= count; i += 4) {
+            vst1q_f32(&output[i], vmulq_f32(vld1q_f32(&frames[i]), vld1q_f32(&gains[i])));
+        }
+    } else if (channels == 2) {
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t gain = vld1q_f32(&gains[i]);
+            float32x4x2_t stereo = vld2q_f32(&frames[2 * i]);
+            stereo.val[0] = vmulq_f32(stereo.val[0], gain);
+            stereo.val[1] = vmulq_f32(stereo.val[1], gain);
+            vst2q_f32(&output[2 * i], stereo);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        for (unsigned channel = 0; channel < channels; channel++) {
+            output[i * channels + channel] = frames[i * channels + channel] * gains[i];
+        }
+    }
+}
+
+AudioProcessor::AudioProcessor(unsigned sampleRate, unsigned preEmphasis)
+    : source(nullptr), sampleRate(sampleRate), channels(0), minimumHead(0), minimumTail(0), averagePosition(0), position(0), envelope(1.f)
+{
+    if ((preEmphasis != 0) && (preEmphasis != 50) && (preEmphasis != 75)) {
+        throw std::runtime_error("Pre-emphasis must be 0, 50 or 75 us");
+    }
+    if (preEmphasis) {
+        // Matched-z shelf: zero at the emphasis time constant, pole at
+        // PROCESSOR_EMPHASIS_LIMIT so the boost levels off, unity gain at DC.
+        double zero = std::exp(-1000000.0 / (preEmphasis * static_cast<double>(sampleRate)));
+        double pole = std::exp(-2.0 * M_PI * PROCESSOR_EMPHASIS_LIMIT / sampleRate);
+        double gain = (1.0 - pole) / (1.0 - zero);
+        sections.push_back({ static_cast<float>(gain), static_cast<float>(-gain * zero), 0.f, static_cast<float>(-pole), 0.f });
+    }
+    if (PROCESSOR_LOWPASS * 20.0 < sampleRate * 9.0) {
+        // Chebyshev type I prototype, bilinear transformed with the cutoff
+        // prewarped, one biquad per conjugate pole pair. Passband peaks are
+        // at unity, the ripple dips below.
+        double epsilon = std::sqrt(std::pow(10.0, PROCESSOR_LOWPASS_RIPPLE / 10.0) - 1.0);
+        double v = std::asinh(1.0 / epsilon) / PROCESSOR_LOWPASS_ORDER;
+        double k = 2.0 * sampleRate, cutoff = k * std::tan(M_PI * PROCESSOR_LOWPASS / sampleRate);
+        for (unsigned i = 0; i < PROCESSOR_LOWPASS_ORDER / 2; i++) {
+            double theta = M_PI * (2 * i + 1) / (2 * PROCESSOR_LOWPASS_ORDER);
+            double real = std::sinh(v) * std::sin(theta) * cutoff, imag = std::cosh(v) * std::cos(theta) * cutoff;
+            double w = real * real + imag * imag, a0 = k * k + 2.0 * real * k + w;
+            double gain = (i == 0) ? 1.0 / std::sqrt(1.0 + epsilon * epsilon) : 1.0;
+            sections.push_back({
+                static_cast<float>(gain * w / a0), static_cast<float>(2.0 * gain * w / a0), static_cast<float>(gain * w / a0),
+                static_cast<float>(2.0 * (w - k * k) / a0), static_cast<float>((k * k - 2.0 * real * k + w) / a0)
+            });
+        }
+    }
+    lookahead = std::max(static_cast<unsigned>(std::llround(static_cast<double>(sampleRate) * PROCESSOR_LOOKAHEAD / 1000000.0)), 1u);
+    release = static_cast<float>(1.0 - std::exp(-1000000.0 / (PROCESSOR_RELEASE * static_cast<double>(sampleRate))));
+    required.resize(PROCESSOR_BLOCK_SIZE);
+    gains.resize(PROCESSOR_BLOCK_SIZE);
+    minimumValues.resize(lookahead + 2);
+    minimumPositions.resize(lookahead + 2);
+    averageWindow.assign(lookahead, 1.f);
+    averageSum = lookahead;
+}
+
+void AudioProcessor::SetSource(AudioSource &source)
+{
+    if ((source.GetSampleRate() != sampleRate) || !source.GetChannels()) {
+        throw std::runtime_error("Cannot process " + source.GetName() + ", " + std::to_string(sampleRate) + " Hz source required");
+    }
+    this->source = &source;
+    if (source.GetChannels() != channels) {
+        // Filter state and delayed audio are per channel, the limiter gain
+        // carries over.
+        channels = source.GetChannels();
+        states.assign(sections.size() * channels * 2, 0.f);
+        delay.assign((lookahead + PROCESSOR_BLOCK_SIZE) * channels, 0.f);
+    }
+}
+
+std::string AudioProcessor::GetName() const
+{
+    return source ? source->GetName() : std::string();
+}
+
+unsigned AudioProcessor::GetSampleRate() const
+{
+    return sampleRate;
+}
+
+unsigned AudioProcessor::GetChannels() const
+{
+    return channels;
+}
+
+unsigned AudioProcessor::Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    unsigned produced = 0;
+    while (produced < frames) {
+        unsigned requested = std::min(frames - produced, static_cast<unsigned>(PROCESSOR_BLOCK_SIZE));
+        float *block = &samples[produced * channels];
+        unsigned quantity = source->Read(block, requested, enable, mtx);
+        Filter(block, quantity);
+        Limit(block, quantity, block);
+        produced += quantity;
+        if (quantity < requested) {
+            break;
+        }
+    }
+    return produced;
+}
+
+void AudioProcessor::Filter(float *samples, unsigned count)
+{
+    // The recursion is serial, so sections run one after another over the
+    // whole block with their state in registers.
+    for (unsigned channel = 0; channel < channels; channel++) {
+        for (unsigned i = 0; i < sections.size(); i++) {
+            const Section section = sections[i];
+            float *state = &states[(channel * sections.size() + i) * 2];
+            float first = state[0], second = state[1];
+            for (unsigned j = channel; j < count * channels; j += channels) {
+                float input = samples[j], output = section.b0 * input + first;
+                first = section.b1 * input - section.a1 * output + second;
+                second = section.b2 * input - section.a2 * output;
+                samples[j] = output;
+            }
+            // Decaying state would otherwise end up denormal on silence.
+            state[0] = (std::fabs(first) < 1e-20f) ? 0.f : first;
+            state[1] = (std::fabs(second) < 1e-20f) ? 0.f : second;
+        }
+    }
+}
+
+void AudioProcessor::Limit(const float *samples, unsigned count, float *output)
+{
+    float *incoming = &delay[lookahead * channels];
+    std::memcpy(incoming, samples, count * channels * sizeof(float));
+    GetRequiredGains(incoming, count, channels, required.data());
+
+    unsigned capacity = lookahead + 2;
+    for (unsigned i = 0; i < count; i++, position++) {
+        // Sliding minimum over the last lookahead + 1 frames, a monotonic
+        // queue keeps it O(1) per frame.
+        while ((minimumHead != minimumTail) && (minimumValues[(minimumTail + capacity - 1) % capacity] >= required[i])) {
+            minimumTail = (minimumTail + capacity - 1) % capacity;
+        }
+        minimumValues[minimumTail] = required[i];
+        minimumPositions[minimumTail] = position;
+        minimumTail = (minimumTail + 1) % capacity;
+        while (minimumPositions[minimumHead] + lookahead < position) {
+            minimumHead = (minimumHead + 1) % capacity;
+        }
+        envelope = std::min(minimumValues[minimumHead], envelope + (1.f - envelope) * release);
+        averageSum += envelope - averageWindow[averagePosition];
+        averageWindow[averagePosition] = envelope;
+        averagePosition = (averagePosition + 1 == lookahead) ? 0 : averagePosition + 1;
+        gains[i] = static_cast<float>(averageSum / lookahead);
+    }
+
+    ApplyGains(delay.data(), gains.data(), count, channels, output);
+    std::memmove(delay.data(), &delay[count * channels], lookahead * channels * sizeof(float));
+}
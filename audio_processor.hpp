@@ -0,0 +1,92 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "audio_source.hpp"
+#include <cstdint>
+#include <vector>
+
+#define PROCESSOR_LOWPASS 15000
+#define PROCESSOR_LOWPASS_ORDER 8
+#define PROCESSOR_LOWPASS_RIPPLE 0.5
+#define PROCESSOR_EMPHASIS_LIMIT 20000
+#define PROCESSOR_LOOKAHEAD 1500
+#define PROCESSOR_RELEASE 50000
+#define PROCESSOR_CEILING 0.99f
+#define PROCESSOR_BLOCK_SIZE 1024
+
+// Broadcast processing between a source and the divisor conversion:
+// pre-emphasis (50 or 75 us, 0 disables it), a Chebyshev lowpass at
+// PROCESSOR_LOWPASS (applied when the rate leaves room for it) and a
+// lookahead peak limiter holding every channel below PROCESSOR_CEILING.
+//
+// The limiter delays audio by PROCESSOR_LOOKAHEAD. The gain is the minimum of
+// the required gain over the lookahead window with an exponential release,
+// smoothed by a moving average of the same length, so it is already down
+// when a peak comes out of the delay line. Like MpxEncoder the processor
+// outlives its sources, so filter and limiter state carry over between
+// spliced files; a session starts with PROCESSOR_LOOKAHEAD of silence and its
+// last PROCESSOR_LOOKAHEAD is not played.
+class AudioProcessor : public AudioSource
+{
+    public:
+        AudioProcessor(unsigned sampleRate, unsigned preEmphasis);
+        AudioProcessor(const AudioProcessor &) = delete;
+        AudioProcessor(AudioProcessor &&) = delete;
+        AudioProcessor &operator=(const AudioProcessor &) = delete;
+        void SetSource(AudioSource &source);
+        std::string GetName() const;
+        unsigned GetSampleRate() const;
+        unsigned GetChannels() const;
+        unsigned Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx);
+    private:
+        struct Section
+        {
+            float b0, b1, b2, a1, a2;
+        };
+
+        void Filter(float *samples, unsigned count);
+        void Limit(const float *samples, unsigned count, float *output);
+
+        AudioSource *source;
+        unsigned sampleRate, channels, lookahead;
+        std::vector<Section> sections;
+        std::vector<float> states, delay, required, gains;
+        std::vector<float> minimumValues, averageWindow;
+        std::vector<uint64_t> minimumPositions;
+        unsigned minimumHead, minimumTail, averagePosition;
+        uint64_t position;
+        double averageSum;
+        float envelope, release;
+};
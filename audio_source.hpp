@@ -35,18 +35,34 @@
 #define AUDIO_SOURCE_HPP
 
 #include "sample.hpp"
-#include <vector>
+#include <mutex>
+#include <string>
 
+// Pull-based source of normalized (-1 - 1) interleaved float frames. Read
+// fills the caller's buffer and returns fewer frames than requested only when
+// the source has ended or the program is being stopped (enable cleared).
 class AudioSource
 {
     public:
-        virtual uint16_t GetChannels() = 0;
-        virtual uint32_t GetSampleRate() = 0;
-        virtual uint16_t GetBitsPerSample() = 0;
-        virtual float GetNextSample() = 0;
-        virtual std::vector<Sample> GetSamples(unsigned quantity, bool &stop) = 0;
-	virtual bool SetSampleOffset(unsigned offset) = 0;
-
+        virtual ~AudioSource() { }
+        virtual std::string GetName() const = 0;
+        virtual unsigned GetSampleRate() const = 0;
+        virtual unsigned GetChannels() const = 0;
+        virtual unsigned Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx) = 0;
+        // Sources backed by a regular file named GetName() may have their
+        // divisors cached.
+        virtual bool IsCacheable() const { return false; }
+        // Sources decoding PCM themselves can also deliver Q15 or Q31 frames
+        // for the fixed-point pipeline, ReadFixed is only valid when
+        // IsFixedPoint() is true.
+        virtual bool IsFixedPoint() const { return false; }
+        virtual unsigned ReadFixed(Q15 *samples, unsigned frames, bool &enable, std::mutex &mtx) { return 0; }
+        virtual unsigned ReadFixed(Q31 *samples, unsigned frames, bool &enable, std::mutex &mtx) { return 0; }
+        // Mono 8 or 16-bit PCM sources can also hand out their raw
+        // little-endian codes, quantity works like the frame count of Read.
+        // GetRawBits() is 0 when they cannot.
+        virtual unsigned GetRawBits() const { return 0; }
+        virtual const uint8_t *GetRawSamples(unsigned &quantity, bool &enable, std::mutex &mtx) { return nullptr; }
 };
 
 #endif // AUDIO_SOURCE_HPP
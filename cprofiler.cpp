@@ -1,10 +1,394 @@
 #include "cprofiler.hpp"
+#include <iomanip>
+#include <map>
+#include <memory>
 
-namespace TrentCode 
+namespace TrentCode
 {
-thread_local std::list<std::string> path;
-thread_local std::map<std::string, StatsNode> statsMap;
-thread_local unsigned int callDepth = 0;
-thread_local unsigned int statCount = 0;
 
-};
+static std::mutex registryMutex;
+static std::map<std::string, unsigned int> scopeIds;
+static std::vector<std::string> scopeNames;
+static std::vector<std::shared_ptr<ThreadProfile> > threadProfiles;
+static std::vector<ThreadProfile *> releasedProfiles;
+static thread_local ThreadProfile * threadProfile = NULL;
+static uint64_t referenceTicks, referenceTime;
+static double calibratedPeriod = 0.0;
+
+// The tick period is estimated once over a short interval (good enough for
+// scheduling aggregation) and refined against the first reference point when
+// reporting.
+static void calibrate()
+{
+    if (calibratedPeriod == 0.0) {
+        referenceTicks = ticks();
+        referenceTime = now();
+        uint64_t time;
+        do {
+            time = now();
+        } while (time - referenceTime < 2000000);
+        calibratedPeriod = static_cast<double>(time - referenceTime) / (ticks() - referenceTicks);
+    }
+}
+
+double getTickPeriod()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    calibrate();
+    uint64_t elapsedTicks = ticks() - referenceTicks, elapsedTime = now() - referenceTime;
+    return (elapsedTicks && (elapsedTime > 1000000000)) ? static_cast<double>(elapsedTime) / elapsedTicks : calibratedPeriod;
+}
+
+static unsigned int getBucket(uint64_t value)
+{
+    if (value < 2) {
+        return value;
+    }
+    unsigned int exponent = 63 - __builtin_clzll(value);
+    return 2 * exponent + ((value >> (exponent - 1)) & 0x01);
+}
+
+static uint64_t getBucketValue(unsigned int bucket)
+{
+    if (bucket < 2) {
+        return bucket;
+    }
+    unsigned int exponent = bucket / 2;
+    return (1ULL << exponent) + (bucket % 2) * (1ULL << (exponent - 1));
+}
+
+static uint64_t getPercentile(const NodeStats &stats, unsigned int percent)
+{
+    uint64_t rank = (stats.count * percent + 99) / 100, count = 0;
+    for (unsigned int i = 0; i < histogramSize; i++) {
+        count += stats.histogram[i];
+        if (count >= rank) {
+            uint64_t value = getBucketValue(i);
+            return (value < stats.min) ? stats.min : ((value > stats.max) ? stats.max : value);
+        }
+    }
+    return stats.max;
+}
+
+unsigned int intern(const char * name)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::pair<std::map<std::string, unsigned int>::iterator, bool> item =
+        scopeIds.insert(std::pair<std::string, unsigned int>(name, scopeNames.size()));
+    if (item.second) {
+        scopeNames.push_back(name);
+    }
+    return item.first->second;
+}
+
+// Profiles of exited threads are handed over to the next new thread, so
+// threads restarted for every file (prefetch, transmit) keep accumulating
+// into one timeline instead of growing the registry.
+class ProfileRelease
+{
+public:
+    ~ProfileRelease()
+    {
+        if (NULL != threadProfile) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            releasedProfiles.push_back(threadProfile);
+        }
+    }
+}; // class ProfileRelease
+
+static thread_local ProfileRelease profileRelease;
+
+ThreadProfile &getThreadProfile()
+{
+    if (NULL == threadProfile) {
+        (void)&profileRelease;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        calibrate();
+        if (!releasedProfiles.empty()) {
+            threadProfile = releasedProfiles.back();
+            releasedProfiles.pop_back();
+        } else {
+            threadProfiles.push_back(std::make_shared<ThreadProfile>(threadProfiles.size()));
+            threadProfile = threadProfiles.back().get();
+        }
+    }
+    return *threadProfile;
+}
+
+static std::vector<std::shared_ptr<ThreadProfile> > getThreadProfiles()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return threadProfiles;
+}
+
+static std::vector<std::string> getScopeNames()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return scopeNames;
+}
+
+static std::string escape(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text) {
+        if ((c == '"') || (c == '\\')) {
+            escaped += '\\';
+        }
+        escaped += (static_cast<unsigned char>(c) < 0x20) ? ' ' : c;
+    }
+    return escaped;
+}
+
+void aggregate()
+{
+    for (std::shared_ptr<ThreadProfile> &profile : getThreadProfiles()) {
+        profile->aggregate();
+    }
+}
+
+void setThreadName(const char * name)
+{
+    getThreadProfile().setName(name);
+}
+
+void report(std::ostream &stream)
+{
+    for (std::shared_ptr<ThreadProfile> &profile : getThreadProfiles()) {
+        profile->report(stream);
+    }
+}
+
+void writeChromeTrace(std::ostream &stream)
+{
+    std::vector<std::shared_ptr<ThreadProfile> > profiles = getThreadProfiles();
+    std::vector<std::string> names = getScopeNames();
+    double period = getTickPeriod();
+    uint64_t origin;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        origin = referenceTicks;
+    }
+    stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << std::endl;
+    stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"fm_transmitter\"}}";
+    for (std::shared_ptr<ThreadProfile> &profile : profiles) {
+        profile->writeTraceEvents(stream, names, period, origin);
+    }
+    stream << std::endl << "]}" << std::endl;
+}
+
+void writeFoldedStacks(std::ostream &stream)
+{
+    std::vector<std::shared_ptr<ThreadProfile> > profiles = getThreadProfiles();
+    std::vector<std::string> names = getScopeNames();
+    double period = getTickPeriod();
+    for (std::shared_ptr<ThreadProfile> &profile : profiles) {
+        profile->writeFoldedStacks(stream, names, period);
+    }
+}
+
+ThreadProfile::ThreadProfile(unsigned int id) : id(id), nodeCount(1), callDepth(0), timelineCount(0), dropped(0)
+{
+    nodes[0].scope = untracked;
+    nodes[0].parent = untracked;
+    for (Slot &slot : slots) {
+        slot.node = untracked;
+    }
+    stack[0] = 0;
+    samples.Reset(ringSize);
+    aggregationTicks = static_cast<uint64_t>(aggregationPeriod * 1000000000.0 / calibratedPeriod);
+    nextAggregation = ticks() + aggregationTicks;
+}
+
+unsigned int ThreadProfile::enter(unsigned int scope)
+{
+    if (callDepth >= maxCallDepth) {
+        callDepth++;
+        return untracked;
+    }
+    unsigned int parent = stack[callDepth];
+    unsigned int node = untracked;
+    const unsigned int slotCount = sizeof(slots) / sizeof(Slot);
+    for (unsigned int i = 0, index = (parent * 31 + scope) % slotCount; i < slotCount; i++, index = (index + 1) % slotCount) {
+        Slot &slot = slots[index];
+        if ((slot.node != untracked) && (slot.parent == parent) && (slot.scope == scope)) {
+            node = slot.node;
+            break;
+        }
+        if (slot.node == untracked) {
+            unsigned int count = nodeCount.load(std::memory_order_relaxed);
+            if (count < maxNodeCount) {
+                nodes[count].scope = scope;
+                nodes[count].parent = parent;
+                nodes[count].stats = NodeStats();
+                nodes[count].stats.min = UINT64_MAX;
+                slot.parent = parent;
+                slot.scope = scope;
+                slot.node = count;
+                node = count;
+                nodeCount.store(count + 1, std::memory_order_release);
+            }
+            break;
+        }
+    }
+    stack[++callDepth] = node;
+    return node;
+}
+
+void ThreadProfile::leave(unsigned int node, uint64_t startTime)
+{
+    uint64_t endTime = ticks();
+    if (callDepth) {
+        callDepth--;
+    }
+    if (node == untracked) {
+        return;
+    }
+    Sample sample;
+    sample.node = node;
+    sample.start = startTime;
+    sample.duration = endTime - startTime;
+    if (!samples.Push(&sample, 1)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    if ((samples.GetSize() >= maxStatCount) || (endTime >= nextAggregation)) {
+        if (mtx.try_lock()) {
+            drain();
+            mtx.unlock();
+        }
+        nextAggregation = endTime + aggregationTicks;
+    }
+}
+
+void ThreadProfile::aggregate()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    drain();
+}
+
+void ThreadProfile::drain()
+{
+    Sample buffer[64];
+    std::size_t count;
+    while ((count = samples.Pop(buffer, sizeof(buffer) / sizeof(Sample))) > 0) {
+        for (std::size_t i = 0; i < count; i++) {
+            NodeStats &stats = nodes[buffer[i].node].stats;
+            uint64_t duration = buffer[i].duration;
+            stats.count++;
+            stats.total += duration;
+            stats.min = (duration < stats.min) ? duration : stats.min;
+            stats.max = (duration > stats.max) ? duration : stats.max;
+            stats.histogram[getBucket(duration)]++;
+            timeline[timelineCount++ % timelineSize] = buffer[i];
+        }
+    }
+}
+
+void ThreadProfile::setName(const char * name)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    this->name = name;
+}
+
+// Must be called with mtx held.
+std::string ThreadProfile::getLabel()
+{
+    return name.empty() ? "Thread " + std::to_string(id) : name;
+}
+
+// Must be called with mtx held.
+std::string ThreadProfile::getPath(unsigned int node, const std::vector<std::string> &names, char separator)
+{
+    std::string path;
+    for (; node && (node != untracked); node = nodes[node].parent) {
+        path = path.empty() ? names[nodes[node].scope] : names[nodes[node].scope] + separator + path;
+    }
+    return path;
+}
+
+void ThreadProfile::report(std::ostream &stream)
+{
+    std::vector<std::string> names = getScopeNames();
+    double period = getTickPeriod();
+    auto toTime = [&](uint64_t value) -> uint64_t {
+        return static_cast<uint64_t>(value * period);
+    };
+    std::lock_guard<std::mutex> lock(mtx);
+    drain();
+
+    unsigned int count = nodeCount.load(std::memory_order_acquire);
+    std::vector<std::vector<unsigned int> > children(count);
+    for (unsigned int i = 1; i < count; i++) {
+        children[nodes[i].parent].push_back(i);
+    }
+
+    stream << getLabel() << " (" << dropped.load(std::memory_order_relaxed) << " samples dropped)" << std::endl;
+    std::vector<std::pair<unsigned int, unsigned int> > pending;
+    for (auto it = children[0].rbegin(); it != children[0].rend(); it++) {
+        pending.push_back(std::make_pair(*it, 1));
+    }
+    while (!pending.empty()) {
+        unsigned int node = pending.back().first, depth = pending.back().second;
+        pending.pop_back();
+        const NodeStats &stats = nodes[node].stats;
+        stream << std::string(2 * depth, ' ') << names[nodes[node].scope] << ": " << stats.count << " calls";
+        if (stats.count) {
+            stream << ", mean " << toTime(stats.total / stats.count) << " ns, min " << toTime(stats.min)
+                << " ns, p50 " << toTime(getPercentile(stats, 50)) << " ns, p90 " << toTime(getPercentile(stats, 90))
+                << " ns, p99 " << toTime(getPercentile(stats, 99)) << " ns, max " << toTime(stats.max) << " ns";
+        }
+        stream << std::endl;
+        for (auto it = children[node].rbegin(); it != children[node].rend(); it++) {
+            pending.push_back(std::make_pair(*it, depth + 1));
+        }
+    }
+}
+
+void ThreadProfile::writeTraceEvents(std::ostream &stream, const std::vector<std::string> &names, double period, uint64_t origin)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    drain();
+
+    std::ios::fmtflags flags = stream.flags();
+    stream << std::fixed << std::setprecision(3);
+    stream << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << id
+        << ",\"args\":{\"name\":\"" << escape(getLabel()) << "\"}}";
+    stream << "," << std::endl << "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << id
+        << ",\"args\":{\"sort_index\":" << id << "}}";
+    uint64_t first = (timelineCount > timelineSize) ? timelineCount - timelineSize : 0;
+    for (uint64_t i = first; i < timelineCount; i++) {
+        const Sample &sample = timeline[i % timelineSize];
+        double start = static_cast<int64_t>(sample.start - origin) * period / 1000.0;
+        stream << "," << std::endl << "{\"name\":\"" << escape(names[nodes[sample.node].scope])
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << id << ",\"ts\":" << start
+            << ",\"dur\":" << sample.duration * period / 1000.0
+            << ",\"args\":{\"path\":\"" << escape(getPath(sample.node, names, '/')) << "\"}}";
+    }
+    if (first) {
+        stream << "," << std::endl << "{\"name\":\"timeline truncated\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << id
+            << ",\"ts\":" << static_cast<int64_t>(timeline[first % timelineSize].start - origin) * period / 1000.0
+            << ",\"args\":{\"dropped\":" << first << "}}";
+    }
+    stream.flags(flags);
+}
+
+void ThreadProfile::writeFoldedStacks(std::ostream &stream, const std::vector<std::string> &names, double period)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    drain();
+
+    unsigned int count = nodeCount.load(std::memory_order_acquire);
+    std::vector<uint64_t> children(count, 0);
+    for (unsigned int i = 1; i < count; i++) {
+        children[nodes[i].parent] += nodes[i].stats.total;
+    }
+    std::string label = getLabel();
+    for (unsigned int i = 1; i < count; i++) {
+        uint64_t total = nodes[i].stats.total;
+        uint64_t self = static_cast<uint64_t>(((total > children[i]) ? total - children[i] : 0) * period / 1000.0);
+        if (self) {
+            stream << label << ';' << getPath(i, names, ';') << ' ' << self << std::endl;
+        }
+    }
+}
+
+} // namespace TrentCode
@@ -1,16 +1,17 @@
 
 #pragma once
 
-#include <string>
-#include <iostream>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
 #include <mutex>
-#include <map>
-#include <list>
-#include <sstream>
-#include <chrono>
-#include <queue>
-#include "statsnode.hpp"
-#include "stat.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "ring_buffer.hpp"
 
 namespace TrentCode
 {
@@ -18,57 +19,141 @@ namespace TrentCode
 const unsigned int aggregationPeriod = 60; // aggregate every one minute
 const unsigned int maxStatCount = 1000; // force aggregation at this size
 const unsigned int maxCallDepth = 10; // max call depth.
+const unsigned int maxNodeCount = 256; // distinct call paths per thread
+const unsigned int ringSize = 4096; // pending samples per thread
+const unsigned int histogramSize = 128; // two buckets per power of two ticks
+const unsigned int timelineSize = 8192; // most recent samples kept per thread for trace export
+const unsigned int untracked = 0xffffffff;
 
-extern thread_local std::list<std::string> path;
-extern thread_local std::map<std::string, StatsNode> statsMap;
-extern thread_local unsigned int callDepth;
-extern thread_local unsigned int statCount;
+struct Sample
+{
+    uint32_t node;
+    uint64_t start;
+    uint64_t duration;
+};
 
-class Observation
+struct NodeStats
+{
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint32_t histogram[histogramSize];
+};
+
+struct Node
+{
+    unsigned int scope;
+    unsigned int parent;
+    NodeStats stats;
+};
+
+// Profile of a single thread, all durations are kept in ticks. enter/leave are only called by the owning
+// thread and never allocate, lock or do I/O: finished scopes are pushed into
+// a lock-free ring which is drained into per call path statistics either by
+// the owning thread (every aggregationPeriod seconds or when maxStatCount
+// samples are pending, if nobody else is aggregating) or by aggregate().
+class ThreadProfile
 {
-    StatsNode * nodePtr = NULL;
 public:
+    ThreadProfile(unsigned int id);
+    unsigned int enter(unsigned int scope);
+    void leave(unsigned int node, uint64_t startTime);
+    void aggregate();
+    void setName(const char * name);
+    void report(std::ostream &stream);
+    void writeTraceEvents(std::ostream &stream, const std::vector<std::string> &names, double period, uint64_t origin);
+    void writeFoldedStacks(std::ostream &stream, const std::vector<std::string> &names, double period);
 
-    Observation(const char * name)
-    { 
-        path.push_back(name);
-        std::pair<std::map<std::string, StatsNode >::iterator, bool > item = 
-            statsMap.insert(std::pair<std::string,StatsNode>(getPath(), StatsNode()));
-        nodePtr = &(*item.first).second;
-        nodePtr->start();
-    }
+private:
+    struct Slot
+    {
+        unsigned int parent;
+        unsigned int scope;
+        unsigned int node;
+    };
 
-    std::string getPath() {
-        std::ostringstream os;
-        for (std::string s : path) {
-            os << s << ":";
-        }
-        return os.str();
-    }
+    void drain();
+    std::string getPath(unsigned int node, const std::vector<std::string> &names, char separator);
+    std::string getLabel();
+
+    unsigned int id;
+    std::string name;
+    std::mutex mtx;
+    Node nodes[maxNodeCount];
+    std::atomic<unsigned int> nodeCount;
+    Slot slots[4 * maxNodeCount];
+    unsigned int stack[maxCallDepth + 1];
+    unsigned int callDepth;
+    RingBuffer<Sample> samples;
+    Sample timeline[timelineSize];
+    uint64_t timelineCount;
+    uint64_t aggregationTicks, nextAggregation;
+    std::atomic<uint64_t> dropped;
+}; // class ThreadProfile
+
+unsigned int intern(const char * name);
+ThreadProfile &getThreadProfile();
+void aggregate();
+void setThreadName(const char * name);
+void report(std::ostream &stream);
 
-    void end() {
-        if (NULL != nodePtr)
-        {
-            statCount++; 
-            callDepth--;
-            std::cout << "OUT " << getPath() << std::endl;
-            nodePtr->end();
-            if (!path.empty()) path.pop_back();
-            nodePtr = NULL;
-
-            // check if it is time to 
-            if (statCount > maxStatCount) {
-                // aggregate stats. 
-            }
-        }
+// Exports of everything aggregated so far, across all threads. The Chrome
+// trace holds the most recent timelineSize scopes of each thread as complete
+// events (load it in chrome://tracing or Perfetto), folded stacks hold the
+// self time of every call path in microseconds (input for flamegraph.pl).
+void writeChromeTrace(std::ostream &stream);
+void writeFoldedStacks(std::ostream &stream);
+
+inline uint64_t now()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// Cheapest monotonic counter available: TSC on x86, the generic timer on
+// AArch64, clock_gettime (nanoseconds) elsewhere.
+inline uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return now();
+#endif
+}
+
+double getTickPeriod(); // nanoseconds per tick
+
+class Observation
+{
+    ThreadProfile &profile;
+    unsigned int node;
+    uint64_t startTime;
+public:
+
+    Observation(unsigned int scope) : profile(getThreadProfile()), node(profile.enter(scope)), startTime(ticks())
+    {
     }
 
-    ~Observation() 
+    Observation(const Observation &) = delete;
+    Observation &operator=(const Observation &) = delete;
+
+    ~Observation()
     {
-        end();
+        profile.leave(node, startTime);
     }
 }; // class Observation
 
 } // namespace TrentCode
 
-#define CPROF TrentCode::Observation TrentCode(__func__)
+#define CPROF_CONCAT_(a, b) a##b
+#define CPROF_CONCAT(a, b) CPROF_CONCAT_(a, b)
+#define CPROF_NAMED(name) \
+    static const unsigned int CPROF_CONCAT(trentCodeScope, __LINE__) = TrentCode::intern(name); \
+    TrentCode::Observation CPROF_CONCAT(trentCodeObservation, __LINE__)(CPROF_CONCAT(trentCodeScope, __LINE__))
+#define CPROF CPROF_NAMED(__func__)
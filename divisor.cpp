@@ -0,0 +1,444 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "divisor.hpp"
+#include <cmath>
+#include <stdexcept>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+uint32_t GetDivisor(float value, uint32_t clockDivisor, uint32_t divisorRange)
+{
+    return CLK_PASSWORD | (0xffffff & (clockDivisor - static_cast<int32_t>(round(value * divisorRange))));
+}
+
+static void ConvertToDivisorsScalar(const float *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    for (unsigned i = 0; i < frames; i++) {
+        float sum = 0.f;
+        for (unsigned j = 0; j < channels; j++) {
+            sum += samples[j];
+        }
+        divisors[i] = GetDivisor(sum / channels, clockDivisor, divisorRange);
+        samples += channels;
+    }
+}
+
+// Vector kernels downmix frames exactly like the scalar path (stereo as
+// (left + right) / 2, which is exact in float) and reproduce GetDivisor lane
+// by lane: round half away from zero is done as trunc() plus a correction so
+// no lane depends on the current rounding mode.
+#if defined(__AVX2__)
+#define DIVISOR_KERNEL_NAME "AVX2"
+#define VECTOR_FRAMES 8
+
+static inline __m256i ToDivisors(__m256 value, __m256 range, __m256i clockDivisor)
+{
+    value = _mm256_mul_ps(value, range);
+    __m256i truncated = _mm256_cvttps_epi32(value);
+    __m256 fraction = _mm256_sub_ps(value, _mm256_cvtepi32_ps(truncated));
+    __m256i rounded = _mm256_add_epi32(_mm256_sub_epi32(truncated,
+        _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ))),
+        _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(-0.5f), _CMP_LE_OQ)));
+    return _mm256_or_si256(_mm256_and_si256(_mm256_sub_epi32(clockDivisor, rounded), _mm256_set1_epi32(0xffffff)), _mm256_set1_epi32(CLK_PASSWORD));
+}
+
+template <unsigned Channels>
+static inline __m256 LoadValues(const float *samples)
+{
+    if (Channels == 1) {
+        return _mm256_loadu_ps(samples);
+    }
+    __m256 first = _mm256_loadu_ps(samples), second = _mm256_loadu_ps(samples + 8);
+    __m256 left = _mm256_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 right = _mm256_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+    __m256 sum = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_add_ps(left, right)), _MM_SHUFFLE(3, 1, 2, 0)));
+    return _mm256_mul_ps(sum, _mm256_set1_ps(0.5f));
+}
+
+template <unsigned Channels>
+static unsigned ConvertFramesToDivisors(const float *samples, unsigned frames, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    __m256 range = _mm256_set1_ps(static_cast<float>(divisorRange));
+    __m256i carrier = _mm256_set1_epi32(clockDivisor);
+    unsigned i = 0;
+    for (; i + VECTOR_FRAMES <= frames; i += VECTOR_FRAMES) {
+        __m256 values = LoadValues<Channels>(&samples[i * Channels]);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&divisors[i]), ToDivisors(values, range, carrier));
+    }
+    return i;
+}
+#elif defined(__SSE2__)
+#define DIVISOR_KERNEL_NAME "SSE2"
+#define VECTOR_FRAMES 4
+
+static inline __m128i ToDivisors(__m128 value, __m128 range, __m128i clockDivisor)
+{
+    value = _mm_mul_ps(value, range);
+    __m128i truncated = _mm_cvttps_epi32(value);
+    __m128 fraction = _mm_sub_ps(value, _mm_cvtepi32_ps(truncated));
+    __m128i rounded = _mm_add_epi32(_mm_sub_epi32(truncated,
+        _mm_castps_si128(_mm_cmpge_ps(fraction, _mm_set1_ps(0.5f)))),
+        _mm_castps_si128(_mm_cmple_ps(fraction, _mm_set1_ps(-0.5f))));
+    return _mm_or_si128(_mm_and_si128(_mm_sub_epi32(clockDivisor, rounded), _mm_set1_epi32(0xffffff)), _mm_set1_epi32(CLK_PASSWORD));
+}
+
+template <unsigned Channels>
+static inline __m128 LoadValues(const float *samples)
+{
+    if (Channels == 1) {
+        return _mm_loadu_ps(samples);
+    }
+    __m128 first = _mm_loadu_ps(samples), second = _mm_loadu_ps(samples + 4);
+    __m128 left = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 right = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_mul_ps(_mm_add_ps(left, right), _mm_set1_ps(0.5f));
+}
+
+template <unsigned Channels>
+static unsigned ConvertFramesToDivisors(const float *samples, unsigned frames, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    __m128 range = _mm_set1_ps(static_cast<float>(divisorRange));
+    __m128i carrier = _mm_set1_epi32(clockDivisor);
+    unsigned i = 0;
+    for (; i + VECTOR_FRAMES <= frames; i += VECTOR_FRAMES) {
+        __m128 values = LoadValues<Channels>(&samples[i * Channels]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&divisors[i]), ToDivisors(values, range, carrier));
+    }
+    return i;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define DIVISOR_KERNEL_NAME "NEON"
+#define VECTOR_FRAMES 4
+
+static inline uint32x4_t ToDivisors(float32x4_t value, float32x4_t range, int32x4_t clockDivisor)
+{
+    value = vmulq_f32(value, range);
+    int32x4_t truncated = vcvtq_s32_f32(value);
+    float32x4_t fraction = vsubq_f32(value, vcvtq_f32_s32(truncated));
+    int32x4_t rounded = vaddq_s32(vsubq_s32(truncated,
+        vreinterpretq_s32_u32(vcgeq_f32(fraction, vdupq_n_f32(0.5f)))),
+        vreinterpretq_s32_u32(vcleq_f32(fraction, vdupq_n_f32(-0.5f))));
+    return vorrq_u32(vandq_u32(vreinterpretq_u32_s32(vsubq_s32(clockDivisor, rounded)), vdupq_n_u32(0xffffff)), vdupq_n_u32(CLK_PASSWORD));
+}
+
+template <unsigned Channels>
+static inline float32x4_t LoadValues(const float *samples)
+{
+    if (Channels == 1) {
+        return vld1q_f32(samples);
+    }
+    float32x4x2_t frames = vld2q_f32(samples);
+    return vmulq_f32(vaddq_f32(frames.val[0], frames.val[1]), vdupq_n_f32(0.5f));
+}
+
+template <unsigned Channels>
+static unsigned ConvertFramesToDivisors(const float *samples, unsigned frames, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    float32x4_t range = vdupq_n_f32(static_cast<float>(divisorRange));
+    int32x4_t carrier = vdupq_n_s32(clockDivisor);
+    unsigned i = 0;
+    for (; i + VECTOR_FRAMES <= frames; i += VECTOR_FRAMES) {
+        vst1q_u32(&divisors[i], ToDivisors(LoadValues<Channels>(&samples[i * Channels]), range, carrier));
+    }
+    return i;
+}
+#else
+#define DIVISOR_KERNEL_NAME "scalar"
+#endif
+
+void ConvertToDivisors(const float *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    unsigned converted = 0;
+#ifdef VECTOR_FRAMES
+    if (channels == 1) {
+        converted = ConvertFramesToDivisors<1>(samples, frames, clockDivisor, divisorRange, divisors);
+    } else if (channels == 2) {
+        converted = ConvertFramesToDivisors<2>(samples, frames, clockDivisor, divisorRange, divisors);
+    }
+#endif
+    ConvertToDivisorsScalar(&samples[converted * channels], frames - converted, channels, clockDivisor, divisorRange, &divisors[converted]);
+}
+
+static inline int64_t FloorDivide(int64_t value, int64_t divisor)
+{
+    return (value >= 0) ? value / divisor : -((divisor - 1 - value) / divisor);
+}
+
+// Channels is 0 when only known at run time, mono and stereo frames are
+// averaged with shifts.
+template <unsigned Channels>
+static inline int32_t GetOffset(const Q15 *frame, unsigned channels, uint32_t divisorRange)
+{
+    channels = Channels ? Channels : channels;
+    int64_t sum = 0;
+    for (unsigned i = 0; i < channels; i++) {
+        sum += frame[i];
+    }
+    int64_t value = sum * divisorRange + (static_cast<int64_t>(channels) << 14);
+    return static_cast<int32_t>((channels <= 2) ? value >> (14 + channels) : FloorDivide(value, static_cast<int64_t>(channels) << 15));
+}
+
+template <unsigned Channels>
+static inline int32_t GetOffset(const Q31 *frame, unsigned channels, uint32_t divisorRange)
+{
+    channels = Channels ? Channels : channels;
+    int64_t sum = 0;
+    for (unsigned i = 0; i < channels; i++) {
+        sum += frame[i];
+    }
+    int64_t mean = (channels <= 2) ? sum >> (channels - 1) : FloorDivide(sum, channels);
+    return static_cast<int32_t>((mean * divisorRange + (1ll << 30)) >> 31);
+}
+
+template <unsigned Channels, typename Sample>
+static void ConvertFixedToDivisorsScalar(const Sample *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    for (unsigned i = 0; i < frames; i++) {
+        divisors[i] = CLK_PASSWORD | (0xffffff & (clockDivisor - GetOffset<Channels>(&samples[i * channels], channels, divisorRange)));
+    }
+}
+
+template <typename Sample>
+static void ConvertFixedToDivisorsScalar(const Sample *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    if (channels == 1) {
+        ConvertFixedToDivisorsScalar<1>(samples, frames, channels, clockDivisor, divisorRange, divisors);
+    } else if (channels == 2) {
+        ConvertFixedToDivisorsScalar<2>(samples, frames, channels, clockDivisor, divisorRange, divisors);
+    } else {
+        ConvertFixedToDivisorsScalar<0>(samples, frames, channels, clockDivisor, divisorRange, divisors);
+    }
+}
+
+// Integer kernels match the scalar fixed-point path bit by bit: Q15 products
+// fit 32 bits for divisorRange below 2^15 (a stereo sum times the range too),
+// Q31 ones are widened to 64 bits and stereo Q31 frames are halved first.
+#if defined(__AVX2__)
+#define Q15_VECTOR_FRAMES 16
+
+static inline __m256i ToDivisors(__m256i offset, __m256i clockDivisor)
+{
+    return _mm256_or_si256(_mm256_and_si256(_mm256_sub_epi32(clockDivisor, offset), _mm256_set1_epi32(0xffffff)), _mm256_set1_epi32(CLK_PASSWORD));
+}
+
+template <unsigned Channels>
+static unsigned ConvertFramesToDivisors(const Q15 *samples, unsigned frames, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    __m256i range = _mm256_set1_epi16(static_cast<int16_t>(divisorRange));
+    __m256i carrier = _mm256_set1_epi32(clockDivisor);
+    unsigned i = 0;
+    for (; i + Q15_VECTOR_FRAMES <= frames; i += Q15_VECTOR_FRAMES) {
+        if (Channels == 1) {
+            __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[i]));
+            __m256i low = _mm256_mullo_epi16(values, range), high = _mm256_mulhi_epi16(values, range);
+            // Unpacks work within 128-bit lanes, the lane permute restores frame order.
+            __m256i first = _mm256_unpacklo_epi16(low, high), second = _mm256_unpackhi_epi16(low, high);
+            __m256i half = _mm256_set1_epi32(1 << 14);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(&divisors[i]), ToDivisors(_mm256_srai_epi32(_mm256_add_epi32(_mm256_permute2x128_si256(first, second, 0x20), half), 15), carrier));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(&divisors[i + 8]), ToDivisors(_mm256_srai_epi32(_mm256_add_epi32(_mm256_permute2x128_si256(first, second, 0x31), half), 15), carrier));
+        } else {
+            // Multiply-add of left and right gives (left + right) * range per frame.
+            __m256i half = _mm256_set1_epi32(1 << 15);
+            for (unsigned j = 0; j < Q15_VECTOR_FRAMES; j += 8) {
+                __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&samples[2 * (i + j)]));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(&divisors[i + j]), ToDivisors(_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(values, range), half), 16), carrier));
+            }
+        }
+    }
+    return i;
+}
+#elif defined(__SSE2__)
+#define Q15_VECTOR_FRAMES 8
+
+static inline __m128i ToDivisors(__m128i offset, __m128i clockDivisor)
+{
+    return _mm_or_si128(_mm_and_si128(_mm_sub_epi32(clockDivisor, offset), _mm_set1_epi32(0xffffff)), _mm_set1_epi32(CLK_PASSWORD));
+}
+
+template <unsigned Channels>
+static unsigned ConvertFramesToDivisors(const Q15 *samples, unsigned frames, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    __m128i range = _mm_set1_epi16(static_cast<int16_t>(divisorRange));
+    __m128i carrier = _mm_set1_epi32(clockDivisor);
+    unsigned i = 0;
+    for (; i + Q15_VECTOR_FRAMES <= frames; i += Q15_VECTOR_FRAMES) {
+        if (Channels == 1) {
+            __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[i]));
+            __m128i low = _mm_mullo_epi16(values, range), high = _mm_mulhi_epi16(values, range);
+            __m128i half = _mm_set1_epi32(1 << 14);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&divisors[i]), ToDivisors(_mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(low, high), half), 15), carrier));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&divisors[i + 4]), ToDivisors(_mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(low, high), half), 15), carrier));
+        } else {
+            __m128i half = _mm_set1_epi32(1 << 15);
+            for (unsigned j = 0; j < Q15_VECTOR_FRAMES; j += 4) {
+                __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&samples[2 * (i + j)]));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(&divisors[i + j]), ToDivisors(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(values, range), half), 16), carrier));
+            }
+        }
+    }
+    return i;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define Q15_VECTOR_FRAMES 8
+#define Q31_VECTOR_FRAMES 4
+
+static inline uint32x4_t ToDivisors(int32x4_t offset, int32x4_t clockDivisor)
+{
+    return vorrq_u32(vandq_u32(vreinterpretq_u32_s32(vsubq_s32(clockDivisor, offset)), vdupq_n_u32(0xffffff)), vdupq_n_u32(CLK_PASSWORD));
+}
+
+template <unsigned Channels>
+static unsigned ConvertFramesToDivisors(const Q15 *samples, unsigned frames, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    int32x4_t carrier = vdupq_n_s32(clockDivisor);
+    unsigned i = 0;
+    for (; i + Q15_VECTOR_FRAMES <= frames; i += Q15_VECTOR_FRAMES) {
+        int32x4_t low, high;
+        if (Channels == 1) {
+            int16x8_t values = vld1q_s16(&samples[i]);
+            int16x4_t range = vdup_n_s16(static_cast<int16_t>(divisorRange));
+            low = vrshrq_n_s32(vmull_s16(vget_low_s16(values), range), 15);
+            high = vrshrq_n_s32(vmull_s16(vget_high_s16(values), range), 15);
+        } else {
+            int16x8x2_t values = vld2q_s16(&samples[2 * i]);
+            low = vrshrq_n_s32(vmulq_n_s32(vaddl_s16(vget_low_s16(values.val[0]), vget_low_s16(values.val[1])), divisorRange), 16);
+            high = vrshrq_n_s32(vmulq_n_s32(vaddl_s16(vget_high_s16(values.val[0]), vget_high_s16(values.val[1])), divisorRange), 16);
+        }
+        vst1q_u32(&divisors[i], ToDivisors(low, carrier));
+        vst1q_u32(&divisors[i + 4], ToDivisors(high, carrier));
+    }
+    return i;
+}
+
+template <unsigned Channels>
+static unsigned ConvertFramesToDivisors(const Q31 *samples, unsigned frames, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    int32x2_t range = vdup_n_s32(divisorRange);
+    int32x4_t carrier = vdupq_n_s32(clockDivisor);
+    unsigned i = 0;
+    for (; i + Q31_VECTOR_FRAMES <= frames; i += Q31_VECTOR_FRAMES) {
+        int32x4_t values;
+        if (Channels == 1) {
+            values = vld1q_s32(&samples[i]);
+        } else {
+            int32x4x2_t stereo = vld2q_s32(&samples[2 * i]);
+            values = vhaddq_s32(stereo.val[0], stereo.val[1]);
+        }
+        int32x4_t offset = vcombine_s32(vrshrn_n_s64(vmull_s32(vget_low_s32(values), range), 31), vrshrn_n_s64(vmull_s32(vget_high_s32(values), range), 31));
+        vst1q_u32(&divisors[i], ToDivisors(offset, carrier));
+    }
+    return i;
+}
+#endif
+
+void ConvertToDivisors(const Q15 *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    unsigned converted = 0;
+#ifdef Q15_VECTOR_FRAMES
+    if (divisorRange < 0x8000) {
+        if (channels == 1) {
+            converted = ConvertFramesToDivisors<1>(samples, frames, clockDivisor, divisorRange, divisors);
+        } else if (channels == 2) {
+            converted = ConvertFramesToDivisors<2>(samples, frames, clockDivisor, divisorRange, divisors);
+        }
+    }
+#endif
+    ConvertFixedToDivisorsScalar(&samples[converted * channels], frames - converted, channels, clockDivisor, divisorRange, &divisors[converted]);
+}
+
+void ConvertToDivisors(const Q31 *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors)
+{
+    unsigned converted = 0;
+#ifdef Q31_VECTOR_FRAMES
+    if (channels == 1) {
+        converted = ConvertFramesToDivisors<1>(samples, frames, clockDivisor, divisorRange, divisors);
+    } else if (channels == 2) {
+        converted = ConvertFramesToDivisors<2>(samples, frames, clockDivisor, divisorRange, divisors);
+    }
+#endif
+    ConvertFixedToDivisorsScalar(&samples[converted * channels], frames - converted, channels, clockDivisor, divisorRange, &divisors[converted]);
+}
+
+DivisorTable::DivisorTable(unsigned bitsPerSample, uint32_t clockDivisor, uint32_t divisorRange)
+    : bits(bitsPerSample)
+{
+    if ((bits != 8) && (bits != 16)) {
+        throw std::runtime_error("Divisor tables require 8 or 16-bit samples");
+    }
+    // Every code is decoded and converted by the regular path once, little
+    // endian like in the file.
+    unsigned size = 1 << bits, bytesPerSample = bits >> 3;
+    std::vector<uint8_t> codes(size * bytesPerSample);
+    for (unsigned i = 0; i < size; i++) {
+        for (unsigned j = 0; j < bytesPerSample; j++) {
+            codes[i * bytesPerSample + j] = static_cast<uint8_t>(i >> (j << 3));
+        }
+    }
+#ifdef FIXED_POINT
+    typedef FixedSample Sample;
+#else
+    typedef float Sample;
+#endif
+    std::vector<Sample> samples(size);
+    GetSampleConverter<Sample>(WAVE_FORMAT_PCM, bits)(codes.data(), size, samples.data());
+    table.resize(size);
+    ConvertToDivisors(samples.data(), size, 1, clockDivisor, divisorRange, table.data());
+}
+
+unsigned DivisorTable::GetBits() const
+{
+    return bits;
+}
+
+void DivisorTable::Convert(const uint8_t *data, unsigned count, uint32_t *divisors) const
+{
+    const uint32_t *values = table.data();
+    if (bits == 8) {
+        for (unsigned i = 0; i < count; i++) {
+            divisors[i] = values[data[i]];
+        }
+    } else {
+        for (unsigned i = 0; i < count; i++) {
+            divisors[i] = values[data[2 * i] | (data[2 * i + 1] << 8)];
+        }
+    }
+}
+
+const char *GetDivisorKernelName()
+{
+    return DIVISOR_KERNEL_NAME;
+}
@@ -0,0 +1,71 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "sample.hpp"
+#include <cstdint>
+#include <vector>
+
+#define CLK_PASSWORD (0x5a << 24)
+
+// Downmixes a block of interleaved normalized frames and converts it into
+// clock divisor register words (CLK_PASSWORD | divisor). Uses NEON, AVX2 or
+// SSE2 kernels for mono and stereo when the build target supports them;
+// results are bit-exact with GetDivisor of the channel mean.
+void ConvertToDivisors(const float *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors);
+// Fixed-point counterparts: the channel mean times divisorRange is computed in
+// integer arithmetic and rounded half up, Q31 frames are averaged before the
+// multiplication. Integer PCM scales differ from the float path by 2^-16 and
+// ties round differently, so results may be one divisor step apart from it.
+// Q15 (divisorRange below 2^15) and Q31 use NEON kernels where available,
+// Q15 also AVX2 or SSE2 ones.
+void ConvertToDivisors(const Q15 *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors);
+void ConvertToDivisors(const Q31 *samples, unsigned frames, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange, uint32_t *divisors);
+// Divisor words of every 8 or 16-bit PCM code for one carrier setting, the
+// same words ConvertToDivisors gives for the decoded codes in this build
+// (float or fixed-point). Mono raw PCM is then converted by plain lookups;
+// the 16-bit table takes 256 KB.
+class DivisorTable
+{
+    public:
+        DivisorTable(unsigned bitsPerSample, uint32_t clockDivisor, uint32_t divisorRange);
+        unsigned GetBits() const;
+        void Convert(const uint8_t *data, unsigned count, uint32_t *divisors) const;
+    private:
+        unsigned bits;
+        std::vector<uint32_t> table;
+};
+
+uint32_t GetDivisor(float value, uint32_t clockDivisor, uint32_t divisorRange);
+const char *GetDivisorKernelName();
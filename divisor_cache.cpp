@@ -0,0 +1,220 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "divisor_cache.hpp"
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <climits>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Bumped whenever the divisor math or the key changes, so caches written by
+// older builds are rebuilt rather than replayed.
+#define DIVISOR_CACHE_VERSION 3
+
+#ifdef FIXED_POINT
+#define DIVISOR_CACHE_CONVERSION FIXED_POINT
+#else
+#define DIVISOR_CACHE_CONVERSION 0
+#endif
+
+struct DivisorCacheHeader
+{
+    uint8_t magic[4];
+    uint32_t version;
+    uint64_t modificationTime;
+    uint64_t fileSize;
+    uint32_t sampleRate;
+    uint32_t clockDivisor;
+    uint32_t divisorRange;
+    uint32_t conversion;
+    uint32_t pipeline;
+    uint32_t pathLength;
+    uint64_t count;
+};
+
+static const uint8_t cacheMagic[4] = { 'F', 'M', 'D', 'C' };
+
+static uint64_t HashKey(const DivisorCacheHeader &key, const std::string &path)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto update = [&](const void *data, std::size_t size) {
+        for (std::size_t i = 0; i < size; i++) {
+            hash = (hash ^ reinterpret_cast<const uint8_t *>(data)[i]) * 0x100000001b3ULL;
+        }
+    };
+    update(path.data(), path.size());
+    update(&key.modificationTime, sizeof(key.modificationTime));
+    update(&key.fileSize, sizeof(key.fileSize));
+    update(&key.sampleRate, sizeof(key.sampleRate));
+    update(&key.clockDivisor, sizeof(key.clockDivisor));
+    update(&key.divisorRange, sizeof(key.divisorRange));
+    update(&key.conversion, sizeof(key.conversion));
+    update(&key.pipeline, sizeof(key.pipeline));
+    return hash;
+}
+
+DivisorCache::DivisorCache(const std::string &directory, const std::string &filename, unsigned sampleRate, uint32_t clockDivisor, uint32_t divisorRange, uint32_t pipeline)
+    : fileDescriptor(-1), mappedFile(nullptr), mappedSize(0), dataOffset(0), count(0)
+{
+    char resolved[PATH_MAX];
+    struct stat fileStat;
+    if (!realpath(filename.c_str(), resolved) || stat(resolved, &fileStat) || !S_ISREG(fileStat.st_mode)) {
+        return;
+    }
+    std::string source(resolved);
+
+    DivisorCacheHeader key;
+    std::memcpy(key.magic, cacheMagic, sizeof(key.magic));
+    key.version = DIVISOR_CACHE_VERSION;
+    key.modificationTime = static_cast<uint64_t>(fileStat.st_mtim.tv_sec) * 1000000000ULL + fileStat.st_mtim.tv_nsec;
+    key.fileSize = fileStat.st_size;
+    key.sampleRate = sampleRate;
+    key.clockDivisor = clockDivisor;
+    key.divisorRange = divisorRange;
+    key.conversion = DIVISOR_CACHE_CONVERSION;
+    key.pipeline = pipeline;
+    key.pathLength = source.size();
+    key.count = 0;
+    dataOffset = (sizeof(DivisorCacheHeader) + source.size() + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(HashKey(key, source)));
+    path = directory + "/" + name + ".fmc";
+
+    int cacheFile = open(path.c_str(), O_RDONLY);
+    if (cacheFile != -1) {
+        if (!fstat(cacheFile, &fileStat) && (static_cast<std::size_t>(fileStat.st_size) > dataOffset)) {
+            void *mapped = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, cacheFile, 0);
+            if (mapped != MAP_FAILED) {
+                mappedFile = reinterpret_cast<uint8_t *>(mapped);
+                mappedSize = fileStat.st_size;
+            }
+        }
+        close(cacheFile);
+        if (mappedFile) {
+            DivisorCacheHeader header;
+            std::memcpy(&header, mappedFile, sizeof(DivisorCacheHeader));
+            uint64_t expected = header.count;
+            header.count = 0;
+            if (!std::memcmp(&header, &key, sizeof(DivisorCacheHeader)) &&
+                !std::memcmp(mappedFile + sizeof(DivisorCacheHeader), source.data(), source.size()) &&
+                (dataOffset + expected * sizeof(uint32_t) == mappedSize)) {
+                madvise(mappedFile, mappedSize, MADV_WILLNEED);
+                madvise(mappedFile, mappedSize, MADV_SEQUENTIAL);
+                count = expected;
+                return;
+            }
+            munmap(mappedFile, mappedSize);
+            mappedFile = nullptr;
+            mappedSize = 0;
+        }
+    }
+
+    temporaryPath = path + ".tmp." + std::to_string(getpid());
+    fileDescriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor == -1) {
+        return;
+    }
+    std::vector<uint8_t> header(dataOffset, 0);
+    std::memcpy(header.data(), &key, sizeof(DivisorCacheHeader));
+    std::memcpy(header.data() + sizeof(DivisorCacheHeader), source.data(), source.size());
+    if (write(fileDescriptor, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+        Discard();
+    }
+}
+
+DivisorCache::~DivisorCache()
+{
+    if (mappedFile) {
+        munmap(mappedFile, mappedSize);
+    }
+    Discard();
+}
+
+bool DivisorCache::IsHit() const
+{
+    return mappedFile != nullptr;
+}
+
+const uint32_t *DivisorCache::GetDivisors() const
+{
+    return mappedFile ? reinterpret_cast<const uint32_t *>(mappedFile + dataOffset) : nullptr;
+}
+
+std::size_t DivisorCache::GetSize() const
+{
+    return mappedFile ? count : 0;
+}
+
+void DivisorCache::Append(const uint32_t *divisors, std::size_t count)
+{
+    if (fileDescriptor == -1) {
+        return;
+    }
+    std::size_t size = sizeof(uint32_t) * count;
+    if (write(fileDescriptor, divisors, size) != static_cast<ssize_t>(size)) {
+        Discard();
+        return;
+    }
+    this->count += count;
+}
+
+void DivisorCache::Commit()
+{
+    if (fileDescriptor == -1) {
+        return;
+    }
+    bool stored = (pwrite(fileDescriptor, &count, sizeof(count), offsetof(DivisorCacheHeader, count)) == sizeof(count)) &&
+        !fsync(fileDescriptor) && !close(fileDescriptor);
+    fileDescriptor = -1;
+    if (!stored || rename(temporaryPath.c_str(), path.c_str())) {
+        unlink(temporaryPath.c_str());
+    }
+    temporaryPath.clear();
+}
+
+void DivisorCache::Discard()
+{
+    if (fileDescriptor != -1) {
+        close(fileDescriptor);
+        unlink(temporaryPath.c_str());
+        fileDescriptor = -1;
+        temporaryPath.clear();
+    }
+}
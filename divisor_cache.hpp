@@ -0,0 +1,78 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Stages between the decoder and the divisors, combined into the pipeline
+// word of the cache key.
+#define DIVISOR_CACHE_RESAMPLED 0x01
+#define DIVISOR_CACHE_STEREO 0x02
+#define DIVISOR_CACHE_RDS 0x04
+#define DIVISOR_CACHE_PROCESSED 0x08
+// Processed streams also hold their pre-emphasis time constant (microseconds)
+// from this bit on.
+#define DIVISOR_CACHE_EMPHASIS_SHIFT 8
+
+// On-disk cache of precomputed clock divisor words for a WAVE file. The cache
+// file is keyed by the source path, its size and mtime, the sample rate, the
+// divisor parameters (derived from the frequency, bandwidth and PLL clock), the
+// pipeline stages and the sample conversion of the build (float or Q15/Q31).
+// When a matching cache exists its divisors are memory-mapped, otherwise the
+// divisors passed to Append are written to a temporary file which is moved
+// into place by Commit once the whole source has been converted.
+class DivisorCache
+{
+    public:
+        DivisorCache(const std::string &directory, const std::string &filename, unsigned sampleRate, uint32_t clockDivisor, uint32_t divisorRange, uint32_t pipeline);
+        virtual ~DivisorCache();
+        DivisorCache(const DivisorCache &) = delete;
+        DivisorCache(DivisorCache &&) = delete;
+        DivisorCache &operator=(const DivisorCache &) = delete;
+        bool IsHit() const;
+        const uint32_t *GetDivisors() const;
+        std::size_t GetSize() const;
+        void Append(const uint32_t *divisors, std::size_t count);
+        void Commit();
+    private:
+        void Discard();
+
+        std::string path, temporaryPath;
+        int fileDescriptor;
+        uint8_t *mappedFile;
+        std::size_t mappedSize, dataOffset;
+        uint64_t count;
+};
@@ -32,18 +32,95 @@
 */
 
 #include "transmitter.hpp"
+#include "simulator.hpp"
+#include "synth.hpp"
+#include "cprofiler.hpp"
+#ifndef SIMULATOR
+#include "hardware.hpp"
+#endif
 #include <iostream>
+#include <fstream>
+#include <chrono>
+#include <atomic>
 #include <csignal>
+#include <thread>
 #include <unistd.h>
 
+// Prefetch (ms) for the synthesizer, which is played live and needs nothing
+// decoded ahead.
+#define SYNTH_PREFETCH_TIME 10
+
 std::mutex mtx;
 bool enable = true;
 Transmitter *transmitter = nullptr;
+std::ostream *console = &std::cout;
+std::atomic<bool> profileRequested(false);
+
+void printHistogram(const std::string &name, const TelemetryHistogram &histogram)
+{
+    std::cout << name << ":";
+    if (Telemetry::GetCount(histogram)) {
+        std::cout << " p50 " << Telemetry::GetPercentile(histogram, 50) << ", p90 " << Telemetry::GetPercentile(histogram, 90)
+            << ", p99 " << Telemetry::GetPercentile(histogram, 99) << ";";
+    }
+    for (unsigned i = 0; i < TELEMETRY_HISTOGRAM_SIZE; i++) {
+        uint32_t count = histogram.counts[i].load(std::memory_order_relaxed);
+        if (!count) {
+            continue;
+        }
+        if (i < 4) {
+            std::cout << " " << i << ": ";
+        } else if (i < TELEMETRY_HISTOGRAM_SIZE - 1) {
+            std::cout << " <" << Telemetry::GetBucketValue(i + 1) << ": ";
+        } else {
+            std::cout << " >=" << Telemetry::GetBucketValue(i) << ": ";
+        }
+        std::cout << count;
+    }
+    std::cout << std::endl;
+}
+
+int printTelemetry(const std::string &name)
+{
+    try {
+        Telemetry telemetry(name, false);
+        TelemetryData &data = telemetry.GetData();
+        std::cout << "PID " << data.pid.load() << ", " << data.sampleRate.load() << " Hz" << std::endl
+            << "Samples: " << data.samples.load() << ", dropped " << data.droppedSamples.load()
+            << ", duplicated " << data.duplicatedSamples.load() << std::endl
+            << "Prefetch underruns: " << data.underruns.load() << ", reader stall " << data.readerStallTime.load() << " us" << std::endl
+            << "DMA refills: " << data.refills.load() << ", late " << data.lateRefills.load() << std::endl;
+        printHistogram("Refill latency (us)", data.refillLatency);
+        printHistogram("Refill headroom (samples)", data.refillHeadroom);
+        printHistogram("CPU timing error (us)", data.timingError);
+    } catch (std::exception &catched) {
+        std::cout << "Error: " << catched.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void writeProfile(const std::string &prefix)
+{
+    std::ofstream trace(prefix + ".json", std::ios::trunc), folded(prefix + ".folded", std::ios::trunc);
+    TrentCode::writeChromeTrace(trace);
+    TrentCode::writeFoldedStacks(folded);
+    if (!trace || !folded) {
+        *console << "Error: cannot write profile " << prefix << std::endl;
+        return;
+    }
+    *console << "Profile written to " << prefix << ".json and " << prefix << ".folded" << std::endl;
+}
+
+void sigUsr1Handler(int sigNum)
+{
+    profileRequested = true;
+}
 
 void sigIntHandler(int sigNum)
 {
     if (transmitter) {
-        std::cout << "Stopping..." << std::endl;
+        *console << "Stopping..." << std::endl;
         transmitter->Stop();
         enable = false;
     }
@@ -53,10 +130,21 @@ int main(int argc, char** argv)
 {
     float frequency = 100.f, bandwidth = 200.f;
     uint16_t dmaChannel = 0;
-    bool showUsage = true, loop = false;
-    int opt, filesOffset;
+    unsigned prefetchTime = 0, bufferTime = 0, segments = 0, spinWindow = 0, transmitRate = 0;
+    int priority = 0, cpu = -1;
+    BufferProfile profile = BufferProfile::Balanced;
+    std::string output, cacheDirectory, telemetryName, profilePrefix, midiPort, rdsName, rdsText;
+    int rdsPi = -1, preEmphasis = -1;
+    RenderFormat format = RenderFormat::Divisor;
+#ifndef SIMULATOR
+    bool simulate = false;
+#else
+    bool simulate = true;
+#endif
+    bool showUsage = true, loop = false, profileSet = false, stereo = false;
+    int opt;
 
-    while ((opt = getopt(argc, argv, "rf:d:b:v")) != -1) {
+    while ((opt = getopt(argc, argv, "rf:d:b:p:l:B:n:P:a:w:o:t:c:m:M:T:S:R:xe:i:N:X:sv")) != -1) {
         switch (opt) {
             case 'r':
                 loop = true;
@@ -70,44 +158,262 @@ int main(int argc, char** argv)
             case 'b':
                 bandwidth = std::stof(optarg);
                 break;
+            case 'p':
+                prefetchTime = std::stoi(optarg);
+                break;
+            case 'l':
+                profileSet = true;
+                if (std::string(optarg) == "live") {
+                    profile = BufferProfile::Live;
+                } else if (std::string(optarg) == "archive") {
+                    profile = BufferProfile::Archive;
+                } else if (std::string(optarg) != "balanced") {
+                    std::cout << "Error: unknown buffer profile " << optarg << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'B':
+                bufferTime = std::stoi(optarg);
+                break;
+            case 'n':
+                segments = std::stoi(optarg);
+                break;
+            case 'P':
+                priority = std::stoi(optarg);
+                break;
+            case 'a':
+                cpu = std::stoi(optarg);
+                break;
+            case 'w':
+                spinWindow = std::stoi(optarg);
+                break;
+            case 'm':
+                telemetryName = optarg;
+                break;
+            case 'M':
+                return printTelemetry(optarg);
+            case 'T':
+                profilePrefix = optarg;
+                break;
+            case 'S':
+                midiPort = optarg;
+                break;
+            case 'R':
+                transmitRate = std::stoi(optarg);
+                break;
+            case 'x':
+                stereo = true;
+                break;
+            case 'e':
+                preEmphasis = std::stoi(optarg);
+                break;
+            case 'i':
+                rdsPi = std::stoi(optarg, nullptr, 16) & 0xffff;
+                break;
+            case 'N':
+                rdsName = optarg;
+                break;
+            case 'X':
+                rdsText = optarg;
+                break;
+            case 'c':
+                cacheDirectory = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 't':
+                if (std::string(optarg) == "frequency") {
+                    format = RenderFormat::Frequency;
+                } else if (std::string(optarg) != "divisor") {
+                    std::cout << "Error: unknown render type " << optarg << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                simulate = true;
+                break;
             case 'v':
                 std::cout << EXECUTABLE << " version: " << VERSION << std::endl;
                 return 0;
         }
     }
-    if (optind < argc) {
-        filesOffset = optind;
+    if ((optind < argc) || !midiPort.empty()) {
         showUsage = false;
     }
     if (showUsage) {
-        std::cout << "Usage: " << EXECUTABLE << " [-f <frequency>] [-b <bandwidth>] [-d <dma_channel>] [-r] <file>" << std::endl;
+        std::cout << "Usage: " << EXECUTABLE << " [-f <frequency>] [-b <bandwidth>] [-d <dma_channel>] [-l live|balanced|archive] [-B <buffer_time>] [-n <segments>] [-p <prefetch_time>] [-P <priority>] [-a <cpu>] [-w <spin_window>] [-R <transmit_rate>] [-x] [-e 0|50|75] [-i <rds_pi>] [-N <rds_ps>] [-X <rds_text>] [-c <cache_dir>] [-m <telemetry_name>] [-T <profile_prefix>] [-o <output> [-t divisor|frequency]] [-s] [-r] <file>" << std::endl
+            << "       " << EXECUTABLE << " [options] -S <midi_port>" << std::endl
+            << "       " << EXECUTABLE << " -M <telemetry_name>" << std::endl;
         return 0;
     }
+    // Notes go on air after the whole buffering, so unless told otherwise the
+    // synthesizer gets the live profile and a minimal prefetch.
+    if (!midiPort.empty() && !profileSet) {
+        profile = BufferProfile::Live;
+        if (!prefetchTime) {
+            prefetchTime = SYNTH_PREFETCH_TIME;
+        }
+    }
 
     int result = EXIT_SUCCESS;
 
     std::signal(SIGINT, sigIntHandler);
     std::signal(SIGTERM, sigIntHandler);
 
+    std::unique_ptr<Backend> backend;
+#ifndef SIMULATOR
+    if (!simulate) {
+        backend.reset(new HardwareBackend());
+    }
+#endif
+    if (simulate) {
+        backend.reset(new SimulatedBackend());
+    }
+
+    std::ofstream file;
+    std::ostream *stream = nullptr;
+    if (!output.empty()) {
+        if (output != "-") {
+            file.open(output, std::ios::binary | std::ios::trunc);
+            stream = &file;
+        } else {
+            stream = &std::cout;
+            console = &std::cerr;
+        }
+        if (!*stream) {
+            std::cout << "Error: cannot open output file " << output << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Profiles are written from a helper thread, on SIGUSR1 and at exit.
+    std::atomic<bool> finished(false);
+    std::thread profileThread;
+    if (!profilePrefix.empty()) {
+        std::signal(SIGUSR1, sigUsr1Handler);
+        profileThread = std::thread([&]() {
+            while (!finished) {
+                if (profileRequested.exchange(false)) {
+                    writeProfile(profilePrefix);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        });
+    }
+
+    std::unique_ptr<Telemetry> telemetry;
+    std::unique_ptr<RdsEncoder> rds;
     try {
-        transmitter = new Transmitter();
-        std::cout << "Broadcasting at " << frequency << " MHz with "
+        if (!telemetryName.empty()) {
+            telemetry.reset(new Telemetry(telemetryName, true));
+        }
+        transmitter = new Transmitter(*backend);
+        transmitter->SetTelemetry(telemetry.get());
+        transmitter->SetBufferProfile(profile);
+        if (bufferTime) {
+            transmitter->SetBufferTime(bufferTime * 1000);
+        }
+        if (segments) {
+            transmitter->SetSegments(segments);
+        }
+        transmitter->SetRealtimePriority(priority);
+        transmitter->SetCpuAffinity(cpu);
+        if (spinWindow) {
+            transmitter->SetSpinWindow(spinWindow);
+        }
+        if (prefetchTime) {
+            transmitter->SetPrefetchTime(prefetchTime * 1000);
+        }
+        transmitter->SetTransmitRate(transmitRate);
+        transmitter->SetStereo(stereo);
+        if (preEmphasis >= 0) {
+            transmitter->SetPreEmphasis(preEmphasis);
+            transmitter->SetProcessing(true);
+        }
+        if ((rdsPi >= 0) || !rdsName.empty() || !rdsText.empty()) {
+            rds.reset(new RdsEncoder((rdsPi >= 0) ? rdsPi : RDS_PI));
+            rds->SetProgramService(rdsName);
+            rds->SetRadioText(rdsText);
+            transmitter->SetRds(rds.get());
+        }
+        if (!cacheDirectory.empty()) {
+            transmitter->SetCacheDirectory(cacheDirectory);
+        }
+        *console << (stream ? "Rendering" : "Broadcasting") << " at " << frequency << " MHz with "
             << bandwidth << " kHz bandwidth" << std::endl;
-        do {
-            std::string filename = argv[optind++];
-            if ((optind == argc) && loop) {
-                optind = filesOffset;
-            }
-            WaveReader reader(filename != "-" ? filename : std::string(), enable, mtx);
+        if (!stream && (dmaChannel != 0xff)) {
+            *console << "Buffer: " << transmitter->GetBufferTime() / 1000 << " ms in "
+                << transmitter->GetSegments() << " segments, prefetch "
+                << transmitter->GetPrefetchTime() / 1000 << " ms" << std::endl;
+        }
+        Playlist playlist(std::vector<std::string>(argv + optind, argv + argc), loop, enable, mtx);
+        // Files are opened by the prefetch thread, about a prefetch period
+        // before they go on air, so they are reported as queued.
+        playlist.SetListener([&](const WaveReader &reader) {
             WaveHeader header = reader.GetHeader();
-            std::cout << "Playing: " << reader.GetFilename() << ", "
+            *console << (stream ? "Rendering: " : "Queued: ") << reader.GetFilename() << ", "
                 << header.sampleRate << " Hz, "
-                << header.bitsPerSample << " bits, "
+                << header.bitsPerSample << ((header.audioFormat == WAVE_FORMAT_IEEE_FLOAT) ? " bits float, " : " bits, ")
                 << ((header.channels > 0x01) ? "stereo" : "mono") << std::endl;
-            transmitter->Transmit(reader, frequency, bandwidth, dmaChannel, optind < argc);
-        } while (enable && (optind < argc));
+        });
+        std::unique_ptr<AudioSource> synth;
+        if (!midiPort.empty()) {
+            Synth *midi = new Synth(midiPort, SYNTH_VOICES, transmitRate ? transmitRate : SYNTH_SAMPLE_RATE);
+            midi->SetLatency(transmitter->GetLatency());
+            synth.reset(midi);
+            *console << (stream ? "Rendering: " : "Playing: ") << synth->GetName() << ", "
+                << synth->GetSampleRate() << " Hz, mono" << std::endl;
+        }
+        if (stream) {
+            while (enable) {
+                std::unique_ptr<AudioSource> source = synth ? std::move(synth) : playlist.Next();
+                if (!source) {
+                    break;
+                }
+                auto start = std::chrono::steady_clock::now();
+                unsigned long long rendered = transmitter->Render(*source, frequency, bandwidth, *stream, format);
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                *console << "Rendered " << rendered << " samples in "
+                    << static_cast<unsigned long long>(elapsed * 1000.0) << " ms ("
+                    << static_cast<unsigned long long>((elapsed > 0.0) ? rendered / elapsed : 0.0) << " samples/s)" << std::endl;
+            }
+        } else {
+            if (synth) {
+                transmitter->Transmit(*synth, frequency, bandwidth, dmaChannel, false);
+            } else {
+                transmitter->Transmit(playlist, frequency, bandwidth, dmaChannel);
+            }
+            PrefetchStats stats = transmitter->GetPrefetchStats();
+            *console << "Prefetch buffer: " << stats.capacity << " samples, "
+                << "low watermark " << stats.lowWatermark << ", "
+                << "high watermark " << stats.highWatermark << ", "
+                << stats.underruns << " underruns" << std::endl;
+            RefillStats refill = transmitter->GetRefillStats();
+            if ((dmaChannel != 0xff) && refill.refills) {
+                *console << "DMA refills: " << refill.refills << " of " << refill.segments << "x"
+                    << refill.segmentSize << " samples, latency p50 " << refill.latency50 << " us, "
+                    << "p90 " << refill.latency90 << " us, p99 " << refill.latency99 << " us, "
+                    << "max " << refill.latencyMax << " us, min headroom " << refill.minHeadroom << " us, "
+                    << refill.lateRefills << " late, CPU " << refill.cpuTime / 1000 << " ms in "
+                    << refill.duration / 1000 << " ms" << std::endl;
+            }
+            TimingStats timing = transmitter->GetTimingStats();
+            if ((dmaChannel == 0xff) && timing.samples) {
+                *console << "CPU timing: " << timing.samples << " samples, " << timing.skipped << " skipped, "
+                    << "max error " << timing.maxError << " us, CPU " << timing.cpuTime / 1000 << " ms in "
+                    << timing.duration / 1000 << " ms" << std::endl << "Timing error:";
+                for (unsigned i = 0; i < TIMING_HISTOGRAM_SIZE; i++) {
+                    if (timing.histogram[i]) {
+                        *console << " " << ((i < TIMING_HISTOGRAM_SIZE - 1) ? "<" : ">=")
+                            << timing.limits[(i < TIMING_HISTOGRAM_SIZE - 1) ? i : i - 1] << " us: " << timing.histogram[i];
+                    }
+                }
+                *console << std::endl;
+            }
+        }
     } catch (std::exception &catched) {
-        std::cout << "Error: " << catched.what() << std::endl;
+        *console << "Error: " << catched.what() << std::endl;
         result = EXIT_FAILURE;
     }
     if (transmitter) {
@@ -115,6 +421,17 @@ int main(int argc, char** argv)
         transmitter = nullptr;
         delete temp;
     }
+    if (simulate && !stream) {
+        SimulatorStats stats = static_cast<SimulatedBackend *>(backend.get())->GetStats();
+        *console << "Simulated " << stats.divisorWrites << " divisor writes in "
+            << stats.duration / 1000000 << " ms, max interval "
+            << stats.maxInterval / 1000 << " us" << std::endl;
+    }
+    if (profileThread.joinable()) {
+        finished = true;
+        profileThread.join();
+        writeProfile(profilePrefix);
+    }
 
     return result;
 }
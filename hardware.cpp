@@ -0,0 +1,321 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "hardware.hpp"
+#include "mailbox.hpp"
+#include "divisor.hpp"
+#include <bcm_host.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define BCM2835_PERI_VIRT_BASE 0x20000000
+#define BCM2711_PERI_VIRT_BASE 0xfe000000
+
+#define BCM2835_MEM_FLAG 0x0c
+#define BCM2711_MEM_FLAG 0x04
+
+#define BCM2835_PLLD_FREQ 500
+#define BCM2711_PLLD_FREQ 750
+
+#define CLK_CTL_SRC_PLLA 0x04
+#define CLK_CTL_SRC_PLLC 0x05
+#define CLK_CTL_SRC_PLLD 0x06
+#define CLK_CTL_ENAB (0x01 << 4)
+#define CLK_CTL_MASH(x) ((x & 0x03) << 9)
+
+#define PWM_CTL_CLRF1 (0x01 << 6)
+#define PWM_CTL_USEF1 (0x01 << 5)
+#define PWM_CTL_RPTL1 (0x01 << 2)
+#define PWM_CTL_MODE1 (0x01 << 1)
+#define PWM_CTL_PWEN1 0x01
+#define PWM_STA_BERR (0x01 << 8)
+#define PWM_STA_GAPO4 (0x01 << 7)
+#define PWM_STA_GAPO3 (0x01 << 6)
+#define PWM_STA_GAPO2 (0x01 << 5)
+#define PWM_STA_GAPO1 (0x01 << 4)
+#define PWM_STA_RERR1 (0x01 << 3)
+#define PWM_STA_WERR1 (0x01 << 2)
+#define PWM_STA_EMPT1 (0x01 << 1)
+#define PWM_STA_FULL1 0x01
+#define PWM_DMAC_ENAB (0x01 << 31)
+#define PWM_DMAC_PANIC(x) ((x & 0x0f) << 8)
+#define PWM_DMAC_DREQ(x) (x & 0x0f)
+
+#define DMA_CS_RESET (0x01 << 31)
+#define DMA_CS_PANIC_PRIORITY(x) ((x & 0x0f) << 20)
+#define DMA_CS_PRIORITY(x) ((x & 0x0f) << 16)
+#define DMA_CS_INT (0x01 << 2)
+#define DMA_CS_END (0x01 << 1)
+#define DMA_CS_ACTIVE 0x01
+
+#define PAGE_SIZE 4096
+
+class Peripherals
+{
+    public:
+        virtual ~Peripherals() {
+            munmap(peripherals, GetSize());
+        }
+        Peripherals(const Peripherals &) = delete;
+        Peripherals(Peripherals &&) = delete;
+        Peripherals &operator=(const Peripherals &) = delete;
+        static Peripherals &GetInstance() {
+            static Peripherals instance;
+            return instance;
+        }
+        uintptr_t GetPhysicalAddress(volatile void *object) const {
+            return PERIPHERALS_PHYS_BASE + (reinterpret_cast<uintptr_t>(object) - reinterpret_cast<uintptr_t>(peripherals));
+        }
+        uintptr_t GetVirtualAddress(uintptr_t offset) const {
+            return reinterpret_cast<uintptr_t>(peripherals) + offset;
+        }
+        static uintptr_t GetVirtualBaseAddress() {
+            return (bcm_host_get_peripheral_size() == BCM2711_PERI_VIRT_BASE) ? BCM2711_PERI_VIRT_BASE : bcm_host_get_peripheral_address();
+        }
+        static float GetClockFrequency() {
+            return (Peripherals::GetVirtualBaseAddress() == BCM2711_PERI_VIRT_BASE) ? BCM2711_PLLD_FREQ : BCM2835_PLLD_FREQ;
+        }
+    private:
+        Peripherals() {
+            int memFd;
+            if ((memFd = open("/dev/mem", O_RDWR | O_SYNC)) < 0) {
+                throw std::runtime_error("Cannot open /dev/mem file (permission denied)");
+            }
+
+            peripherals = mmap(nullptr, GetSize(), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, GetVirtualBaseAddress());
+            close(memFd);
+            if (peripherals == MAP_FAILED) {
+                throw std::runtime_error("Cannot obtain access to peripherals (mmap error)");
+            }
+        }
+        unsigned GetSize() {
+            unsigned size = bcm_host_get_peripheral_size();
+            if (size == BCM2711_PERI_VIRT_BASE) {
+                size = 0x01000000;
+            }
+            return size;
+        }
+
+        void *peripherals;
+};
+
+class HardwareMemory : public AllocatedMemory
+{
+    public:
+        HardwareMemory() = delete;
+        HardwareMemory(unsigned size) {
+            mBoxFd = mbox_open();
+            memSize = size;
+            if (memSize % PAGE_SIZE) {
+                memSize = (memSize / PAGE_SIZE + 1) * PAGE_SIZE;
+            }
+            memHandle = mem_alloc(mBoxFd, size, PAGE_SIZE, (Peripherals::GetVirtualBaseAddress() == BCM2835_PERI_VIRT_BASE) ? BCM2835_MEM_FLAG : BCM2711_MEM_FLAG);
+            if (!memHandle) {
+                mbox_close(mBoxFd);
+                memSize = 0;
+                throw std::runtime_error("Cannot allocate memory (" + std::to_string(size) + " bytes)");
+            }
+            memAddress = mem_lock(mBoxFd, memHandle);
+            memAllocated = mapmem(memAddress & ~0xc0000000, memSize);
+        }
+        virtual ~HardwareMemory() {
+            unmapmem(memAllocated, memSize);
+            mem_unlock(mBoxFd, memHandle);
+            mem_free(mBoxFd, memHandle);
+            mbox_close(mBoxFd);
+            memSize = 0;
+        }
+        HardwareMemory(const HardwareMemory &) = delete;
+        HardwareMemory(HardwareMemory &&) = delete;
+        HardwareMemory &operator=(const HardwareMemory &) = delete;
+        virtual uintptr_t GetPhysicalAddress(volatile void *object) const {
+            return (memSize) ? memAddress + (reinterpret_cast<uintptr_t>(object) - reinterpret_cast<uintptr_t>(memAllocated)) : 0x00000000;
+        }
+        virtual uintptr_t GetBaseAddress() const {
+            return reinterpret_cast<uintptr_t>(memAllocated);
+        }
+    private:
+        unsigned memSize, memHandle;
+        uintptr_t memAddress;
+        void *memAllocated;
+        int mBoxFd;
+};
+
+class Device
+{
+    public:
+        Device() {
+            peripherals = &Peripherals::GetInstance();
+        }
+        Device(const Device &) = delete;
+        Device(Device &&) = delete;
+        Device &operator=(const Device &) = delete;
+    protected:
+        Peripherals *peripherals;
+};
+
+class ClockDevice : public Device
+{
+    public:
+        ClockDevice() = delete;
+        ClockDevice(uintptr_t address, unsigned divisor) {
+            clock = reinterpret_cast<ClockRegisters *>(peripherals->GetVirtualAddress(address));
+            clock->ctl = CLK_PASSWORD | CLK_CTL_SRC_PLLD;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            clock->div = CLK_PASSWORD | (0xffffff & divisor);
+            clock->ctl = CLK_PASSWORD | CLK_CTL_MASH(0x1) | CLK_CTL_ENAB | CLK_CTL_SRC_PLLD;        }
+        virtual ~ClockDevice() {
+            clock->ctl = CLK_PASSWORD | CLK_CTL_SRC_PLLD;
+        }
+    protected:
+        volatile ClockRegisters *clock;
+};
+
+class HardwareClockOutput : public ClockDevice, public ClockOutput
+{
+    public:
+        HardwareClockOutput() = delete;
+#ifndef GPIO21
+        HardwareClockOutput(unsigned divisor) : ClockDevice(CLK0_BASE_OFFSET, divisor) {
+            output = reinterpret_cast<uint32_t *>(peripherals->GetVirtualAddress(GPIO_BASE_OFFSET));
+            *output = (*output & 0xffff8fff) | (0x04 << 12);
+#else
+        HardwareClockOutput(unsigned divisor) : ClockDevice(CLK1_BASE_OFFSET, divisor) {
+            output = reinterpret_cast<uint32_t *>(peripherals->GetVirtualAddress(GPIO_BASE_OFFSET + 0x08));
+            *output = (*output & 0xffffffc7) | (0x02 << 3);
+#endif
+        }
+        virtual ~HardwareClockOutput() {
+#ifndef GPIO21
+            *output = (*output & 0xffff8fff) | (0x01 << 12);
+#else
+            *output = (*output & 0xffffffc7) | (0x02 << 3);
+#endif
+        }
+        virtual void SetDivisor(unsigned divisor) {
+            clock->div = CLK_PASSWORD | (0xffffff & divisor);
+        }
+        virtual uintptr_t GetDivisorAddress() const {
+            return peripherals->GetPhysicalAddress(&clock->div);
+        }
+    private:
+        volatile uint32_t *output;
+};
+
+class HardwarePWMController : public ClockDevice, public PWMController
+{
+    public:
+        HardwarePWMController() = delete;
+        HardwarePWMController(unsigned sampleRate) : ClockDevice(PWMCLK_BASE_OFFSET, static_cast<unsigned>(Peripherals::GetClockFrequency() * 1000000.f * (0x01 << 12) / (PWM_WRITES_PER_SAMPLE * PWM_CHANNEL_RANGE * sampleRate))) {
+            pwm = reinterpret_cast<PWMRegisters *>(peripherals->GetVirtualAddress(PWM_BASE_OFFSET));
+            pwm->ctl = 0x00000000;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            pwm->status = PWM_STA_BERR | PWM_STA_GAPO1 | PWM_STA_RERR1 | PWM_STA_WERR1;
+            pwm->ctl = PWM_CTL_CLRF1;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            pwm->chn1Range = PWM_CHANNEL_RANGE;
+            pwm->dmaConf = PWM_DMAC_ENAB | PWM_DMAC_PANIC(0x7) | PWM_DMAC_DREQ(0x7);
+            pwm->ctl = PWM_CTL_USEF1 | PWM_CTL_RPTL1 | PWM_CTL_MODE1 | PWM_CTL_PWEN1;
+        }
+        virtual ~HardwarePWMController() {
+            pwm->ctl = 0x00000000;
+        }
+        virtual uintptr_t GetFifoInAddress() const {
+            return peripherals->GetPhysicalAddress(&pwm->fifoIn);
+        }
+    private:
+        volatile PWMRegisters *pwm;
+};
+
+class HardwareDMAController : public Device, public DMAController
+{
+    public:
+        HardwareDMAController() = delete;
+        HardwareDMAController(uint32_t address, unsigned dmaChannel) {
+            dma = reinterpret_cast<DMARegisters *>(peripherals->GetVirtualAddress((dmaChannel < 15) ? DMA0_BASE_OFFSET + dmaChannel * 0x100 : DMA15_BASE_OFFSET));
+            dma->ctlStatus = DMA_CS_RESET;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            dma->ctlStatus = DMA_CS_INT | DMA_CS_END;
+            dma->cbAddress = address;
+            dma->ctlStatus = DMA_CS_PANIC_PRIORITY(0xf) | DMA_CS_PRIORITY(0xf) | DMA_CS_ACTIVE;
+        }
+        virtual ~HardwareDMAController() {
+            dma->ctlStatus = DMA_CS_RESET;
+        }
+        virtual void SetControllBlockAddress(uint32_t address) {
+            dma->cbAddress = address;
+        }
+        virtual uint32_t GetControllBlockAddress() const {
+            return dma->cbAddress;
+        }
+    private:
+        volatile DMARegisters *dma;
+};
+
+float HardwareBackend::GetClockFrequency() const
+{
+    return Peripherals::GetClockFrequency();
+}
+
+std::unique_ptr<ClockOutput> HardwareBackend::CreateClockOutput(unsigned divisor)
+{
+    return std::unique_ptr<ClockOutput>(new HardwareClockOutput(divisor));
+}
+
+std::unique_ptr<PWMController> HardwareBackend::CreatePWMController(unsigned sampleRate)
+{
+    return std::unique_ptr<PWMController>(new HardwarePWMController(sampleRate));
+}
+
+std::unique_ptr<DMAController> HardwareBackend::CreateDMAController(uint32_t address, unsigned dmaChannel)
+{
+    return std::unique_ptr<DMAController>(new HardwareDMAController(address, dmaChannel));
+}
+
+std::unique_ptr<AllocatedMemory> HardwareBackend::AllocateMemory(unsigned size)
+{
+    return std::unique_ptr<AllocatedMemory>(new HardwareMemory(size));
+}
+
+std::size_t HardwareBackend::GetMemoryLimit() const
+{
+    int mBoxFd = mbox_open();
+    std::size_t size = get_vc_memory(mBoxFd);
+    mbox_close(mBoxFd);
+    return size;
+}
@@ -101,6 +101,27 @@ static int mbox_property(int file_desc, void *buf)
    return ret_val;
 }
 
+unsigned get_vc_memory(int file_desc)
+{
+   int i=0;
+   unsigned p[32];
+   p[i++] = 0; // size
+   p[i++] = 0x00000000; // process request
+
+   p[i++] = 0x10006; // (the tag id)
+   p[i++] = 8; // (size of the buffer)
+   p[i++] = 0; // (size of the data)
+   p[i++] = 0; // (base address)
+   p[i++] = 0; // (size in bytes)
+
+   p[i++] = 0x00000000; // end tag
+   p[0] = i*sizeof *p; // actual size
+
+   if (mbox_property(file_desc, p) < 0)
+      return 0;
+   return p[6];
+}
+
 unsigned mem_alloc(int file_desc, unsigned size, unsigned align, unsigned flags)
 {
    int i=0;
@@ -0,0 +1,172 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "mpx_encoder.hpp"
+#include "oscillator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Composite of count stereo frames: (L + R) * level / 2 + (L - R) * level / 2
+// * subcarrier + pilot, the pilot already carries its level.
+static void MixStereo(const float *frames, const float *pilot, const float *subcarrier, unsigned count, float level, float *composite)
+{
+    const float half = level / 2;
+    unsigned i = 0;
+#if defined(__AVX2__)
+    const __m256 scale = _mm256_set1_ps(half);
+    for (; i + 8 <= count; i += 8) {
+        __m256 low = _mm256_loadu_ps(&frames[2 * i]), high = _mm256_loadu_ps(&frames[2 * i + 8]);
+        // Shuffles work within 128-bit lanes, the 64-bit permute restores frame order.
+        __m256 left = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256 right = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256 mid = _mm256_mul_ps(_mm256_add_ps(left, right), scale);
+        __m256 side = _mm256_mul_ps(_mm256_sub_ps(left, right), scale);
+        _mm256_storeu_ps(&composite[i], _mm256_add_ps(_mm256_add_ps(mid, _mm256_loadu_ps(&pilot[i])), _mm256_mul_ps(side, _mm256_loadu_ps(&subcarrier[i]))));
+    }
+#elif defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(half);
+    for (; i + 4 <= count; i += 4) {
+        __m128 low = _mm_loadu_ps(&frames[2 * i]), high = _mm_loadu_ps(&frames[2 * i + 4]);
+        __m128 left = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 right = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 mid = _mm_mul_ps(_mm_add_ps(left, right), scale);
+        __m128 side = _mm_mul_ps(_mm_sub_ps(left, right), scale);
+        _mm_storeu_ps(&composite[i], _mm_add_ps(_mm_add_ps(mid, _mm_loadu_ps(&pilot[i])), _mm_mul_ps(side, _mm_loadu_ps(&subcarrier[i]))));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t scale = vdupq_n_f32(half);
+    for (; i + 4 <= count; i += 4) {
+        float32x4x2_t stereo = vld2q_f32(&frames[2 * i]);
+        float32x4_t mid = vmulq_f32(vaddq_f32(stereo.val[0], stereo.val[1]), scale);
+        float32x4_t side = vmulq_f32(vsubq_f32(stereo.val[0], stereo.val[1]), scale);
+        vst1q_f32(&composite[i], vaddq_f32(vaddq_f32(mid, vld1q_f32(&pilot[i])), vmulq_f32(side, vld1q_f32(&subcarrier[i]))));
+    }
+#endif
+    for (; i < count; i++) {
+        float mid = (frames[2 * i] + frames[2 * i + 1]) * half;
+        float side = (frames[2 * i] - frames[2 * i + 1]) * half;
+        composite[i] = mid + pilot[i] + side * subcarrier[i];
+    }
+}
+
+MpxEncoder::MpxEncoder(unsigned sampleRate, bool stereo, RdsEncoder *rds)
+    : source(nullptr), sampleRate(sampleRate), channels(0), stereo(stereo), rds(rds), phase(0)
+{
+    if (sampleRate < MPX_MIN_SAMPLE_RATE) {
+        throw std::runtime_error("Multiplex requires at least " + std::to_string(MPX_MIN_SAMPLE_RATE) + " Hz composite rate");
+    }
+    increment = static_cast<uint32_t>(std::llround(static_cast<double>(MPX_PILOT_FREQUENCY) * 4294967296.0 / sampleRate));
+    level = MPX_AUDIO_LEVEL - (rds ? RDS_LEVEL : 0.f);
+    if (rds) {
+        rds->SetSampleRate(sampleRate);
+    }
+}
+
+void MpxEncoder::SetSource(AudioSource &source)
+{
+    if ((source.GetSampleRate() != sampleRate) || (source.GetChannels() < 1) || (source.GetChannels() > 2)) {
+        throw std::runtime_error("Cannot encode multiplex of " + source.GetName() + ", " + std::to_string(sampleRate) + " Hz mono or stereo source required");
+    }
+    this->source = &source;
+    channels = source.GetChannels();
+    block.resize(MPX_BLOCK_SIZE * channels);
+}
+
+std::string MpxEncoder::GetName() const
+{
+    return source ? source->GetName() : std::string();
+}
+
+unsigned MpxEncoder::GetSampleRate() const
+{
+    return sampleRate;
+}
+
+unsigned MpxEncoder::GetChannels() const
+{
+    return 1;
+}
+
+unsigned MpxEncoder::Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    unsigned produced = 0;
+    while (produced < frames) {
+        unsigned requested = std::min(frames - produced, static_cast<unsigned>(MPX_BLOCK_SIZE));
+        unsigned quantity = source->Read(block.data(), requested, enable, mtx);
+        float *composite = &samples[produced];
+        if (stereo) {
+            RenderCarriers(quantity);
+            if (channels == 2) {
+                MixStereo(block.data(), pilot, subcarrier, quantity, level, composite);
+            } else {
+                for (unsigned i = 0; i < quantity; i++) {
+                    composite[i] = block[i] * level + pilot[i];
+                }
+            }
+        } else if (channels == 2) {
+            for (unsigned i = 0; i < quantity; i++) {
+                composite[i] = (block[2 * i] + block[2 * i + 1]) * (level / 2);
+            }
+        } else {
+            for (unsigned i = 0; i < quantity; i++) {
+                composite[i] = block[i] * level;
+            }
+        }
+        if (rds) {
+            rds->Render(composite, quantity, phase, increment, RDS_LEVEL);
+        }
+        phase += quantity * increment;
+        produced += quantity;
+        if (quantity < requested) {
+            break;
+        }
+    }
+    return produced;
+}
+
+void MpxEncoder::RenderCarriers(unsigned count)
+{
+    const float *table = Wavetable::Get(Waveform::Sine, 0);
+    uint32_t current = phase;
+    for (unsigned i = 0; i < count; i++) {
+        pilot[i] = MPX_PILOT_LEVEL * GetWavetableValue(table, current);
+        subcarrier[i] = GetWavetableValue(table, current << 1);
+        current += increment;
+    }
+}
@@ -0,0 +1,80 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "audio_source.hpp"
+#include "rds_encoder.hpp"
+#include <cstdint>
+#include <vector>
+
+#define MPX_SAMPLE_RATE 192000
+#define MPX_MIN_SAMPLE_RATE 120000
+#define MPX_AUDIO_CUTOFF 15000
+#define MPX_PILOT_FREQUENCY 19000
+#define MPX_PILOT_LEVEL 0.1f
+#define MPX_AUDIO_LEVEL 0.9f
+#define MPX_BLOCK_SIZE 1024
+
+// FM multiplex generator. Takes sources already running at the composite
+// rate (band-limited to MPX_AUDIO_CUTOFF) and produces the mono composite
+// baseband: (L + R) / 2 and, in stereo, the 19 kHz pilot and (L - R) / 2 on a
+// 38 kHz DSB-SC subcarrier, plus the optional RDS subcarrier. All carriers
+// come from one 32-bit phase accumulator, the subcarriers read the table at
+// multiples of the pilot phase, so they stay phase-locked forever. Mono
+// sources are sent as L = R. The encoder outlives its sources, so consecutive
+// files keep the carriers continuous.
+class MpxEncoder : public AudioSource
+{
+    public:
+        MpxEncoder(unsigned sampleRate, bool stereo, RdsEncoder *rds = nullptr);
+        void SetSource(AudioSource &source);
+        MpxEncoder(const MpxEncoder &) = delete;
+        MpxEncoder(MpxEncoder &&) = delete;
+        MpxEncoder &operator=(const MpxEncoder &) = delete;
+        std::string GetName() const;
+        unsigned GetSampleRate() const;
+        unsigned GetChannels() const;
+        unsigned Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx);
+    private:
+        void RenderCarriers(unsigned count);
+
+        AudioSource *source;
+        unsigned sampleRate, channels;
+        bool stereo;
+        RdsEncoder *rds;
+        float level;
+        uint32_t phase, increment;
+        std::vector<float> block;
+        float pilot[MPX_BLOCK_SIZE], subcarrier[MPX_BLOCK_SIZE];
+};
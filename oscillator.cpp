@@ -0,0 +1,140 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "oscillator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+Wavetable::Wavetable(Waveform waveform)
+{
+    // Additive synthesis from the Fourier series, so every octave is free of
+    // harmonics above the Nyquist frequency of the notes it is used for.
+    // Harmonics are looked up in a single sine cycle, sin(k * x) lands exactly
+    // on entry k * i, which keeps the table construction cheap.
+    std::vector<double> sine(WAVETABLE_SIZE), values(WAVETABLE_SIZE);
+    for (unsigned i = 0; i < WAVETABLE_SIZE; i++) {
+        sine[i] = std::sin(2.0 * M_PI * i / WAVETABLE_SIZE);
+    }
+    for (unsigned octave = 0; octave < WAVETABLE_OCTAVES; octave++) {
+        unsigned harmonics = (waveform == Waveform::Sine) ? 1 : (WAVETABLE_SIZE / 2) >> octave;
+        double peak = 0.0;
+        for (unsigned i = 0; i < WAVETABLE_SIZE; i++) {
+            double value = 0.0;
+            for (unsigned k = 1; k <= harmonics; k++) {
+                double harmonic = sine[(static_cast<unsigned long long>(k) * i) % WAVETABLE_SIZE];
+                switch (waveform) {
+                    case Waveform::Sine:
+                        value += harmonic;
+                        break;
+                    case Waveform::Saw:
+                        value += ((k % 2) ? 1.0 : -1.0) * harmonic / k;
+                        break;
+                    case Waveform::Square:
+                        value += (k % 2) ? harmonic / k : 0.0;
+                        break;
+                    case Waveform::Triangle:
+                        value += (k % 2) ? (((k / 2) % 2) ? -1.0 : 1.0) * harmonic / (k * k) : 0.0;
+                        break;
+                }
+            }
+            values[i] = value;
+            peak = std::max(peak, std::fabs(value));
+        }
+        for (unsigned i = 0; i <= WAVETABLE_SIZE; i++) {
+            tables[octave][i] = static_cast<float>(values[i % WAVETABLE_SIZE] / peak);
+        }
+    }
+}
+
+const float *Wavetable::Get(Waveform waveform, unsigned octave)
+{
+    static const Wavetable sine(Waveform::Sine), saw(Waveform::Saw), square(Waveform::Square), triangle(Waveform::Triangle);
+    const Wavetable *wavetable = &sine;
+    switch (waveform) {
+        case Waveform::Saw:
+            wavetable = &saw;
+            break;
+        case Waveform::Square:
+            wavetable = &square;
+            break;
+        case Waveform::Triangle:
+            wavetable = &triangle;
+            break;
+        default:
+            break;
+    }
+    return wavetable->tables[(octave < WAVETABLE_OCTAVES) ? octave : WAVETABLE_OCTAVES - 1];
+}
+
+Oscillator::Oscillator()
+    : waveform(Waveform::Sine), phase(0), increment(0)
+{
+    SelectTable();
+}
+
+void Oscillator::SetWaveform(Waveform waveform)
+{
+    this->waveform = waveform;
+    SelectTable();
+}
+
+void Oscillator::SetFrequency(float frequency, unsigned sampleRate)
+{
+    double ratio = static_cast<double>(frequency) / sampleRate;
+    increment = (ratio > 0.0 && ratio < 0.5) ? static_cast<uint32_t>(ratio * 4294967296.0) : 0;
+    SelectTable();
+}
+
+void Oscillator::Reset()
+{
+    phase = 0;
+}
+
+void Oscillator::Render(float *output, unsigned count, float gain)
+{
+    for (unsigned i = 0; i < count; i++) {
+        output[i] += GetNextSample() * gain;
+    }
+}
+
+// Picks the richest table whose highest harmonic stays below Nyquist, the
+// first octave supports fundamentals below sampleRate / WAVETABLE_SIZE.
+void Oscillator::SelectTable()
+{
+    unsigned octave = 0;
+    while ((octave < WAVETABLE_OCTAVES - 1) && (increment >= (0x01ull << (32 - WAVETABLE_BITS + octave)))) {
+        octave++;
+    }
+    table = Wavetable::Get(waveform, octave);
+}
@@ -0,0 +1,87 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#define WAVETABLE_BITS 11
+#define WAVETABLE_SIZE (0x01 << WAVETABLE_BITS)
+#define WAVETABLE_OCTAVES 10
+
+enum class Waveform { Sine, Saw, Square, Triangle };
+
+// Band-limited single cycle waveforms. Each waveform has one table per
+// octave, the table for octave n holds WAVETABLE_SIZE / 2 >> n harmonics, plus
+// a guard point so interpolation never wraps.
+class Wavetable
+{
+    public:
+        static const float *Get(Waveform waveform, unsigned octave);
+    private:
+        Wavetable(Waveform waveform);
+        float tables[WAVETABLE_OCTAVES][WAVETABLE_SIZE + 1];
+};
+
+// Linearly interpolated table value at a 32-bit phase, the upper
+// WAVETABLE_BITS select the entry.
+inline float GetWavetableValue(const float *table, uint32_t phase)
+{
+    uint32_t index = phase >> (32 - WAVETABLE_BITS);
+    float fraction = (phase & ((0x01u << (32 - WAVETABLE_BITS)) - 1)) * (1.f / (0x01u << (32 - WAVETABLE_BITS)));
+    return table[index] + (table[index + 1] - table[index]) * fraction;
+}
+
+// Oscillator driven by a 32-bit phase accumulator which wraps around naturally,
+// so the phase stays continuous forever. The upper WAVETABLE_BITS select the
+// table entry, the remaining bits interpolate linearly to the next one.
+class Oscillator
+{
+    public:
+        Oscillator();
+        void SetWaveform(Waveform waveform);
+        void SetFrequency(float frequency, unsigned sampleRate);
+        void Reset();
+        // Adds count samples multiplied by gain to output.
+        void Render(float *output, unsigned count, float gain);
+        inline float GetNextSample() {
+            float value = GetWavetableValue(table, phase);
+            phase += increment;
+            return value;
+        }
+    private:
+        void SelectTable();
+        Waveform waveform;
+        uint32_t phase, increment;
+        const float *table;
+};
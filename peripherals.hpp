@@ -0,0 +1,143 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#define PERIPHERALS_PHYS_BASE 0x7e000000
+
+#define GPIO_BASE_OFFSET 0x00200000
+
+#define CLK0_BASE_OFFSET 0x00101070
+#define CLK1_BASE_OFFSET 0x00101078
+
+#define PWMCLK_BASE_OFFSET 0x001010a0
+#define PWM_BASE_OFFSET 0x0020c000
+#define PWM_CHANNEL_RANGE 32
+#define PWM_WRITES_PER_SAMPLE 10
+
+#define DMA0_BASE_OFFSET 0x00007000
+#define DMA15_BASE_OFFSET 0x00e05000
+#define DMA_TI_NO_WIDE_BURST (0x01 << 26)
+#define DMA_TI_PERMAP(x) ((x & 0x0f) << 16)
+#define DMA_TI_DEST_DREQ (0x01 << 6)
+#define DMA_TI_WAIT_RESP (0x01 << 3)
+
+struct ClockRegisters {
+    uint32_t ctl;
+    uint32_t div;
+};
+
+struct PWMRegisters {
+    uint32_t ctl;
+    uint32_t status;
+    uint32_t dmaConf;
+    uint32_t reserved0;
+    uint32_t chn1Range;
+    uint32_t chn1Data;
+    uint32_t fifoIn;
+    uint32_t reserved1;
+    uint32_t chn2Range;
+    uint32_t chn2Data;
+};
+
+struct DMAControllBlock {
+    uint32_t transferInfo;
+    uint32_t srcAddress;
+    uint32_t dstAddress;
+    uint32_t transferLen;
+    uint32_t stride;
+    uint32_t nextCbAddress;
+    uint32_t reserved0;
+    uint32_t reserved1;
+};
+
+struct DMARegisters {
+    uint32_t ctlStatus;
+    uint32_t cbAddress;
+    uint32_t transferInfo;
+    uint32_t srcAddress;
+    uint32_t dstAddress;
+    uint32_t transferLen;
+    uint32_t stride;
+    uint32_t nextCbAddress;
+    uint32_t debug;
+};
+
+// Devices hand out bus addresses, which is what DMA control blocks refer to.
+class ClockOutput
+{
+    public:
+        virtual ~ClockOutput() { }
+        virtual void SetDivisor(unsigned divisor) = 0;
+        virtual uintptr_t GetDivisorAddress() const = 0;
+};
+
+class PWMController
+{
+    public:
+        virtual ~PWMController() { }
+        virtual uintptr_t GetFifoInAddress() const = 0;
+};
+
+class DMAController
+{
+    public:
+        virtual ~DMAController() { }
+        virtual void SetControllBlockAddress(uint32_t address) = 0;
+        virtual uint32_t GetControllBlockAddress() const = 0;
+};
+
+class AllocatedMemory
+{
+    public:
+        virtual ~AllocatedMemory() { }
+        virtual uintptr_t GetPhysicalAddress(volatile void *object) const = 0;
+        virtual uintptr_t GetBaseAddress() const = 0;
+};
+
+class Backend
+{
+    public:
+        virtual ~Backend() { }
+        virtual float GetClockFrequency() const = 0;
+        virtual std::unique_ptr<ClockOutput> CreateClockOutput(unsigned divisor) = 0;
+        virtual std::unique_ptr<PWMController> CreatePWMController(unsigned sampleRate) = 0;
+        virtual std::unique_ptr<DMAController> CreateDMAController(uint32_t address, unsigned dmaChannel) = 0;
+        virtual std::unique_ptr<AllocatedMemory> AllocateMemory(unsigned size) = 0;
+        // Upper bound of DMA-visible memory a single AllocateMemory call can get,
+        // 0 if unknown.
+        virtual std::size_t GetMemoryLimit() const = 0;
+};
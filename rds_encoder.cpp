@@ -0,0 +1,220 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rds_encoder.hpp"
+#include "oscillator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define RDS_BIT_RATE 1187.5
+#define RDS_GROUP_BITS 104
+#define RDS_BLOCK_BITS 26
+#define RDS_BLOCK_SIZE 256
+#define RDS_POLYNOMIAL 0x5b9
+#define RDS_TAPER (1.0 / 6.0)
+
+// Offset words A, B, C and D added to the checkword of each block.
+static const uint16_t offsetWords[4] = { 0x0fc, 0x198, 0x168, 0x1b4 };
+
+// Remainder of information * x^10 divided by x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1.
+static uint16_t GetCheckword(uint16_t information)
+{
+    uint32_t remainder = static_cast<uint32_t>(information) << 10;
+    for (int i = 25; i >= 10; i--) {
+        if (remainder & (0x01u << i)) {
+            remainder ^= RDS_POLYNOMIAL << (i - 10);
+        }
+    }
+    return remainder & 0x3ff;
+}
+
+RdsEncoder::RdsEncoder(uint16_t pi)
+    : pi(pi), radioTextSegments(0), bit(RDS_GROUP_BITS), group(0), psSegment(0), rtSegment(0), textFlag(false), symbol(false), clockStarted(false), lastMinute(0),
+    symbolLength(0), clock(0), nextBit(0)
+{
+    SetProgramService("");
+    std::memset(radioText, ' ', sizeof(radioText));
+}
+
+void RdsEncoder::SetProgramService(const std::string &name)
+{
+    std::memset(programService, ' ', sizeof(programService));
+    std::memcpy(programService, name.data(), std::min(name.size(), sizeof(programService)));
+}
+
+// Text shorter than RDS_RT_LENGTH ends with a carriage return, only the
+// segments holding it are sent. A new text toggles the A/B flag, so receivers
+// clear their display.
+void RdsEncoder::SetRadioText(const std::string &text)
+{
+    std::memset(radioText, ' ', sizeof(radioText));
+    std::size_t length = std::min(text.size(), sizeof(radioText));
+    std::memcpy(radioText, text.data(), length);
+    if (length < sizeof(radioText)) {
+        radioText[length++] = '\r';
+    }
+    radioTextSegments = text.empty() ? 0 : (length + 3) / 4;
+    rtSegment = 0;
+    textFlag = !textFlag;
+}
+
+void RdsEncoder::SetSampleRate(unsigned sampleRate)
+{
+    // Biphase symbol: an impulse at the bit start and a negative one half a
+    // bit later, filtered by H(f) = cos(pi * f * td / 4) for f < 2 / td. The
+    // impulse response has a closed form, the waveform is cut to
+    // RDS_SYMBOL_SPAN bits around its center with tapered edges.
+    const double period = 1.0 / RDS_BIT_RATE, a = M_PI * period / 4.0, limit = 2.0 / period;
+    auto getResponse = [&](double time) -> double {
+        double response = 0.0;
+        for (double x : { a - 2.0 * M_PI * time, a + 2.0 * M_PI * time }) {
+            response += (std::fabs(x) < 1e-12) ? limit : std::sin(x * limit) / x;
+        }
+        return response;
+    };
+    double span = RDS_SYMBOL_SPAN * period, delay = span / 2.0 - period / 4.0;
+    symbolLength = static_cast<unsigned>(std::ceil(span * sampleRate)) + 1;
+    symbols.resize(RDS_PHASES * symbolLength);
+    double peak = 0.0;
+    std::vector<double> values(symbols.size());
+    for (unsigned p = 0; p < RDS_PHASES; p++) {
+        for (unsigned j = 0; j < symbolLength; j++) {
+            double time = (j - static_cast<double>(p) / RDS_PHASES) / sampleRate - delay;
+            double position = (time + delay) / span, window = 0.0;
+            if ((position >= 0.0) && (position <= 1.0)) {
+                double edge = std::min(position, 1.0 - position);
+                window = (edge < RDS_TAPER) ? 0.5 - 0.5 * std::cos(M_PI * edge / RDS_TAPER) : 1.0;
+            }
+            values[p * symbolLength + j] = (getResponse(time) - getResponse(time - period / 2.0)) * window;
+            peak = std::max(peak, std::fabs(values[p * symbolLength + j]));
+        }
+    }
+    for (std::size_t i = 0; i < symbols.size(); i++) {
+        symbols[i] = static_cast<float>(values[i] / peak);
+    }
+    baseband.assign(RDS_BLOCK_SIZE + symbolLength + 1, 0.f);
+    clockStarted = false;
+}
+
+void RdsEncoder::Render(float *composite, unsigned count, uint32_t phase, uint32_t increment, float level)
+{
+    const float *carrier = Wavetable::Get(Waveform::Sine, 0);
+    // The bit clock counts pilot phase, every bit starts at the beginning
+    // of a pilot cycle.
+    if (!clockStarted) {
+        clock = phase;
+        nextBit = 0x01ull << 32;
+        clockStarted = true;
+    }
+    for (unsigned offset = 0; offset < count; offset += RDS_BLOCK_SIZE) {
+        unsigned quantity = std::min(count - offset, static_cast<unsigned>(RDS_BLOCK_SIZE));
+        uint64_t end = clock + static_cast<uint64_t>(quantity) * increment;
+        while (nextBit < end) {
+            uint64_t distance = nextBit - clock;
+            unsigned start = static_cast<unsigned>(distance / increment);
+            unsigned fraction = static_cast<unsigned>(((distance % increment) * RDS_PHASES + increment / 2) / increment);
+            if (fraction == RDS_PHASES) {
+                start++;
+                fraction = 0;
+            }
+            symbol ^= GetNextBit();
+            const float *waveform = &symbols[fraction * symbolLength];
+            float *target = &baseband[start];
+            if (symbol) {
+                for (unsigned j = 0; j < symbolLength; j++) {
+                    target[j] += waveform[j];
+                }
+            } else {
+                for (unsigned j = 0; j < symbolLength; j++) {
+                    target[j] -= waveform[j];
+                }
+            }
+            nextBit += static_cast<uint64_t>(RDS_PILOT_CYCLES) << 32;
+        }
+        for (unsigned i = 0; i < quantity; i++) {
+            composite[offset + i] += level * baseband[i] * GetWavetableValue(carrier, 3 * phase);
+            phase += increment;
+        }
+        std::copy(baseband.begin() + quantity, baseband.end(), baseband.begin());
+        std::fill(baseband.end() - quantity, baseband.end(), 0.f);
+        clock = end;
+    }
+}
+
+void RdsEncoder::BuildGroup()
+{
+    // Block B: group type, version A, TP = 0 and PTY = 0, then five group
+    // specific bits.
+    time_t now = time(nullptr);
+    if (now / 60 != lastMinute) {
+        lastMinute = now / 60;
+        tm utc, local;
+        gmtime_r(&now, &utc);
+        localtime_r(&now, &local);
+        uint32_t mjd = static_cast<uint32_t>(now / 86400 + 40587);
+        long offset = local.tm_gmtoff / 1800;
+        SetBlock(1, (0x4 << 12) | ((mjd >> 15) & 0x03));
+        SetBlock(2, ((mjd & 0x7fff) << 1) | (utc.tm_hour >> 4));
+        SetBlock(3, ((utc.tm_hour & 0x0f) << 12) | (utc.tm_min << 6) | ((offset < 0) ? 0x20 : 0x00) | (std::labs(offset) & 0x1f));
+    } else if ((group % 2) || !radioTextSegments) {
+        SetBlock(1, (0x0 << 12) | 0x08 | psSegment);
+        SetBlock(2, 0xe0cd);
+        SetBlock(3, (static_cast<uint8_t>(programService[2 * psSegment]) << 8) | static_cast<uint8_t>(programService[2 * psSegment + 1]));
+        psSegment = (psSegment + 1) % (RDS_PS_LENGTH / 2);
+    } else {
+        const char *text = &radioText[4 * rtSegment];
+        SetBlock(1, (0x2 << 12) | (textFlag ? 0x10 : 0x00) | rtSegment);
+        SetBlock(2, (static_cast<uint8_t>(text[0]) << 8) | static_cast<uint8_t>(text[1]));
+        SetBlock(3, (static_cast<uint8_t>(text[2]) << 8) | static_cast<uint8_t>(text[3]));
+        rtSegment = (rtSegment + 1) % radioTextSegments;
+    }
+    SetBlock(0, pi);
+    group++;
+    bit = 0;
+}
+
+void RdsEncoder::SetBlock(unsigned index, uint16_t information)
+{
+    blocks[index] = (static_cast<uint32_t>(information) << 10) | (GetCheckword(information) ^ offsetWords[index]);
+}
+
+bool RdsEncoder::GetNextBit()
+{
+    if (bit == RDS_GROUP_BITS) {
+        BuildGroup();
+    }
+    bool value = (blocks[bit / RDS_BLOCK_BITS] >> (RDS_BLOCK_BITS - 1 - bit % RDS_BLOCK_BITS)) & 0x01;
+    bit++;
+    return value;
+}
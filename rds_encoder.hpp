@@ -0,0 +1,91 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#define RDS_PI 0x1234
+#define RDS_PS_LENGTH 8
+#define RDS_RT_LENGTH 64
+#define RDS_LEVEL 0.04f
+#define RDS_PILOT_CYCLES 16
+#define RDS_SYMBOL_SPAN 3
+#define RDS_PHASES 8
+
+// RDS encoder for the 57 kHz subcarrier of the multiplex. Sends the program
+// service name (group 0A), radio text (2A) and, at every minute change, clock
+// time (4A). Groups are built one at a time as their bits are needed.
+//
+// Every bit lasts 16 pilot cycles and is sent as a differentially coded
+// biphase symbol shaped as IEC 62106 requires. The shaped symbol is computed
+// once per sample rate for RDS_PHASES sub-sample start offsets, so rendering
+// adds one precomputed waveform per bit into the baseband and multiplies the
+// baseband by the carrier read from the sine wavetable at three times the
+// pilot phase.
+class RdsEncoder
+{
+    public:
+        RdsEncoder(uint16_t pi = RDS_PI);
+        RdsEncoder(const RdsEncoder &) = delete;
+        RdsEncoder(RdsEncoder &&) = delete;
+        RdsEncoder &operator=(const RdsEncoder &) = delete;
+        void SetProgramService(const std::string &name);
+        void SetRadioText(const std::string &text);
+        // Restarts the bit clock and builds the symbol tables for a
+        // composite running at sampleRate, call before the first Render.
+        void SetSampleRate(unsigned sampleRate);
+        // Adds count samples of the modulated subcarrier multiplied by level
+        // to composite. phase is the pilot phase of the first sample, advancing
+        // by increment every sample.
+        void Render(float *composite, unsigned count, uint32_t phase, uint32_t increment, float level);
+    private:
+        void BuildGroup();
+        void SetBlock(unsigned index, uint16_t information);
+        bool GetNextBit();
+
+        uint16_t pi;
+        char programService[RDS_PS_LENGTH];
+        char radioText[RDS_RT_LENGTH];
+        unsigned radioTextSegments;
+        uint32_t blocks[4];
+        unsigned bit, group, psSegment, rtSegment;
+        bool textFlag, symbol, clockStarted;
+        time_t lastMinute;
+        std::vector<float> symbols, baseband;
+        unsigned symbolLength;
+        uint64_t clock, nextBit;
+};
@@ -0,0 +1,215 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "resampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define RESAMPLER_CUTOFF 0.9
+#define RESAMPLER_KAISER_BETA 8.0
+
+// Dot product of count (a multiple of 8) floats.
+static inline float Dot(const float *a, const float *b, unsigned count)
+{
+#if defined(__AVX2__)
+    __m256 sum = _mm256_setzero_ps();
+    for (unsigned i = 0; i < count; i += 8) {
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i])));
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_add_ss(half, _mm_shuffle_ps(half, half, 0x01)));
+#elif defined(__SSE2__)
+    __m128 low = _mm_setzero_ps(), high = _mm_setzero_ps();
+    for (unsigned i = 0; i < count; i += 8) {
+        low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+        high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(&a[i + 4]), _mm_loadu_ps(&b[i + 4])));
+    }
+    __m128 sum = _mm_add_ps(low, high);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x01)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    float32x4_t low = vdupq_n_f32(0.f), high = vdupq_n_f32(0.f);
+    for (unsigned i = 0; i < count; i += 8) {
+        low = vmlaq_f32(low, vld1q_f32(&a[i]), vld1q_f32(&b[i]));
+        high = vmlaq_f32(high, vld1q_f32(&a[i + 4]), vld1q_f32(&b[i + 4]));
+    }
+    return vaddvq_f32(vaddq_f32(low, high));
+#else
+    float sum[8] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+    for (unsigned i = 0; i < count; i += 8) {
+        for (unsigned j = 0; j < 8; j++) {
+            sum[j] += a[i + j] * b[i + j];
+        }
+    }
+    return ((sum[0] + sum[4]) + (sum[1] + sum[5])) + ((sum[2] + sum[6]) + (sum[3] + sum[7]));
+#endif
+}
+
+static double GetBessel(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (unsigned k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+Resampler::Resampler(AudioSource &source, unsigned sampleRate, unsigned cutoff)
+    : source(source), sampleRate(sampleRate), channels(source.GetChannels()), position(0), available(0), phase(0), ended(false)
+{
+    if (!sampleRate || !source.GetSampleRate() || !channels) {
+        throw std::runtime_error("Cannot resample " + source.GetName() + ", invalid sample rate");
+    }
+    unsigned a = sampleRate, b = source.GetSampleRate();
+    while (b) {
+        unsigned remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    interpolation = sampleRate / a;
+    decimation = source.GetSampleRate() / a;
+    phases = std::min(interpolation, static_cast<unsigned>(RESAMPLER_MAX_PHASES));
+
+    // When decimating (or cutting off lower) the kernel is stretched by the
+    // same ratio, so the transition band stays as steep relative to the cutoff.
+    double passband = RESAMPLER_CUTOFF * std::min(1.0, static_cast<double>(interpolation) / decimation);
+    unsigned stretch = (decimation + interpolation - 1) / interpolation;
+    if (cutoff && (2.0 * cutoff / source.GetSampleRate() < passband)) {
+        passband = 2.0 * cutoff / source.GetSampleRate();
+        stretch = std::max(stretch, static_cast<unsigned>(std::ceil(RESAMPLER_CUTOFF / passband)));
+    }
+    taps = RESAMPLER_TAPS * stretch;
+    taps = std::min((taps + 7) & ~0x07u, static_cast<unsigned>(RESAMPLER_MAX_TAPS));
+
+    // Phase p produces the output lying p / phases input samples after
+    // tap taps / 2 - 1, every phase is normalized to unity DC gain.
+    coefficients.resize(phases * taps);
+    for (unsigned p = 0; p < phases; p++) {
+        double sum = 0.0;
+        for (unsigned j = 0; j < taps; j++) {
+            double t = static_cast<double>(j) - (taps / 2 - 1) - static_cast<double>(p) / phases;
+            double x = t / (taps / 2);
+            double window = (std::fabs(x) < 1.0) ? GetBessel(RESAMPLER_KAISER_BETA * std::sqrt(1.0 - x * x)) / GetBessel(RESAMPLER_KAISER_BETA) : 0.0;
+            double sinc = (t != 0.0) ? std::sin(M_PI * passband * t) / (M_PI * passband * t) : 1.0;
+            coefficients[p * taps + j] = static_cast<float>(sinc * window);
+            sum += coefficients[p * taps + j];
+        }
+        for (unsigned j = 0; j < taps; j++) {
+            coefficients[p * taps + j] = static_cast<float>(coefficients[p * taps + j] / sum);
+        }
+    }
+
+    block.resize(RESAMPLER_BLOCK_SIZE * channels);
+    // Less than taps samples are kept on refills, then a block or a shorter
+    // last one followed by taps / 2 zeros is appended.
+    history.resize(channels, std::vector<float>(taps + RESAMPLER_BLOCK_SIZE + taps / 2, 0.f));
+    available = taps / 2 - 1;
+}
+
+std::string Resampler::GetName() const
+{
+    return source.GetName();
+}
+
+unsigned Resampler::GetSampleRate() const
+{
+    return sampleRate;
+}
+
+unsigned Resampler::GetChannels() const
+{
+    return channels;
+}
+
+unsigned Resampler::Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    unsigned produced = 0;
+    while (produced < frames) {
+        if (available - position < taps) {
+            if (!Refill(enable, mtx)) {
+                break;
+            }
+            continue;
+        }
+        const float *filter = &coefficients[((phases == interpolation) ? phase : static_cast<unsigned long long>(phase) * phases / interpolation) * taps];
+        for (unsigned c = 0; c < channels; c++) {
+            samples[produced * channels + c] = Dot(filter, &history[c][position], taps);
+        }
+        produced++;
+        phase += decimation;
+        position += phase / interpolation;
+        phase %= interpolation;
+    }
+    return produced;
+}
+
+// Moves the unused input to the front of the planar history buffers and
+// appends the next deinterleaved block, or taps / 2 zeros once the source has
+// ended so the last input samples are flushed out.
+bool Resampler::Refill(bool &enable, std::mutex &mtx)
+{
+    if (ended) {
+        return false;
+    }
+    std::size_t kept = (position < available) ? available - position : 0;
+    for (std::vector<float> &channel : history) {
+        std::copy(channel.begin() + std::min(position, available), channel.begin() + available, channel.begin());
+    }
+    position = (position > available) ? position - available : 0;
+    available = kept;
+
+    unsigned quantity = source.Read(block.data(), RESAMPLER_BLOCK_SIZE, enable, mtx);
+    for (unsigned c = 0; c < channels; c++) {
+        float *channel = &history[c][available];
+        for (unsigned i = 0; i < quantity; i++) {
+            channel[i] = block[i * channels + c];
+        }
+    }
+    available += quantity;
+    if (quantity < RESAMPLER_BLOCK_SIZE) {
+        for (std::vector<float> &channel : history) {
+            std::fill(channel.begin() + available, channel.begin() + available + taps / 2, 0.f);
+        }
+        available += taps / 2;
+        ended = true;
+    }
+    return true;
+}
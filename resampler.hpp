@@ -0,0 +1,71 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "audio_source.hpp"
+#include <vector>
+
+#define RESAMPLER_TAPS 32
+#define RESAMPLER_MAX_TAPS 256
+#define RESAMPLER_MAX_PHASES 512
+#define RESAMPLER_BLOCK_SIZE 1024
+
+// Polyphase windowed-sinc resampler converting another AudioSource to a fixed
+// output rate. The rate ratio is reduced to L / M, the filter is split into
+// L phases (at most RESAMPLER_MAX_PHASES, ratios with more phases round the
+// position down to the closest phase) computed once, so every output sample
+// is a single dot product per channel over contiguous memory. The passband
+// ends at 90% of the lower Nyquist frequency, or at cutoff Hz if that is lower.
+class Resampler : public AudioSource
+{
+    public:
+        Resampler(AudioSource &source, unsigned sampleRate, unsigned cutoff = 0);
+        Resampler(const Resampler &) = delete;
+        Resampler(Resampler &&) = delete;
+        Resampler &operator=(const Resampler &) = delete;
+        std::string GetName() const;
+        unsigned GetSampleRate() const;
+        unsigned GetChannels() const;
+        unsigned Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx);
+    private:
+        bool Refill(bool &enable, std::mutex &mtx);
+
+        AudioSource &source;
+        unsigned sampleRate, channels, taps, interpolation, decimation, phases;
+        std::vector<float> coefficients, block;
+        std::vector<std::vector<float> > history;
+        std::size_t position, available;
+        unsigned phase;
+        bool ended;
+};
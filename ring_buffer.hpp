@@ -0,0 +1,93 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+// Single-producer/single-consumer ring buffer. Push must only be called from one
+// thread and Pop from one other thread; neither side ever blocks or takes a lock.
+template <typename T>
+class RingBuffer
+{
+    public:
+        RingBuffer() : mask(0), head(0), tail(0) { }
+        RingBuffer(const RingBuffer &) = delete;
+        RingBuffer(RingBuffer &&) = delete;
+        RingBuffer &operator=(const RingBuffer &) = delete;
+        void Reset(std::size_t capacity) {
+            std::size_t size = 1;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            buffer.resize(size);
+            mask = size - 1;
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+        }
+        std::size_t Push(const T *items, std::size_t count) {
+            std::size_t position = head.load(std::memory_order_relaxed);
+            count = std::min(count, buffer.size() - (position - tail.load(std::memory_order_acquire)));
+            std::size_t first = std::min(count, buffer.size() - (position & mask));
+            std::copy(items, items + first, &buffer[position & mask]);
+            std::copy(items + first, items + count, &buffer[0]);
+            head.store(position + count, std::memory_order_release);
+            return count;
+        }
+        std::size_t Pop(T *items, std::size_t count) {
+            std::size_t position = tail.load(std::memory_order_relaxed);
+            count = std::min(count, head.load(std::memory_order_acquire) - position);
+            std::size_t first = std::min(count, buffer.size() - (position & mask));
+            std::copy(&buffer[position & mask], &buffer[position & mask] + first, items);
+            std::copy(&buffer[0], &buffer[0] + (count - first), items + first);
+            tail.store(position + count, std::memory_order_release);
+            return count;
+        }
+        std::size_t GetSize() const {
+            std::size_t position = tail.load(std::memory_order_acquire);
+            return head.load(std::memory_order_acquire) - position;
+        }
+        std::size_t GetCapacity() const {
+            return buffer.size();
+        }
+    private:
+        std::vector<T> buffer;
+        std::size_t mask;
+        char headPadding[64];
+        std::atomic<std::size_t> head;
+        char tailPadding[64];
+        std::atomic<std::size_t> tail;
+};
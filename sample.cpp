@@ -32,29 +32,179 @@
 */
 
 #include "sample.hpp"
+#include <algorithm>
 #include <climits>
+#include <cmath>
+#include <cstring>
 
-Sample::Sample(uint8_t *data, unsigned channels, unsigned bitsPerChannel)
-    : value(0.f)
-{
-    int sum = 0;
-    int16_t *channelValues = new int16_t[channels];
-    for (unsigned i = 0; i < channels; i++) {
-        switch (bitsPerChannel >> 3) {
-        case 2:
-            channelValues[i] = (data[((i + 1) << 1) - 1] << 8) | data[((i + 1) << 1) - 2];
-            break;
-        case 1:
-            channelValues[i] = (static_cast<int16_t>(data[i]) - 0x80) << 8;
-            break;
-        }
-        sum += channelValues[i];
-    }
-    value = 2 * sum / (static_cast<float>(USHRT_MAX) * channels);
-    delete[] channelValues;
+template <typename Sample, uint16_t AudioFormat, unsigned BytesPerSample>
+inline Sample GetChannelValue(const uint8_t *data);
+
+// 8 and 16-bit samples share the 16-bit scale, integer formats map the full
+// code range onto -1 - 1 (2 * value / (2^bits - 1)).
+template <>
+inline float GetChannelValue<float, WAVE_FORMAT_PCM, 1>(const uint8_t *data)
+{
+    return 2 * ((static_cast<int16_t>(data[0]) - 0x80) * 0x100) / static_cast<float>(USHRT_MAX);
+}
+
+template <>
+inline float GetChannelValue<float, WAVE_FORMAT_PCM, 2>(const uint8_t *data)
+{
+    return 2 * static_cast<int32_t>(static_cast<int16_t>((data[1] << 8) | data[0])) / static_cast<float>(USHRT_MAX);
+}
+
+template <>
+inline float GetChannelValue<float, WAVE_FORMAT_PCM, 3>(const uint8_t *data)
+{
+    int32_t value = static_cast<int32_t>((static_cast<uint32_t>(data[2]) << 24) | (data[1] << 16) | (data[0] << 8)) >> 8;
+    return 2 * value / 16777215.f;
+}
+
+template <>
+inline float GetChannelValue<float, WAVE_FORMAT_PCM, 4>(const uint8_t *data)
+{
+    int32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return 2 * static_cast<float>(value) / static_cast<float>(UINT_MAX);
+}
+
+// Float samples are clipped, NaN ends up at full scale.
+template <>
+inline float GetChannelValue<float, WAVE_FORMAT_IEEE_FLOAT, 4>(const uint8_t *data)
+{
+    float value;
+    std::memcpy(&value, data, sizeof(value));
+    return std::max(-1.f, std::min(1.f, value));
 }
 
-float Sample::GetMonoValue() const
+template <>
+inline float GetChannelValue<float, WAVE_FORMAT_IEEE_FLOAT, 8>(const uint8_t *data)
 {
+    double value;
+    std::memcpy(&value, data, sizeof(value));
+    return static_cast<float>(std::max(-1.0, std::min(1.0, value)));
+}
+
+// Fixed-point samples take the integer codes as fractions of 2^(bits - 1),
+// narrower formats are shifted up and wider ones rounded down to the Q
+// format with saturation. Floats are clipped like above, then scaled.
+template <>
+inline Q15 GetChannelValue<Q15, WAVE_FORMAT_PCM, 1>(const uint8_t *data)
+{
+    return static_cast<Q15>((data[0] - 0x80) * 0x100);
+}
+
+template <>
+inline Q15 GetChannelValue<Q15, WAVE_FORMAT_PCM, 2>(const uint8_t *data)
+{
+    return static_cast<Q15>((data[1] << 8) | data[0]);
+}
+
+template <>
+inline Q15 GetChannelValue<Q15, WAVE_FORMAT_PCM, 3>(const uint8_t *data)
+{
+    int32_t value = static_cast<int32_t>((static_cast<uint32_t>(data[2]) << 24) | (data[1] << 16) | (data[0] << 8)) >> 8;
+    return SaturateQ15((value + 0x80) >> 8);
+}
+
+template <>
+inline Q15 GetChannelValue<Q15, WAVE_FORMAT_PCM, 4>(const uint8_t *data)
+{
+    int32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return SaturateQ15(static_cast<int32_t>((static_cast<int64_t>(value) + 0x8000) >> 16));
+}
+
+template <>
+inline Q15 GetChannelValue<Q15, WAVE_FORMAT_IEEE_FLOAT, 4>(const uint8_t *data)
+{
+    return SaturateQ15(static_cast<int32_t>(std::lround(GetChannelValue<float, WAVE_FORMAT_IEEE_FLOAT, 4>(data) * 32768.f)));
+}
+
+template <>
+inline Q15 GetChannelValue<Q15, WAVE_FORMAT_IEEE_FLOAT, 8>(const uint8_t *data)
+{
+    double value;
+    std::memcpy(&value, data, sizeof(value));
+    return SaturateQ15(static_cast<int32_t>(std::lround(std::max(-1.0, std::min(1.0, value)) * 32768.0)));
+}
+
+// Q31 repeats 8 and 16-bit codes in the low half (value * 65537), which is
+// the 2 * value / (2^16 - 1) scale of the float path to within 2^-31.
+template <>
+inline Q31 GetChannelValue<Q31, WAVE_FORMAT_PCM, 1>(const uint8_t *data)
+{
+    return SaturateQ31(static_cast<int64_t>((data[0] - 0x80) * 0x100) * 0x10001);
+}
+
+template <>
+inline Q31 GetChannelValue<Q31, WAVE_FORMAT_PCM, 2>(const uint8_t *data)
+{
+    return SaturateQ31(static_cast<int64_t>(static_cast<int16_t>((data[1] << 8) | data[0])) * 0x10001);
+}
+
+template <>
+inline Q31 GetChannelValue<Q31, WAVE_FORMAT_PCM, 3>(const uint8_t *data)
+{
+    return static_cast<Q31>((static_cast<uint32_t>(data[2]) << 24) | (data[1] << 16) | (data[0] << 8));
+}
+
+template <>
+inline Q31 GetChannelValue<Q31, WAVE_FORMAT_PCM, 4>(const uint8_t *data)
+{
+    Q31 value;
+    std::memcpy(&value, data, sizeof(value));
     return value;
 }
+
+template <>
+inline Q31 GetChannelValue<Q31, WAVE_FORMAT_IEEE_FLOAT, 4>(const uint8_t *data)
+{
+    return SaturateQ31(std::llround(GetChannelValue<float, WAVE_FORMAT_IEEE_FLOAT, 4>(data) * 2147483648.0));
+}
+
+template <>
+inline Q31 GetChannelValue<Q31, WAVE_FORMAT_IEEE_FLOAT, 8>(const uint8_t *data)
+{
+    double value;
+    std::memcpy(&value, data, sizeof(value));
+    return SaturateQ31(std::llround(std::max(-1.0, std::min(1.0, value)) * 2147483648.0));
+}
+
+template <typename Sample, uint16_t AudioFormat, unsigned BytesPerSample>
+void ConvertSamples(const uint8_t *data, unsigned count, Sample *samples)
+{
+    for (unsigned i = 0; i < count; i++) {
+        samples[i] = GetChannelValue<Sample, AudioFormat, BytesPerSample>(&data[i * BytesPerSample]);
+    }
+}
+
+template <typename Sample>
+SampleConverter<Sample> GetSampleConverter(uint16_t audioFormat, unsigned bitsPerSample)
+{
+    if (audioFormat == WAVE_FORMAT_PCM) {
+        switch (bitsPerSample) {
+            case 8:
+                return ConvertSamples<Sample, WAVE_FORMAT_PCM, 1>;
+            case 16:
+                return ConvertSamples<Sample, WAVE_FORMAT_PCM, 2>;
+            case 24:
+                return ConvertSamples<Sample, WAVE_FORMAT_PCM, 3>;
+            case 32:
+                return ConvertSamples<Sample, WAVE_FORMAT_PCM, 4>;
+        }
+    } else if (audioFormat == WAVE_FORMAT_IEEE_FLOAT) {
+        switch (bitsPerSample) {
+            case 32:
+                return ConvertSamples<Sample, WAVE_FORMAT_IEEE_FLOAT, 4>;
+            case 64:
+                return ConvertSamples<Sample, WAVE_FORMAT_IEEE_FLOAT, 8>;
+        }
+    }
+    return nullptr;
+}
+
+template SampleConverter<float> GetSampleConverter<float>(uint16_t audioFormat, unsigned bitsPerSample);
+template SampleConverter<Q15> GetSampleConverter<Q15>(uint16_t audioFormat, unsigned bitsPerSample);
+template SampleConverter<Q31> GetSampleConverter<Q31>(uint16_t audioFormat, unsigned bitsPerSample);
@@ -36,13 +36,43 @@
 
 #include <cstdint>
 
-class Sample
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+
+// Fixed-point samples, -1 - 1 as signed fractions of 2^15 and 2^31.
+typedef int16_t Q15;
+typedef int32_t Q31;
+
+// Sample type of the fixed-point pipeline, selected at build time with
+// FIXED_POINT=15 or FIXED_POINT=31.
+#if FIXED_POINT == 15
+typedef Q15 FixedSample;
+#elif FIXED_POINT == 31
+typedef Q31 FixedSample;
+#elif defined(FIXED_POINT)
+#error "FIXED_POINT must be 15 or 31"
+#endif
+
+inline Q15 SaturateQ15(int32_t value)
 {
-    public:
-        Sample(uint8_t *data, unsigned channels, unsigned bitsPerChannel);
-        float GetMonoValue() const;
-    protected:
-        float value;
-};
+    return static_cast<Q15>((value > INT16_MAX) ? INT16_MAX : ((value < INT16_MIN) ? INT16_MIN : value));
+}
+
+inline Q31 SaturateQ31(int64_t value)
+{
+    return static_cast<Q31>((value > INT32_MAX) ? INT32_MAX : ((value < INT32_MIN) ? INT32_MIN : value));
+}
+
+// Converts count little-endian samples into normalized (-1 - 1) floats or
+// Q15/Q31 fractions, channel interleaving is kept.
+template <typename Sample>
+using SampleConverter = void (*)(const uint8_t *data, unsigned count, Sample *samples);
+
+// Returns the conversion kernel for 8-bit unsigned, 16, 24 or 32-bit signed
+// PCM or 32/64-bit IEEE float samples, nullptr for any other format. Meant to
+// be looked up once per stream, so the sample loops never branch on format.
+// Available for float, Q15 and Q31 samples.
+template <typename Sample>
+SampleConverter<Sample> GetSampleConverter(uint16_t audioFormat, unsigned bitsPerSample);
 
 #endif // SAMPLE_HPP
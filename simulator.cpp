@@ -0,0 +1,338 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "simulator.hpp"
+#include "divisor.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#define SIMULATED_MEMORY_BASE 0xc0000000
+#define SIMULATED_MEMORY_LIMIT (64 << 20)
+#define SIMULATED_MEMORY_ALIGN 4096
+#define SIMULATED_DMA_SLACK 1000000
+
+class SimulatedClockOutput : public ClockOutput
+{
+    public:
+        SimulatedClockOutput(SimulatedBackend &backend, unsigned divisor) : backend(backend) {
+            SetDivisor(divisor);
+        }
+        virtual void SetDivisor(unsigned divisor) {
+            uint32_t value = CLK_PASSWORD | (0xffffff & divisor);
+            backend.GetClockRegisters()->div = value;
+            backend.RecordDivisor(value, backend.GetTime());
+        }
+        virtual uintptr_t GetDivisorAddress() const {
+            return backend.GetDivisorAddress();
+        }
+    private:
+        SimulatedBackend &backend;
+};
+
+class SimulatedPWMController : public PWMController
+{
+    public:
+        SimulatedPWMController(SimulatedBackend &backend, unsigned sampleRate) : backend(backend) {
+            backend.SetSampleRate(sampleRate);
+        }
+        virtual ~SimulatedPWMController() {
+            backend.SetSampleRate(0);
+        }
+        virtual uintptr_t GetFifoInAddress() const {
+            return backend.GetFifoInAddress();
+        }
+    private:
+        SimulatedBackend &backend;
+};
+
+class SimulatedDMAController : public DMAController
+{
+    public:
+        SimulatedDMAController(SimulatedBackend &backend, uint32_t address) : backend(backend), cbAddress(address), stop(false) {
+            engine = std::thread(&SimulatedDMAController::Run, this);
+        }
+        virtual ~SimulatedDMAController() {
+            stop = true;
+            engine.join();
+        }
+        virtual void SetControllBlockAddress(uint32_t address) {
+            cbAddress = address;
+        }
+        virtual uint32_t GetControllBlockAddress() const {
+            return cbAddress;
+        }
+    private:
+        void Run() {
+            auto time = std::chrono::steady_clock::now();
+            while (!stop) {
+                uint32_t address = cbAddress;
+                if (!address) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    time = std::chrono::steady_clock::now();
+                    continue;
+                }
+                volatile DMAControllBlock *cb = reinterpret_cast<volatile DMAControllBlock *>(backend.Translate(address, sizeof(DMAControllBlock)));
+                if (!cb) {
+                    cbAddress = 0x00000000;
+                    continue;
+                }
+                uint32_t transferInfo = cb->transferInfo, length = cb->transferLen;
+                uint32_t srcAddress = cb->srcAddress, dstAddress = cb->dstAddress, nextCbAddress = cb->nextCbAddress;
+
+                unsigned sampleRate = backend.GetSampleRate();
+                if ((transferInfo & DMA_TI_DEST_DREQ) && sampleRate) {
+                    time += std::chrono::nanoseconds(static_cast<uint64_t>(length / sizeof(uint32_t)) * 1000000000 / (PWM_WRITES_PER_SAMPLE * sampleRate));
+                    auto now = std::chrono::steady_clock::now();
+                    if (time > now + std::chrono::nanoseconds(SIMULATED_DMA_SLACK)) {
+                        std::this_thread::sleep_until(time);
+                    } else if (time + std::chrono::nanoseconds(SIMULATED_DMA_SLACK) < now) {
+                        time = now;
+                    }
+                }
+
+                volatile uint8_t *src = reinterpret_cast<volatile uint8_t *>(backend.Translate(srcAddress, length));
+                if (dstAddress == backend.GetFifoInAddress()) {
+                    // Words pushed into the PWM FIFO only pace the transfer
+                } else if (dstAddress == backend.GetDivisorAddress()) {
+                    if (src) {
+                        uint32_t divisor = *reinterpret_cast<volatile uint32_t *>(src);
+                        backend.GetClockRegisters()->div = divisor;
+                        backend.RecordDivisor(divisor, backend.GetTime(time));
+                    }
+                } else {
+                    volatile uint8_t *dst = reinterpret_cast<volatile uint8_t *>(backend.Translate(dstAddress, length));
+                    if (src && dst) {
+                        for (uint32_t i = 0; i < length; i++) {
+                            dst[i] = src[i];
+                        }
+                    }
+                }
+                cbAddress.compare_exchange_strong(address, nextCbAddress);
+            }
+        }
+
+        SimulatedBackend &backend;
+        std::atomic<uint32_t> cbAddress;
+        std::atomic<bool> stop;
+        std::thread engine;
+};
+
+class SimulatedMemory : public AllocatedMemory
+{
+    public:
+        SimulatedMemory(SimulatedBackend &backend, unsigned size) : backend(backend) {
+            if (posix_memalign(&memory, SIMULATED_MEMORY_ALIGN, size)) {
+                throw std::runtime_error("Cannot allocate memory (" + std::to_string(size) + " bytes)");
+            }
+            std::memset(memory, 0, size);
+            try {
+                address = backend.RegisterMemory(memory, size);
+            } catch (...) {
+                free(memory);
+                throw;
+            }
+        }
+        virtual ~SimulatedMemory() {
+            backend.UnregisterMemory(memory);
+            free(memory);
+        }
+        SimulatedMemory(const SimulatedMemory &) = delete;
+        SimulatedMemory(SimulatedMemory &&) = delete;
+        SimulatedMemory &operator=(const SimulatedMemory &) = delete;
+        virtual uintptr_t GetPhysicalAddress(volatile void *object) const {
+            return address + (reinterpret_cast<uintptr_t>(object) - reinterpret_cast<uintptr_t>(memory));
+        }
+        virtual uintptr_t GetBaseAddress() const {
+            return reinterpret_cast<uintptr_t>(memory);
+        }
+    private:
+        SimulatedBackend &backend;
+        void *memory;
+        uint32_t address;
+};
+
+SimulatedBackend::SimulatedBackend(float clockFrequency, std::size_t maxRecords)
+    : clockFrequency(clockFrequency), start(std::chrono::steady_clock::now()), nextAddress(SIMULATED_MEMORY_BASE), memoryLimit(SIMULATED_MEMORY_LIMIT),
+    clock(), sampleRate(0), maxRecords(maxRecords), stats(), lastWrite(0)
+{
+    records.reserve(maxRecords);
+}
+
+float SimulatedBackend::GetClockFrequency() const
+{
+    return clockFrequency;
+}
+
+std::unique_ptr<ClockOutput> SimulatedBackend::CreateClockOutput(unsigned divisor)
+{
+    return std::unique_ptr<ClockOutput>(new SimulatedClockOutput(*this, divisor));
+}
+
+std::unique_ptr<PWMController> SimulatedBackend::CreatePWMController(unsigned sampleRate)
+{
+    return std::unique_ptr<PWMController>(new SimulatedPWMController(*this, sampleRate));
+}
+
+std::unique_ptr<DMAController> SimulatedBackend::CreateDMAController(uint32_t address, unsigned dmaChannel)
+{
+    return std::unique_ptr<DMAController>(new SimulatedDMAController(*this, address));
+}
+
+std::unique_ptr<AllocatedMemory> SimulatedBackend::AllocateMemory(unsigned size)
+{
+    if (size > memoryLimit) {
+        throw std::runtime_error("Cannot allocate memory (" + std::to_string(size) + " bytes)");
+    }
+    return std::unique_ptr<AllocatedMemory>(new SimulatedMemory(*this, size));
+}
+
+std::size_t SimulatedBackend::GetMemoryLimit() const
+{
+    return memoryLimit;
+}
+
+void SimulatedBackend::SetMemoryLimit(std::size_t limit)
+{
+    memoryLimit = limit;
+}
+
+std::vector<DivisorWrite> SimulatedBackend::GetDivisorWrites() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return records;
+}
+
+SimulatorStats SimulatedBackend::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return stats;
+}
+
+uint64_t SimulatedBackend::GetTime() const
+{
+    return GetTime(std::chrono::steady_clock::now());
+}
+
+uint64_t SimulatedBackend::GetTime(std::chrono::steady_clock::time_point time) const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - start).count();
+}
+
+void SimulatedBackend::RecordDivisor(uint32_t divisor, uint64_t time)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (stats.divisorWrites) {
+        if (time - lastWrite > stats.maxInterval) {
+            stats.maxInterval = time - lastWrite;
+        }
+        stats.duration += time - lastWrite;
+    }
+    lastWrite = time;
+    stats.divisorWrites++;
+    if (records.size() < maxRecords) {
+        DivisorWrite record = { time, divisor };
+        records.push_back(record);
+    } else {
+        stats.droppedRecords++;
+    }
+}
+
+uint32_t SimulatedBackend::RegisterMemory(void *memory, unsigned size)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t address = nextAddress;
+    if (static_cast<uint64_t>(address) + size > 0xffffffff) {
+        throw std::runtime_error("Cannot allocate memory (" + std::to_string(size) + " bytes)");
+    }
+    nextAddress += (size + SIMULATED_MEMORY_ALIGN - 1) & ~(SIMULATED_MEMORY_ALIGN - 1);
+    MemoryRegion region = { address, size, memory };
+    regions.push_back(region);
+    return address;
+}
+
+void SimulatedBackend::UnregisterMemory(void *memory)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto region = regions.begin(); region != regions.end(); region++) {
+        if (region->memory == memory) {
+            regions.erase(region);
+            break;
+        }
+    }
+    if (regions.empty()) {
+        nextAddress = SIMULATED_MEMORY_BASE;
+    }
+}
+
+volatile void *SimulatedBackend::Translate(uint32_t address, unsigned size) const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const MemoryRegion &region : regions) {
+        if ((address >= region.address) && (static_cast<uint64_t>(address) + size <= static_cast<uint64_t>(region.address) + region.size)) {
+            return reinterpret_cast<uint8_t *>(region.memory) + (address - region.address);
+        }
+    }
+    return nullptr;
+}
+
+volatile ClockRegisters *SimulatedBackend::GetClockRegisters()
+{
+    return &clock;
+}
+
+uint32_t SimulatedBackend::GetDivisorAddress() const
+{
+    return PERIPHERALS_PHYS_BASE + CLK0_BASE_OFFSET + offsetof(ClockRegisters, div);
+}
+
+uint32_t SimulatedBackend::GetFifoInAddress() const
+{
+    return PERIPHERALS_PHYS_BASE + PWM_BASE_OFFSET + offsetof(PWMRegisters, fifoIn);
+}
+
+void SimulatedBackend::SetSampleRate(unsigned sampleRate)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    this->sampleRate = sampleRate;
+}
+
+unsigned SimulatedBackend::GetSampleRate() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return sampleRate;
+}
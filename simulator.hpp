@@ -0,0 +1,106 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "peripherals.hpp"
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+struct DivisorWrite
+{
+    uint64_t time;
+    uint32_t divisor;
+};
+
+struct SimulatorStats
+{
+    uint64_t divisorWrites;
+    uint64_t droppedRecords;
+    uint64_t duration;
+    uint64_t maxInterval;
+};
+
+// Hardware-free backend: the clock divisor register, the PWM FIFO and a DMA engine
+// are modelled in memory. The DMA engine walks DMAControllBlock chains on its own
+// thread, paced by PWM FIFO DREQs at the configured sample rate, and every divisor
+// write (from DMA or CPU) is recorded with a timestamp in nanoseconds.
+class SimulatedBackend : public Backend
+{
+    public:
+        SimulatedBackend(float clockFrequency = 500.f, std::size_t maxRecords = 0);
+        SimulatedBackend(const SimulatedBackend &) = delete;
+        SimulatedBackend(SimulatedBackend &&) = delete;
+        SimulatedBackend &operator=(const SimulatedBackend &) = delete;
+        virtual float GetClockFrequency() const;
+        virtual std::unique_ptr<ClockOutput> CreateClockOutput(unsigned divisor);
+        virtual std::unique_ptr<PWMController> CreatePWMController(unsigned sampleRate);
+        virtual std::unique_ptr<DMAController> CreateDMAController(uint32_t address, unsigned dmaChannel);
+        virtual std::unique_ptr<AllocatedMemory> AllocateMemory(unsigned size);
+        virtual std::size_t GetMemoryLimit() const;
+        void SetMemoryLimit(std::size_t limit);
+        std::vector<DivisorWrite> GetDivisorWrites() const;
+        SimulatorStats GetStats() const;
+
+        uint64_t GetTime() const;
+        uint64_t GetTime(std::chrono::steady_clock::time_point time) const;
+        void RecordDivisor(uint32_t divisor, uint64_t time);
+        uint32_t RegisterMemory(void *memory, unsigned size);
+        void UnregisterMemory(void *memory);
+        volatile void *Translate(uint32_t address, unsigned size) const;
+        volatile ClockRegisters *GetClockRegisters();
+        uint32_t GetDivisorAddress() const;
+        uint32_t GetFifoInAddress() const;
+        void SetSampleRate(unsigned sampleRate);
+        unsigned GetSampleRate() const;
+    private:
+        struct MemoryRegion {
+            uint32_t address;
+            unsigned size;
+            void *memory;
+        };
+
+        float clockFrequency;
+        std::chrono::steady_clock::time_point start;
+        std::vector<MemoryRegion> regions;
+        uint32_t nextAddress;
+        std::size_t memoryLimit;
+        ClockRegisters clock;
+        unsigned sampleRate;
+        std::vector<DivisorWrite> records;
+        std::size_t maxRecords;
+        SimulatorStats stats;
+        uint64_t lastWrite;
+        mutable std::mutex mtx;
+};
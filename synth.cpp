@@ -1,311 +1,469 @@
-/*
-    Synth - Soft Synthesizer for Raspberry Pi 
-
-    Copyright (c) 2021, Trent McNair
-    All rights reserved.
-*/
-
-#include "synth.hpp"
-
-#include <alsa/asoundlib.h>
-#include <chrono>
-#include <cstring>
-#include <ctype.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <iostream>
-#include <pthread.h>
-#include <signal.h>
-#include <stdexcept>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/poll.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <thread>
-#include <unistd.h>
-
-#define MAX_CHANNELS 8
-
-static volatile int midinotes[MAX_CHANNELS] = { 0, 0, 0, 0 };
-static volatile unsigned short midivolumes[MAX_CHANNELS] = {0, 0, 0, 0};
-static volatile uint16_t synthPos = 0;
-static pthread_t thread_id;
-static const char *port_name = "hw:2,0,0";
-static int ignore_active_sensing = 1;
-static int timeout;
-static int stop;
-static snd_rawmidi_t *input, **inputp;
-
-const uint16_t note_freq[] = {
-      0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 
-     16,   17,   18,   19,   21,   22,   23,   25,   26,   28,   29,   31,
-     33,   35,   37,   39,   41,   44,   46,   49,   52,   55,   58,   62, 
-     65,   69,   73,   78,   82,   87,   93,   98,  104,  110,  117,  123, 
-    131,  139,  147,  156,  165,  175,  185,  196,  208,  220,  233,  247, 
-    262,  277,  294,  311,  330,  349,  370,  392,  415,  440,  466,  494, 
-    523,  554,  587,  622,  659,  698,  740,  784,  831,  880,  932,  988,
-   1047, 1109, 1175, 1245, 1319, 1397, 1480, 1568, 1661, 1760, 1865, 1976,
-   2093, 2218, 2349, 2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951,
-   4186, 4435, 4699, 4978, 5274, 5588, 5920, 6272, 6645, 7040, 7459, 7902,
-   8372, 8870, 9397, 9956,10548,11175,11840,12544   
-};
-
-
-static void error(const char *format, ...)
-{
-        va_list ap;
-
-        va_start(ap, format);
-        vfprintf(stderr, format, ap);
-        va_end(ap);
-        putc('\n', stderr);
-}
-
-
-
-void Synth::process_midimessage(unsigned char byte)
-{
-        static enum {
-                STATE_UNKNOWN,
-                STATE_1PARAM,
-                STATE_1PARAM_CONTINUE,
-                STATE_2PARAM_1,
-                STATE_2PARAM_2,
-                STATE_2PARAM_1_CONTINUE,
-                STATE_SYSEX
-        } state = STATE_UNKNOWN;
-
-        if (byte >= 0xf0) {
-                switch (byte) {
-                case 0xf0:
-                        state = STATE_SYSEX;
-                        break;
-                case 0xf1:
-                case 0xf3:
-                        state = STATE_1PARAM;
-                        break;
-                case 0xf2:
-                        state = STATE_2PARAM_1;
-                        break;
-                case 0xf4:
-                case 0xf5:
-                case 0xf6:
-                        state = STATE_UNKNOWN;
-                        break;
-                case 0xf7:
-                        state = STATE_UNKNOWN;
-                        break;
-                }
-        } else if (byte >= 0x80) {
-                if (byte >= 0xc0 && byte <= 0xdf) {
-                        state = STATE_1PARAM;
-                }
-                else  {
-                        state = STATE_2PARAM_1;
-                        midicommand = byte;
-                }
-        } else /* b < 0x80 */ {
-                int running_status = 0;
-                switch (state) {
-                case STATE_1PARAM:
-                        state = STATE_1PARAM_CONTINUE;
-                        break;
-                case STATE_1PARAM_CONTINUE:
-                        running_status = 1;
-                        break;
-                case STATE_2PARAM_1:
-                        state = STATE_2PARAM_2;
-                        midinote = byte;
-                        break;
-                case STATE_2PARAM_2:
-                        state = STATE_2PARAM_1_CONTINUE;
-                        midivol = byte;
-                        break;
-                case STATE_2PARAM_1_CONTINUE:
-                        running_status = 1;
-                        state = STATE_2PARAM_2;
-                        break;
-                default:
-                        break;
-                }
-                if (running_status)
-                        fputs("\n  ", stdout);
-        }
-
-        if (state == 5) {
-            if (midicommand == 155) {
-                int freeChannel = -1;
-                for (int i=0; i<GetChannels(); i++) {
-                  if (midinotes[i] == 0 ) freeChannel = i;
-                  else if (midinotes[i] == midinote) {
-                     freeChannel = -1;
-                     break;
-                  }
-                }
-                if (freeChannel >= 0) {
-                     midinotes[freeChannel] = midinote;
-                     midivolumes[freeChannel] = midivol * 256;
-                     std::cout << "midinote on:  " << (int)midinote << ", channel: " << freeChannel << ", volume: " << (int)midivol << std::endl;
-                }
-            }
-            else {
-                for (int i=0; i<GetChannels(); i++) {
-                  if (midinotes[i] == midinote) {
-                    midinotes[i] = 0;
-                    midivolumes[i] = 0;
-                    std::cout << "midinote off: " << (int)midinote << ", channel: " << i << std::endl;
-                    break;
-                  }
-               }
-            }
-        }
-}
-
-//static void sig_handler(int dummy)
-//{
-//        stop = 1;
-//}
-
-
-void *synthThread(void *args)
-{
-    Synth * synth = (Synth*)args;
-    int err = 0;
-
-    inputp = &input;
-
-        if ((err = snd_rawmidi_open(inputp, NULL, port_name, SND_RAWMIDI_NONBLOCK)) < 0) {
-                error("cannot open port \"%s\": %s", port_name, snd_strerror(err));
-                return 0;
-        }
-
-        snd_rawmidi_params_t *params;
-        snd_rawmidi_params_malloc(&params);
-        snd_rawmidi_params_current(input,params);
-        std::cout << "default ring buffer size: " << snd_rawmidi_params_get_buffer_size(params) << std::endl;
-        snd_rawmidi_params_set_buffer_size(input,params,32);
-        snd_rawmidi_params_set_avail_min(input, params, 1);
-        snd_rawmidi_params(input,params);
-        snd_rawmidi_params_free(params);
-
-        snd_rawmidi_params_malloc(&params);
-        snd_rawmidi_params_current(input,params);
-        std::cout << "new ring buffer size: " << snd_rawmidi_params_get_buffer_size(params) << std::endl;
-        snd_rawmidi_params_free(params);
-
-
-        if (inputp)
-                snd_rawmidi_read(input, NULL, 0); /* trigger reading */
-
-
-        if (inputp) {
-                int read = 0;
-                int npfds, time = 0;
-                struct pollfd *pfds;
-
-                timeout *= 1000;
-                npfds = snd_rawmidi_poll_descriptors_count(input);
-                std::cout << "npfds: " << npfds << std::endl;
-                pfds = (pollfd*)alloca(npfds * sizeof(struct pollfd));
-                snd_rawmidi_poll_descriptors(input, pfds, npfds);
-                unsigned char buf[1];
-                //signal(SIGINT, sig_handler);
-                for (;;) {
-                        //unsigned char buf[256];
-                        int i, length;
-                        unsigned short revents;
-                        err = poll(pfds, npfds, /* 1 */1000);
-                        if (stop || (err < 0 && errno == EINTR))
-                                break;
-                        if (err < 0) {
-                                error("poll failed: %s", strerror(errno));
-                                break;
-                        }
-                        if (err == 0) {
-                                time += 1;
-                                if (timeout && time >= timeout)
-                                        break;
-                                continue;
-                        }
-                        if ((err = snd_rawmidi_poll_descriptors_revents(input, pfds, npfds, &revents)) < 0) {
-                                error("cannot get poll events: %s", snd_strerror(errno));
-                                break;
-                        }
-                        if (revents & (POLLERR | POLLHUP))
-                                break;
-                        if (!(revents & POLLIN))
-                                continue;
-                        err = snd_rawmidi_read(input, buf, 1);
-                        if (err == -EAGAIN)
-                                continue;
-                        if (err < 0) {
-                                error("cannot read from port \"%s\": %s", port_name, snd_strerror(err));
-                                break;
-                        }
-                        length = 0;
-                        for (i = 0; i < err; ++i) {
-                                if (!ignore_active_sensing || buf[i] != 0xfe)  {
-                                        buf[length++] = buf[i];
-                                }
-                        }
-                        if (length == 0)
-                                continue;
-                        read += length;
-                        time = 0;
-                        for (i = 0; i < length; ++i)
-                                synth->process_midimessage(buf[i]);
-                        //fflush(stdout);
-                }
-        }
-
-   return 0;
-}
-
-
-Synth::Synth(bool &stop) 
-{
-    // TODO: kick off thread that listens for input on stdin.
-    pthread_create(&thread_id, NULL, synthThread, this);
-}
-
-Synth::~Synth()
-{
-}
-
-
-float Synth::GetNextSample() {
-    double t = (double) synthPos / GetSampleRate();
-    short sample[4];
-    for (int j=0; j<GetChannels(); j++) {
-        double samp = sin((note_freq[midinotes[j]])*t*2*M_PI);
-        sample[j] = midivolumes[j] * samp;
-    }
-    Sample s((uint8_t*)&sample, GetChannels(), GetBitsPerSample());
-    synthPos++;
-    return s.GetMonoValue();
-}
-
-
-std::vector<Sample> Synth::GetSamples(unsigned quantity, bool &stop) {
-
-    unsigned int i = 0;
-    std::vector<Sample> samples;
-
-    while (i < quantity) {
-      i++;
-
-      double t = (double) synthPos / GetSampleRate();
-      short sample[4];
-      for (int j=0; j<GetChannels(); j++) {
-          double samp = sin((note_freq[midinotes[j]])*t*2*M_PI);
-          sample[j] = midivolumes[j] * samp;
-      }
-      samples.push_back(Sample((uint8_t*)&sample, GetChannels(), GetBitsPerSample()));
-
-      synthPos++; // rolls over @ 65535
-    }
-    return samples;
-
-}
+/*
+    Synth - Soft Synthesizer for Raspberry Pi 
+
+    Copyright (c) 2021, Trent McNair
+    All rights reserved.
+*/
+
+#include "synth.hpp"
+#include "cprofiler.hpp"
+
+#include <alsa/asoundlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <pthread.h>
+#include <signal.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/poll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define MIDI_READ_SIZE 256
+#define MIDI_BUFFER_SIZE 4096
+
+static uint64_t GetTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Headroom for several voices at full velocity, the mix is clipped to -1 - 1.
+#define SYNTH_GAIN 0.25f
+
+// The MIDI thread wakes up this often to check whether it should stop (ms).
+#define MIDI_POLL_TIME 100
+
+// Equal temperament, A4 (note 69) at 440 Hz.
+static float GetNoteFrequency(int note)
+{
+    return 440.f * std::pow(2.f, (note - 69) / 12.f);
+}
+
+
+static void error(const char *format, ...)
+{
+        va_list ap;
+
+        va_start(ap, format);
+        vfprintf(stderr, format, ap);
+        va_end(ap);
+        putc('\n', stderr);
+}
+
+
+
+void Synth::process_midimessage(unsigned char byte, uint64_t time)
+{
+        int complete = 0;
+
+        if (byte >= 0xf0) {
+                switch (byte) {
+                case 0xf0:
+                        midiState = MidiState::SysEx;
+                        break;
+                case 0xf1:
+                case 0xf3:
+                        midiState = MidiState::OneParam;
+                        break;
+                case 0xf2:
+                        midiState = MidiState::TwoParamFirst;
+                        midicommand = byte;
+                        break;
+                case 0xf4:
+                case 0xf5:
+                case 0xf6:
+                        midiState = MidiState::Unknown;
+                        break;
+                case 0xf7:
+                        midiState = MidiState::Unknown;
+                        break;
+                }
+        } else if (byte >= 0x80) {
+                if (byte >= 0xc0 && byte <= 0xdf) {
+                        midiState = MidiState::OneParam;
+                }
+                else  {
+                        midiState = MidiState::TwoParamFirst;
+                        midicommand = byte;
+                }
+        } else /* b < 0x80 */ {
+                switch (midiState) {
+                case MidiState::OneParam:
+                        midiState = MidiState::OneParamContinue;
+                        break;
+                case MidiState::OneParamContinue:
+                        break;
+                case MidiState::TwoParamFirst:
+                        midiState = MidiState::TwoParamSecond;
+                        midinote = byte;
+                        break;
+                case MidiState::TwoParamSecond:
+                        midiState = MidiState::TwoParamFirstContinue;
+                        midivol = byte;
+                        complete = 1;
+                        break;
+                case MidiState::TwoParamFirstContinue:
+                        midiState = MidiState::TwoParamSecond;
+                        midinote = byte;
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        // Note messages are queued once their last data byte arrives, realtime
+        // bytes interleaved with them do not repeat the message.
+        if (complete && (((midicommand & 0xf0) == 0x80) || ((midicommand & 0xf0) == 0x90))) {
+            MidiEvent event;
+            event.time = time;
+            event.type = (((midicommand & 0xf0) == 0x90) && midivol) ? MidiEvent::Type::NoteOn : MidiEvent::Type::NoteOff;
+            event.note = midinote;
+            event.velocity = midivol;
+            QueueEvent(event);
+        }
+}
+
+void Synth::MidiThread()
+{
+    int err = 0;
+    snd_rawmidi_t *input;
+    TrentCode::setThreadName("synth midi");
+
+        if ((err = snd_rawmidi_open(&input, NULL, port.c_str(), SND_RAWMIDI_NONBLOCK)) < 0) {
+                error("cannot open port \"%s\": %s", port.c_str(), snd_strerror(err));
+                return;
+        }
+
+        snd_rawmidi_params_t *params;
+        snd_rawmidi_params_malloc(&params);
+        snd_rawmidi_params_current(input,params);
+        snd_rawmidi_params_set_buffer_size(input,params,MIDI_BUFFER_SIZE);
+        snd_rawmidi_params_set_avail_min(input, params, 1);
+        snd_rawmidi_params(input,params);
+        snd_rawmidi_params_free(params);
+
+        snd_rawmidi_read(input, NULL, 0); /* trigger reading */
+
+        int npfds = snd_rawmidi_poll_descriptors_count(input);
+        struct pollfd *pfds = (pollfd*)alloca(npfds * sizeof(struct pollfd));
+        snd_rawmidi_poll_descriptors(input, pfds, npfds);
+        unsigned char buf[MIDI_READ_SIZE];
+        for (;;) {
+                int i, length;
+                unsigned short revents;
+                err = poll(pfds, npfds, MIDI_POLL_TIME);
+                if (midiStop || (err < 0 && errno == EINTR))
+                        break;
+                if (err < 0) {
+                        error("poll failed: %s", strerror(errno));
+                        break;
+                }
+                if (err == 0)
+                        continue;
+                if ((err = snd_rawmidi_poll_descriptors_revents(input, pfds, npfds, &revents)) < 0) {
+                        error("cannot get poll events: %s", snd_strerror(errno));
+                        break;
+                }
+                if (revents & (POLLERR | POLLHUP))
+                        break;
+                if (!(revents & POLLIN))
+                        continue;
+                err = snd_rawmidi_read(input, buf, sizeof(buf));
+                if (err == -EAGAIN)
+                        continue;
+                if (err < 0) {
+                        error("cannot read from port \"%s\": %s", port.c_str(), snd_strerror(err));
+                        break;
+                }
+                // Active sensing (0xfe) keeps the link alive and carries no notes.
+                length = 0;
+                for (i = 0; i < err; ++i) {
+                        if (buf[i] != 0xfe)  {
+                                buf[length++] = buf[i];
+                        }
+                }
+                if (length == 0)
+                        continue;
+                CPROF_NAMED("midi message");
+                uint64_t now = GetTime();
+                for (i = 0; i < length; ++i)
+                        process_midimessage(buf[i], now);
+        }
+        snd_rawmidi_close(input);
+}
+
+
+Synth::Synth(const std::string &port, unsigned voices, unsigned sampleRate)
+    : port(port), midiStop(false), midiState(MidiState::Unknown), sampleRate(sampleRate),
+      voices(std::min(std::max(voices, 1u), static_cast<unsigned>(SYNTH_MAX_VOICES))), noteCounter(0), clockStart(0), rendered(0),
+      latency(SYNTH_BLOCK_SIZE), pendingEvents(0), droppedEvents(0)
+{
+    events.Reset(SYNTH_QUEUE_SIZE);
+    active.reserve(this->voices.size());
+    for (Voice &voice : this->voices) {
+        voice.note = VOICE_NO_NOTE;
+        voice.velocity = 0.f;
+        voice.started = 0;
+        voice.envelope.SetParameters(ENVELOPE_ATTACK, ENVELOPE_DECAY, ENVELOPE_SUSTAIN, ENVELOPE_RELEASE, sampleRate);
+    }
+    midiThread = std::thread(&Synth::MidiThread, this);
+}
+
+Synth::~Synth()
+{
+    midiStop = true;
+    midiThread.join();
+}
+
+std::string Synth::GetName() const
+{
+    return "MIDI " + port;
+}
+
+unsigned Synth::GetSampleRate() const
+{
+    return sampleRate;
+}
+
+unsigned Synth::GetChannels() const
+{
+    return 1;
+}
+
+void Synth::SetWaveform(Waveform waveform)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    for (Voice &voice : voices) {
+        voice.oscillator.SetWaveform(waveform);
+    }
+}
+
+void Synth::SetEnvelope(float attack, float decay, float sustain, float release)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    for (Voice &voice : voices) {
+        voice.envelope.SetParameters(attack, decay, sustain, release, GetSampleRate());
+    }
+}
+
+void Synth::NoteOn(int note, int velocity)
+{
+    MidiEvent event;
+    event.time = GetTime();
+    event.type = velocity ? MidiEvent::Type::NoteOn : MidiEvent::Type::NoteOff;
+    event.note = note;
+    event.velocity = velocity;
+    QueueEvent(event);
+}
+
+void Synth::NoteOff(int note)
+{
+    MidiEvent event;
+    event.time = GetTime();
+    event.type = MidiEvent::Type::NoteOff;
+    event.note = note;
+    event.velocity = 0;
+    QueueEvent(event);
+}
+
+void Synth::QueueEvent(const MidiEvent &event)
+{
+    if (!events.Push(&event, 1)) {
+        droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Synth::SetLatency(unsigned time)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    latency = static_cast<uint64_t>(time) * GetSampleRate() / 1000000;
+}
+
+unsigned long long Synth::GetDroppedEvents() const
+{
+    return droppedEvents.load(std::memory_order_relaxed);
+}
+
+// Starts a note on the voice already playing it, a free voice, or else steals
+// the quietest releasing voice and, failing that, the oldest one.
+void Synth::StartNote(int note, int velocity)
+{
+    Voice *target = nullptr, *quietest = nullptr, *oldest = nullptr;
+    for (unsigned index : active) {
+        Voice &voice = voices[index];
+        if (voice.note == note) {
+            target = &voice;
+            break;
+        }
+        if ((voice.envelope.GetStage() == Envelope::Stage::Release) && (!quietest || (voice.envelope.GetLevel() < quietest->envelope.GetLevel()))) {
+            quietest = &voice;
+        }
+        if (!oldest || (voice.started < oldest->started)) {
+            oldest = &voice;
+        }
+    }
+    if (!target && (active.size() < voices.size())) {
+        for (unsigned index = 0; index < voices.size(); index++) {
+            if (voices[index].envelope.GetStage() == Envelope::Stage::Idle) {
+                target = &voices[index];
+                active.push_back(index);
+                break;
+            }
+        }
+    }
+    if (!target) {
+        target = quietest ? quietest : oldest;
+    }
+    if (target->note != note) {
+        target->oscillator.SetFrequency(GetNoteFrequency(note), GetSampleRate());
+        target->note = note;
+    }
+    target->velocity = velocity / 127.f;
+    target->started = ++noteCounter;
+    target->envelope.NoteOn();
+}
+
+void Synth::StopNote(int note)
+{
+    for (unsigned index : active) {
+        if ((voices[index].note == note) && (voices[index].envelope.GetStage() != Envelope::Stage::Release)) {
+            voices[index].envelope.NoteOff();
+        }
+    }
+}
+
+// The synth never ends, it renders silence while no note is held.
+unsigned Synth::Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    for (unsigned offset = 0; offset < frames; offset += SYNTH_BLOCK_SIZE) {
+        Mix(&samples[offset], std::min(frames - offset, static_cast<unsigned>(SYNTH_BLOCK_SIZE)));
+    }
+    return frames;
+}
+
+// Adds a voice scaled by its envelope levels to the mix. Multiplies and adds
+// stay separate (no FMA), so every kernel gives the scalar result.
+static void MixVoice(float *samples, const float *voice, const float *levels, unsigned count)
+{
+    unsigned i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256 product = _mm256_mul_ps(_mm256_loadu_ps(&voice[i]), _mm256_loadu_ps(&levels[i]));
+        _mm256_storeu_ps(&samples[i], _mm256_add_ps(_mm256_loadu_ps(&samples[i]), product));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(&voice[i]), _mm_loadu_ps(&levels[i]));
+        _mm_storeu_ps(&samples[i], _mm_add_ps(_mm_loadu_ps(&samples[i]), product));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t product = vmulq_f32(vld1q_f32(&voice[i]), vld1q_f32(&levels[i]));
+        vst1q_f32(&samples[i], vaddq_f32(vld1q_f32(&samples[i]), product));
+    }
+#endif
+    for (; i < count; i++) {
+        samples[i] += voice[i] * levels[i];
+    }
+}
+
+// Events are placed on the output sample clock: an event goes to the sample
+// which was being played when it was stamped, plus a fixed latency. The clock
+// starts with the first rendered block and runs at the sample rate. Playback
+// is never more than a block ahead of rendering (that is a stall) nor more
+// than the latency behind it (the output buffers hold no more), so the clock
+// is moved back inside these bounds, which keeps it within the buffering of
+// the real playback position. Events due before this block start it, later
+// ones stay pending until their block is rendered.
+void Synth::Mix(float *samples, unsigned quantity)
+{
+    uint64_t now = GetTime();
+    std::fill(samples, samples + quantity, 0.f);
+    std::lock_guard<std::mutex> lock(mtx);
+    uint64_t clock = GetClockSample(now);
+    if (!rendered || (clock > rendered + SYNTH_BLOCK_SIZE)) {
+        clockStart = now - GetSampleTime(rendered);
+    } else if (clock + latency < rendered) {
+        clockStart = now - GetSampleTime(rendered - latency);
+    }
+    pendingEvents += events.Pop(&blockEvents[pendingEvents], SYNTH_BLOCK_EVENTS - pendingEvents);
+    unsigned offset = 0, applied = 0;
+    for (; applied < pendingEvents; applied++) {
+        const MidiEvent &event = blockEvents[applied];
+        uint64_t sample = GetClockSample(event.time) + latency;
+        if (sample >= rendered + quantity) {
+            break;
+        }
+        unsigned position = (sample > rendered) ? sample - rendered : 0;
+        if (position > offset) {
+            RenderVoices(&samples[offset], position - offset);
+            offset = position;
+        }
+        if (event.type == MidiEvent::Type::NoteOn) {
+            StartNote(event.note, event.velocity);
+        } else {
+            StopNote(event.note);
+        }
+    }
+    std::copy(&blockEvents[applied], &blockEvents[pendingEvents], blockEvents);
+    pendingEvents -= applied;
+    RenderVoices(&samples[offset], quantity - offset);
+    rendered += quantity;
+    for (unsigned j = 0; j < quantity; j++) {
+        samples[j] = std::min(std::max(samples[j], -1.f), 1.f);
+    }
+}
+
+// Whole seconds and the remainder are converted separately, so these do not
+// overflow however long the synth runs.
+uint64_t Synth::GetSampleTime(uint64_t sample) const
+{
+    return sample / GetSampleRate() * 1000000000 + sample % GetSampleRate() * 1000000000 / GetSampleRate();
+}
+
+uint64_t Synth::GetClockSample(uint64_t time) const
+{
+    if (time < clockStart) {
+        return 0;
+    }
+    uint64_t elapsed = time - clockStart;
+    return elapsed / 1000000000 * GetSampleRate() + elapsed % 1000000000 * GetSampleRate() / 1000000000;
+}
+
+// Renders only the voices which are sounding, so the cost follows the number
+// of held notes rather than the pool size.
+void Synth::RenderVoices(float *samples, unsigned quantity)
+{
+    if (!quantity) {
+        return;
+    }
+    for (std::size_t i = 0; i < active.size();) {
+        Voice &voice = voices[active[i]];
+        std::fill(voiceBuffer, voiceBuffer + quantity, 0.f);
+        voice.oscillator.Render(voiceBuffer, quantity, voice.velocity * SYNTH_GAIN);
+        voice.envelope.Render(levelBuffer, quantity);
+        MixVoice(samples, voiceBuffer, levelBuffer, quantity);
+        if (voice.envelope.GetStage() == Envelope::Stage::Idle) {
+            voice.note = VOICE_NO_NOTE;
+            active[i] = active.back();
+            active.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
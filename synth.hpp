@@ -35,31 +35,84 @@
 #define SYNTH_HPP
 
 #include "audio_source.hpp"
-#include "sample.hpp"
+#include "voice.hpp"
+#include "ring_buffer.hpp"
+#include <atomic>
 #include <math.h>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#define SYNTH_MIDI_PORT "hw:2,0,0"
+#define SYNTH_SAMPLE_RATE 22050
+#define SYNTH_VOICES 16
+#define SYNTH_MAX_VOICES 64
+#define SYNTH_BLOCK_SIZE 256
+#define SYNTH_BLOCK_EVENTS 64
+#define SYNTH_QUEUE_SIZE 1024
+
+// Parsed MIDI message, time is taken from the steady clock (nanoseconds) when
+// the bytes were read.
+struct MidiEvent
+{
+    enum class Type : uint8_t { NoteOn, NoteOff };
+    uint64_t time;
+    Type type;
+    uint8_t note;
+    uint8_t velocity;
+};
+
 class Synth: public AudioSource
 {
     public:
-        Synth(bool &stop);
+        Synth(const std::string &port = SYNTH_MIDI_PORT, unsigned voices = SYNTH_VOICES, unsigned sampleRate = SYNTH_SAMPLE_RATE);
         virtual ~Synth();
         Synth(const Synth &) = delete;
         Synth(Synth &&) = delete;
         Synth &operator=(const Synth &) = delete;
-        std::vector<Sample> GetSamples(unsigned quantity, bool &stop);
-        bool SetSampleOffset(unsigned offset) { return true; }
-
-	uint16_t GetChannels() { return 4; }
-	uint32_t GetSampleRate() { return 22050; }
-	uint16_t GetBitsPerSample() { return 16; }
-        void process_midimessage(unsigned char byte);
-        float GetNextSample();
+        std::string GetName() const;
+        unsigned GetSampleRate() const;
+        unsigned GetChannels() const;
+        unsigned Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx);
+        void process_midimessage(unsigned char byte, uint64_t time);
+        void SetWaveform(Waveform waveform);
+        void SetEnvelope(float attack, float decay, float sustain, float release);
+        // Note events go through a single producer queue, call these only
+        // from one thread at a time (the MIDI thread does while it runs).
+        void NoteOn(int note, int velocity);
+        void NoteOff(int note);
+        // Time (microseconds) from an event to the sample it sounds on, at
+        // least the output buffering so events land ahead of playback.
+        void SetLatency(unsigned time);
+        unsigned long long GetDroppedEvents() const;
     private:
+        enum class MidiState { Unknown, OneParam, OneParamContinue, TwoParamFirst, TwoParamSecond, TwoParamFirstContinue, SysEx };
+        void MidiThread();
+        void QueueEvent(const MidiEvent &event);
+        void StartNote(int note, int velocity);
+        void StopNote(int note);
+        void Mix(float *samples, unsigned quantity);
+        void RenderVoices(float *samples, unsigned quantity);
+        uint64_t GetSampleTime(uint64_t sample) const;
+        uint64_t GetClockSample(uint64_t time) const;
+        std::string port;
+        std::thread midiThread;
+        std::atomic<bool> midiStop;
+        MidiState midiState;
         unsigned char midicommand;
         unsigned char midinote;
         unsigned char midivol;
+        std::mutex mtx;
+        unsigned sampleRate;
+        std::vector<Voice> voices;
+        std::vector<unsigned> active;
+        uint64_t noteCounter, clockStart, rendered, latency;
+        RingBuffer<MidiEvent> events;
+        MidiEvent blockEvents[SYNTH_BLOCK_EVENTS];
+        unsigned pendingEvents;
+        std::atomic<unsigned long long> droppedEvents;
+        float voiceBuffer[SYNTH_BLOCK_SIZE], levelBuffer[SYNTH_BLOCK_SIZE];
 };
 
 #endif // SYNTH_HPP
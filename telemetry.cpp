@@ -0,0 +1,142 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "telemetry.hpp"
+#include <stdexcept>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+Telemetry::Telemetry()
+    : data(new TelemetryData()), shared(false), owner(true)
+{
+    data->magic = TELEMETRY_MAGIC;
+    data->version = TELEMETRY_VERSION;
+    data->pid = getpid();
+}
+
+Telemetry::Telemetry(const std::string &name, bool publish)
+    : name((name.empty() || (name[0] != '/')) ? "/" + name : name), data(nullptr), shared(true), owner(publish)
+{
+    int fd = shm_open(this->name.c_str(), publish ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Cannot open telemetry " + this->name);
+    }
+    if (publish && ftruncate(fd, sizeof(TelemetryData))) {
+        close(fd);
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("Cannot create telemetry " + this->name);
+    }
+    void *mapped = mmap(nullptr, sizeof(TelemetryData), publish ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        if (publish) {
+            shm_unlink(this->name.c_str());
+        }
+        throw std::runtime_error("Cannot map telemetry " + this->name);
+    }
+    if (publish) {
+        data = new (mapped) TelemetryData();
+        data->magic = TELEMETRY_MAGIC;
+        data->version = TELEMETRY_VERSION;
+        data->pid = getpid();
+    } else {
+        data = reinterpret_cast<TelemetryData *>(mapped);
+        if ((data->magic != TELEMETRY_MAGIC) || (data->version != TELEMETRY_VERSION)) {
+            munmap(mapped, sizeof(TelemetryData));
+            throw std::runtime_error("Incompatible telemetry " + this->name);
+        }
+    }
+}
+
+Telemetry::~Telemetry()
+{
+    if (!shared) {
+        delete data;
+        return;
+    }
+    munmap(data, sizeof(TelemetryData));
+    if (owner) {
+        shm_unlink(name.c_str());
+    }
+}
+
+TelemetryData &Telemetry::GetData() const
+{
+    return *data;
+}
+
+void Telemetry::Add(std::atomic<uint32_t> &counter, uint32_t value)
+{
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Telemetry::Record(TelemetryHistogram &histogram, uint32_t value)
+{
+    unsigned bucket = value;
+    if (value >= 4) {
+        unsigned exponent = 31 - __builtin_clz(value);
+        bucket = 4 * (exponent - 1) + ((value >> (exponent - 2)) & 0x03);
+    }
+    histogram.counts[(bucket < TELEMETRY_HISTOGRAM_SIZE) ? bucket : TELEMETRY_HISTOGRAM_SIZE - 1].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t Telemetry::GetBucketValue(unsigned bucket)
+{
+    if (bucket < 4) {
+        return bucket;
+    }
+    return (4 + (bucket & 0x03)) << (bucket / 4 - 1);
+}
+
+uint32_t Telemetry::GetCount(const TelemetryHistogram &histogram)
+{
+    uint32_t count = 0;
+    for (const std::atomic<uint32_t> &bucket : histogram.counts) {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint32_t Telemetry::GetPercentile(const TelemetryHistogram &histogram, unsigned percent)
+{
+    uint64_t rank = (static_cast<uint64_t>(GetCount(histogram)) * percent + 99) / 100, count = 0;
+    for (unsigned i = 0; i < TELEMETRY_HISTOGRAM_SIZE - 1; i++) {
+        count += histogram.counts[i].load(std::memory_order_relaxed);
+        if (count >= rank) {
+            return i ? GetBucketValue(i + 1) - 1 : 0;
+        }
+    }
+    return UINT32_MAX;
+}
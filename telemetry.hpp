@@ -0,0 +1,94 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define TELEMETRY_MAGIC 0x31544d46
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_HISTOGRAM_SIZE 80
+
+// Fixed buckets, four per power of two: values 0 - 3 have their own buckets,
+// above that every octave is split into quarters (at most 25% wide, eg.
+// [1024, 1280)). The last bucket counts everything from its start up.
+struct TelemetryHistogram
+{
+    std::atomic<uint32_t> counts[TELEMETRY_HISTOGRAM_SIZE];
+};
+
+// Live transmitter metrics. The layout is shared with other processes through
+// POSIX shared memory, so it contains only lock-free 32-bit atomics; counters
+// wrap around and readers are expected to look at differences between reads.
+struct TelemetryData
+{
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> pid;
+    std::atomic<uint32_t> sampleRate;
+    std::atomic<uint32_t> samples;
+    std::atomic<uint32_t> droppedSamples;
+    std::atomic<uint32_t> duplicatedSamples;
+    std::atomic<uint32_t> underruns;
+    std::atomic<uint32_t> refills;
+    std::atomic<uint32_t> lateRefills;
+    std::atomic<uint32_t> readerStallTime;
+    TelemetryHistogram refillLatency;
+    TelemetryHistogram refillHeadroom;
+    TelemetryHistogram timingError;
+};
+
+class Telemetry
+{
+    public:
+        Telemetry();
+        Telemetry(const std::string &name, bool publish);
+        virtual ~Telemetry();
+        Telemetry(const Telemetry &) = delete;
+        Telemetry(Telemetry &&) = delete;
+        Telemetry &operator=(const Telemetry &) = delete;
+        TelemetryData &GetData() const;
+        static void Add(std::atomic<uint32_t> &counter, uint32_t value);
+        static void Record(TelemetryHistogram &histogram, uint32_t value);
+        // Smallest value counted by a bucket.
+        static uint32_t GetBucketValue(unsigned bucket);
+        static uint32_t GetCount(const TelemetryHistogram &histogram);
+        // Upper end of the bucket holding the given percentile, 0 when empty.
+        static uint32_t GetPercentile(const TelemetryHistogram &histogram, unsigned percent);
+    private:
+        std::string name;
+        TelemetryData *data;
+        bool shared, owner;
+};
@@ -0,0 +1,67 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "memory_source.hpp"
+#include "audio_processor.hpp"
+
+static const unsigned processorRates[] = { 22050, 44100, 192000 };
+
+// CPU time spent per second of one channel by the whole processing chain,
+// with and without pre-emphasis, for noise loud enough to keep the limiter
+// working. Includes copying the input from memory.
+BENCHMARK(AudioProcessorCost)
+{
+    std::vector<float> noise(2 * 22050);
+    for (float &sample : noise) {
+        sample = 1.5f * GetRandomFloat();
+    }
+    std::vector<float> output(2 * PROCESSOR_BLOCK_SIZE);
+    bool enable = true;
+    std::mutex mtx;
+
+    for (unsigned sampleRate : processorRates) {
+        for (unsigned channels = 1; channels <= 2; channels++) {
+            for (unsigned preEmphasis : { 0, 75 }) {
+                MemorySource source(noise, channels, sampleRate, true);
+                AudioProcessor processor(sampleRate, preEmphasis);
+                processor.SetSource(source);
+                double rate = PROCESSOR_BLOCK_SIZE * Measure([&]() {
+                    processor.Read(output.data(), PROCESSOR_BLOCK_SIZE, enable, mtx);
+                });
+                std::string name = std::to_string(sampleRate) + " Hz " + ((channels == 1) ? "mono" : "stereo") + (preEmphasis ? ", 75 us" : ", no emphasis");
+                Report(name, 1000.0 * sampleRate / (rate * channels), "ms/channel-second");
+            }
+        }
+    }
+}
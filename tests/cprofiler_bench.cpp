@@ -0,0 +1,75 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "cprofiler.hpp"
+
+#define PROFILER_BENCH_SCOPES 100000
+
+static volatile unsigned profiledWork;
+
+static void RunScopes()
+{
+    for (unsigned i = 0; i < PROFILER_BENCH_SCOPES; i++) {
+        CPROF_NAMED("bench scope");
+        profiledWork = i;
+    }
+}
+
+static void RunNestedScopes()
+{
+    for (unsigned i = 0; i < PROFILER_BENCH_SCOPES; i++) {
+        CPROF_NAMED("bench outer scope");
+        {
+            CPROF_NAMED("bench inner scope");
+            profiledWork = i;
+        }
+    }
+}
+
+static void RunBaseline()
+{
+    for (unsigned i = 0; i < PROFILER_BENCH_SCOPES; i++) {
+        profiledWork = i;
+    }
+}
+
+// Cost of entering and leaving one scope, including the periodic draining of
+// the per-thread ring and aggregation it triggers, net of the loop itself.
+BENCHMARK(ProfilerScopeOverhead)
+{
+    TrentCode::setThreadName("bench");
+    double baseline = 1000000000.0 / Measure(RunBaseline);
+    Report("scope", (1000000000.0 / Measure(RunScopes) - baseline) / PROFILER_BENCH_SCOPES, "ns");
+    Report("nested scopes", (1000000000.0 / Measure(RunNestedScopes) - baseline) / (2 * PROFILER_BENCH_SCOPES), "ns per scope");
+}
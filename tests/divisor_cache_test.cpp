@@ -0,0 +1,68 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "divisor_cache.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+// Stores divisors for a file and looks them up again with the same and with
+// different keys; only an identical key may hit.
+TEST(DivisorCacheKeyCoversPipeline)
+{
+    char directory[] = "/tmp/fm_transmitter_testXXXXXX";
+    CHECK(mkdtemp(directory));
+    std::string source = std::string(directory) + "/source.wav";
+    std::ofstream(source) << "RIFF";
+
+    const uint32_t divisors[] = { 1, 2, 3 };
+    {
+        DivisorCache cache(directory, source, 22050, 0x5000, 0x30, DIVISOR_CACHE_RESAMPLED);
+        CHECK(!cache.IsHit());
+        cache.Append(divisors, 3);
+        cache.Commit();
+    }
+    DivisorCache hit(directory, source, 22050, 0x5000, 0x30, DIVISOR_CACHE_RESAMPLED);
+    CHECK(hit.IsHit() && (hit.GetSize() == 3) && (hit.GetDivisors()[2] == 3));
+    CHECK(!DivisorCache(directory, source, 44100, 0x5000, 0x30, DIVISOR_CACHE_RESAMPLED).IsHit());
+    CHECK(!DivisorCache(directory, source, 22050, 0x5001, 0x30, DIVISOR_CACHE_RESAMPLED).IsHit());
+    CHECK(!DivisorCache(directory, source, 22050, 0x5000, 0x31, DIVISOR_CACHE_RESAMPLED).IsHit());
+    CHECK(!DivisorCache(directory, source, 22050, 0x5000, 0x30, 0).IsHit());
+    CHECK(!DivisorCache(directory, source, 22050, 0x5000, 0x30, DIVISOR_CACHE_RESAMPLED | DIVISOR_CACHE_STEREO).IsHit());
+    CHECK(!DivisorCache(directory, source, 22050, 0x5000, 0x30, DIVISOR_CACHE_RESAMPLED | DIVISOR_CACHE_RDS).IsHit());
+    CHECK(!DivisorCache(directory, source, 22050, 0x5000, 0x30, DIVISOR_CACHE_RESAMPLED | DIVISOR_CACHE_PROCESSED | (50 << DIVISOR_CACHE_EMPHASIS_SHIFT)).IsHit());
+    std::ofstream(source, std::ios::app) << "WAVE";
+    CHECK(!DivisorCache(directory, source, 22050, 0x5000, 0x30, DIVISOR_CACHE_RESAMPLED).IsHit());
+    CHECK(!system((std::string("rm -rf ") + directory).c_str()));
+}
@@ -0,0 +1,316 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "test.hpp"
+#include "divisor.hpp"
+#include "sample.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#define DIVISOR_TEST_FRAMES 67
+#define DIVISOR_TEST_PCM_FRAMES 4096
+
+// Carrier settings around the usual ones and at the edges of the kernels.
+static const uint32_t clockDivisors[] = { 0x5000, 0x1c3f2, 0x80000 };
+static const uint32_t divisorRanges[] = { 0x30, 0x3e8, 0x7fff, 0x8000, 0x10000 };
+
+// Random frames with exact rounding ties, zeros and full scale mixed in.
+template <typename Sample>
+static std::vector<Sample> GetFrames(unsigned count, uint32_t divisorRange, Sample (*convert)(float))
+{
+    std::vector<Sample> frames(count);
+    for (Sample &frame : frames) {
+        switch (GetRandom() % 8) {
+        case 0:
+            frame = convert(((GetRandom() % 256) + 0.5f - 128.f) / divisorRange);
+            break;
+        case 1:
+            frame = convert(0.f);
+            break;
+        case 2:
+            frame = convert((GetRandom() & 0x01) ? 1.f : -1.f);
+            break;
+        default:
+            frame = convert(GetRandomFloat());
+        }
+    }
+    return frames;
+}
+
+static float ToFloat(float value)
+{
+    return value;
+}
+
+static Q15 ToQ15(float value)
+{
+    return SaturateQ15(static_cast<int32_t>(std::floor(value * 32768.f)));
+}
+
+static Q31 ToQ31(float value)
+{
+    return SaturateQ31(static_cast<int64_t>(std::floor(static_cast<double>(value) * 2147483648.0)));
+}
+
+static int64_t Floor(int64_t value, int64_t divisor)
+{
+    return (value >= 0) ? value / divisor : -((divisor - 1 - value) / divisor);
+}
+
+static uint32_t GetReference(const float *frame, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange)
+{
+    float sum = 0.f;
+    for (unsigned i = 0; i < channels; i++) {
+        sum += frame[i];
+    }
+    return GetDivisor(sum / channels, clockDivisor, divisorRange);
+}
+
+// The channel mean times the range, rounded half up.
+static uint32_t GetReference(const Q15 *frame, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange)
+{
+    int64_t sum = 0;
+    for (unsigned i = 0; i < channels; i++) {
+        sum += frame[i];
+    }
+    int64_t scale = static_cast<int64_t>(channels) << 15;
+    return CLK_PASSWORD | (0xffffff & (clockDivisor - Floor(2 * sum * divisorRange + scale, 2 * scale)));
+}
+
+static uint32_t GetReference(const Q31 *frame, unsigned channels, uint32_t clockDivisor, uint32_t divisorRange)
+{
+    int64_t sum = 0;
+    for (unsigned i = 0; i < channels; i++) {
+        sum += frame[i];
+    }
+    return CLK_PASSWORD | (0xffffff & (clockDivisor - Floor(Floor(sum, channels) * divisorRange + (1ll << 30), 1ll << 31)));
+}
+
+// Every length up to DIVISOR_TEST_FRAMES covers all vector tails, the input
+// and output are used at odd offsets so unaligned loads and stores are
+// exercised.
+template <typename Sample>
+static void CheckKernels(Sample (*convert)(float))
+{
+    std::cout << "  kernel: " << GetDivisorKernelName() << std::endl;
+    for (unsigned channels = 1; channels <= 2; channels++) {
+        for (uint32_t clockDivisor : clockDivisors) {
+            for (uint32_t divisorRange : divisorRanges) {
+                for (unsigned frames = 0; frames <= DIVISOR_TEST_FRAMES; frames++) {
+                    std::vector<Sample> samples = GetFrames<Sample>(frames * channels + 1, divisorRange, convert);
+                    std::vector<uint32_t> divisors(frames + 1, 0);
+                    ConvertToDivisors(&samples[1], frames, channels, clockDivisor, divisorRange, &divisors[1]);
+                    CHECK(!divisors[0]);
+                    for (unsigned i = 0; i < frames; i++) {
+                        CHECK(divisors[i + 1] == GetReference(&samples[1 + i * channels], channels, clockDivisor, divisorRange));
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(DivisorKernelsMatchGetDivisor)
+{
+    CheckKernels<float>(ToFloat);
+}
+
+TEST(Q15DivisorKernelsMatchReference)
+{
+    CheckKernels<Q15>(ToQ15);
+}
+
+TEST(Q31DivisorKernelsMatchReference)
+{
+    CheckKernels<Q31>(ToQ31);
+}
+
+// Every 16-bit mono code at the usual carrier settings.
+TEST(DivisorKernelsMatchEvery16BitCode)
+{
+    std::vector<uint8_t> data(2 * 0x10000);
+    for (unsigned i = 0; i < 0x10000; i++) {
+        data[2 * i] = static_cast<uint8_t>(i);
+        data[2 * i + 1] = static_cast<uint8_t>(i >> 8);
+    }
+    std::vector<float> samples(0x10000);
+    std::vector<uint32_t> divisors(0x10000);
+    GetSampleConverter<float>(WAVE_FORMAT_PCM, 16)(data.data(), 0x10000, samples.data());
+    ConvertToDivisors(samples.data(), 0x10000, 1, clockDivisors[1], divisorRanges[1], divisors.data());
+    for (unsigned i = 0; i < 0x10000; i++) {
+        CHECK(divisors[i] == GetReference(&samples[i], 1, clockDivisors[1], divisorRanges[1]));
+    }
+}
+
+// Random 8 or 16-bit PCM, raw and decoded to float, Q15 and Q31 samples.
+struct Pcm
+{
+    std::vector<uint8_t> data;
+    std::vector<float> floats;
+    std::vector<Q15> q15;
+    std::vector<Q31> q31;
+
+    template <typename Sample>
+    const std::vector<Sample> &GetSamples() const;
+};
+
+template <>
+const std::vector<float> &Pcm::GetSamples<float>() const
+{
+    return floats;
+}
+
+template <>
+const std::vector<Q15> &Pcm::GetSamples<Q15>() const
+{
+    return q15;
+}
+
+template <>
+const std::vector<Q31> &Pcm::GetSamples<Q31>() const
+{
+    return q31;
+}
+
+static Pcm GetPcm(unsigned bits, unsigned samples)
+{
+    Pcm pcm;
+    pcm.data.resize(samples * (bits >> 3));
+    for (uint8_t &byte : pcm.data) {
+        byte = static_cast<uint8_t>(GetRandom());
+    }
+    pcm.floats.resize(samples);
+    pcm.q15.resize(samples);
+    pcm.q31.resize(samples);
+    GetSampleConverter<float>(WAVE_FORMAT_PCM, bits)(pcm.data.data(), samples, pcm.floats.data());
+    GetSampleConverter<Q15>(WAVE_FORMAT_PCM, bits)(pcm.data.data(), samples, pcm.q15.data());
+    GetSampleConverter<Q31>(WAVE_FORMAT_PCM, bits)(pcm.data.data(), samples, pcm.q31.data());
+    return pcm;
+}
+
+// Decoded from the same PCM, the fixed-point paths stay within one divisor
+// step of the float one. Ranges past the clock divisor are left out, the
+// divisor field wraps there and one step can turn into a full-range jump.
+TEST(FixedPointDivisorsWithinOneStepOfFloat)
+{
+    for (unsigned bits = 8; bits <= 16; bits += 8) {
+        for (unsigned channels = 1; channels <= 2; channels++) {
+            for (uint32_t clockDivisor : clockDivisors) {
+                for (uint32_t divisorRange : divisorRanges) {
+                    if (divisorRange >= clockDivisor) {
+                        continue;
+                    }
+                    Pcm pcm = GetPcm(bits, DIVISOR_TEST_PCM_FRAMES * channels);
+                    std::vector<uint32_t> divisors(DIVISOR_TEST_PCM_FRAMES), q15(DIVISOR_TEST_PCM_FRAMES), q31(DIVISOR_TEST_PCM_FRAMES);
+                    ConvertToDivisors(pcm.floats.data(), DIVISOR_TEST_PCM_FRAMES, channels, clockDivisor, divisorRange, divisors.data());
+                    ConvertToDivisors(pcm.q15.data(), DIVISOR_TEST_PCM_FRAMES, channels, clockDivisor, divisorRange, q15.data());
+                    ConvertToDivisors(pcm.q31.data(), DIVISOR_TEST_PCM_FRAMES, channels, clockDivisor, divisorRange, q31.data());
+                    for (unsigned i = 0; i < DIVISOR_TEST_PCM_FRAMES; i++) {
+                        CHECK(std::abs(static_cast<int32_t>(q15[i] - divisors[i])) <= 1);
+                        CHECK(std::abs(static_cast<int32_t>(q31[i] - divisors[i])) <= 1);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Frames per second converted to divisor words from float, Q15 and Q31
+// frames, mono and stereo, with the usual carrier settings.
+BENCHMARK(DivisorConversionFrameRate)
+{
+    std::vector<uint32_t> divisors(DIVISOR_TEST_PCM_FRAMES);
+    std::cout << "  kernel: " << GetDivisorKernelName() << std::endl;
+    for (unsigned channels = 1; channels <= 2; channels++) {
+        Pcm pcm = GetPcm(16, DIVISOR_TEST_PCM_FRAMES * channels);
+        std::string name = (channels == 1) ? "mono" : "stereo";
+        Report(name + ", float", DIVISOR_TEST_PCM_FRAMES * Measure([&]() {
+            ConvertToDivisors(pcm.floats.data(), DIVISOR_TEST_PCM_FRAMES, channels, clockDivisors[1], divisorRanges[1], divisors.data());
+        }) / 1000000.0, "Mframes/s");
+        Report(name + ", Q15", DIVISOR_TEST_PCM_FRAMES * Measure([&]() {
+            ConvertToDivisors(pcm.q15.data(), DIVISOR_TEST_PCM_FRAMES, channels, clockDivisors[1], divisorRanges[1], divisors.data());
+        }) / 1000000.0, "Mframes/s");
+        Report(name + ", Q31", DIVISOR_TEST_PCM_FRAMES * Measure([&]() {
+            ConvertToDivisors(pcm.q31.data(), DIVISOR_TEST_PCM_FRAMES, channels, clockDivisors[1], divisorRanges[1], divisors.data());
+        }) / 1000000.0, "Mframes/s");
+    }
+}
+
+#ifdef FIXED_POINT
+typedef FixedSample BuildSample;
+#else
+typedef float BuildSample;
+#endif
+
+// Raw mono PCM looked up in a divisor table gives the same words as decoding
+// it with this build's sample type and converting.
+TEST(DivisorTableMatchesConversion)
+{
+    for (unsigned bits = 8; bits <= 16; bits += 8) {
+        for (uint32_t clockDivisor : clockDivisors) {
+            for (uint32_t divisorRange : divisorRanges) {
+                Pcm pcm = GetPcm(bits, DIVISOR_TEST_PCM_FRAMES);
+                std::vector<uint32_t> divisors(DIVISOR_TEST_PCM_FRAMES), lookups(DIVISOR_TEST_PCM_FRAMES);
+                ConvertToDivisors(pcm.GetSamples<BuildSample>().data(), DIVISOR_TEST_PCM_FRAMES, 1, clockDivisor, divisorRange, divisors.data());
+                DivisorTable(bits, clockDivisor, divisorRange).Convert(pcm.data.data(), DIVISOR_TEST_PCM_FRAMES, lookups.data());
+                CHECK(lookups == divisors);
+            }
+        }
+    }
+}
+
+// Frames per second refilled from raw mono PCM by decoding and converting,
+// and by table lookups, plus the time to build each table.
+BENCHMARK(DivisorTableFrameRate)
+{
+    std::vector<BuildSample> samples(DIVISOR_TEST_PCM_FRAMES);
+    std::vector<uint32_t> divisors(DIVISOR_TEST_PCM_FRAMES);
+    for (unsigned bits = 8; bits <= 16; bits += 8) {
+        Pcm pcm = GetPcm(bits, DIVISOR_TEST_PCM_FRAMES);
+        std::string name = std::to_string(bits) + "-bit";
+        SampleConverter<BuildSample> convert = GetSampleConverter<BuildSample>(WAVE_FORMAT_PCM, bits);
+        Report(name + ", conversion", DIVISOR_TEST_PCM_FRAMES * Measure([&]() {
+            convert(pcm.data.data(), DIVISOR_TEST_PCM_FRAMES, samples.data());
+            ConvertToDivisors(samples.data(), DIVISOR_TEST_PCM_FRAMES, 1, clockDivisors[1], divisorRanges[1], divisors.data());
+        }) / 1000000.0, "Mframes/s");
+
+        auto start = std::chrono::steady_clock::now();
+        DivisorTable table(bits, clockDivisors[1], divisorRanges[1]);
+        Report(name + ", table build", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), "ms");
+        Report(name + ", table", DIVISOR_TEST_PCM_FRAMES * Measure([&]() {
+            table.Convert(pcm.data.data(), DIVISOR_TEST_PCM_FRAMES, divisors.data());
+        }) / 1000000.0, "Mframes/s");
+    }
+}
@@ -0,0 +1,70 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "audio_source.hpp"
+#include <algorithm>
+#include <vector>
+
+// In-memory source of interleaved float frames for the pipeline stages under
+// test. A looping source starts over at the end and never ends, for
+// benchmarks.
+class MemorySource : public AudioSource
+{
+    public:
+        MemorySource(const std::vector<float> &samples, unsigned channels, unsigned sampleRate, bool loop = false)
+            : samples(samples), channels(channels), sampleRate(sampleRate), offset(0), loop(loop) { }
+        std::string GetName() const { return "memory"; }
+        unsigned GetSampleRate() const { return sampleRate; }
+        unsigned GetChannels() const { return channels; }
+        unsigned Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx)
+        {
+            unsigned read = 0;
+            do {
+                if (loop && (offset == this->samples.size())) {
+                    offset = 0;
+                }
+                unsigned quantity = std::min(frames - read, static_cast<unsigned>((this->samples.size() - offset) / channels));
+                std::copy(this->samples.data() + offset, this->samples.data() + offset + quantity * channels, &samples[read * channels]);
+                offset += quantity * channels;
+                read += quantity;
+            } while (loop && (read < frames));
+            return read;
+        }
+    private:
+        std::vector<float> samples;
+        unsigned channels, sampleRate;
+        std::size_t offset;
+        bool loop;
+};
@@ -0,0 +1,108 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "memory_source.hpp"
+#include "mpx_encoder.hpp"
+#include <cmath>
+#include <complex>
+
+#define MPX_TEST_TONE 1000
+
+// Component of signal at frequency Hz, signal has to hold a whole number of
+// seconds so every other whole-Hz component cancels out.
+static std::complex<double> GetComponent(const std::vector<double> &signal, double frequency)
+{
+    std::complex<double> sum;
+    for (std::size_t i = 0; i < signal.size(); i++) {
+        sum += signal[i] * std::polar(1.0, -2.0 * M_PI * frequency * i / MPX_SAMPLE_RATE);
+    }
+    return sum * (2.0 / signal.size());
+}
+
+// A tone on the left channel only is decoded the way a receiver would: the
+// mono sum straight from the composite, the difference coherently from the
+// 38 kHz subcarrier regenerated from the same phase, and the right channel
+// has to stay at least 40 dB below the left one.
+TEST(MpxStereoSeparation)
+{
+    std::vector<float> frames(2 * MPX_SAMPLE_RATE, 0.f);
+    for (unsigned i = 0; i < MPX_SAMPLE_RATE; i++) {
+        frames[2 * i] = 0.5f * static_cast<float>(std::sin(2.0 * M_PI * MPX_TEST_TONE * i / MPX_SAMPLE_RATE));
+    }
+    MemorySource source(frames, 2, MPX_SAMPLE_RATE);
+    MpxEncoder encoder(MPX_SAMPLE_RATE, true);
+    encoder.SetSource(source);
+    std::vector<float> composite(MPX_SAMPLE_RATE);
+    bool enable = true;
+    std::mutex mtx;
+    CHECK(encoder.Read(composite.data(), MPX_SAMPLE_RATE, enable, mtx) == MPX_SAMPLE_RATE);
+
+    uint32_t increment = static_cast<uint32_t>(std::llround(static_cast<double>(MPX_PILOT_FREQUENCY) * 4294967296.0 / MPX_SAMPLE_RATE));
+    std::vector<double> sum(MPX_SAMPLE_RATE), difference(MPX_SAMPLE_RATE);
+    for (unsigned i = 0; i < MPX_SAMPLE_RATE; i++) {
+        uint32_t phase = (i * increment) << 1;
+        sum[i] = composite[i];
+        difference[i] = 2.0 * composite[i] * std::sin(2.0 * M_PI * phase / 4294967296.0);
+    }
+    std::complex<double> mid = GetComponent(sum, MPX_TEST_TONE), side = GetComponent(difference, MPX_TEST_TONE);
+    double left = std::abs(mid + side), right = std::abs(mid - side);
+    CHECK(std::fabs(left - 0.5 * MPX_AUDIO_LEVEL) < 0.01);
+    CHECK(20.0 * std::log10(left / right) > 40.0);
+}
+
+// Composite frames per second from mono and stereo sources, with and
+// without the stereo subcarrier.
+BENCHMARK(MpxThroughput)
+{
+    std::vector<float> noise(2 * MPX_SAMPLE_RATE / 10);
+    for (float &sample : noise) {
+        sample = 0.5f * GetRandomFloat();
+    }
+    std::vector<float> composite(MPX_BLOCK_SIZE);
+    bool enable = true;
+    std::mutex mtx;
+
+    for (unsigned channels = 1; channels <= 2; channels++) {
+        for (bool stereo : { false, true }) {
+            MemorySource source(noise, channels, MPX_SAMPLE_RATE, true);
+            MpxEncoder encoder(MPX_SAMPLE_RATE, stereo);
+            encoder.SetSource(source);
+            double rate = MPX_BLOCK_SIZE * Measure([&]() {
+                encoder.Read(composite.data(), MPX_BLOCK_SIZE, enable, mtx);
+            });
+            std::string name = std::string((channels == 1) ? "mono" : "stereo") + " source, " + (stereo ? "stereo" : "mono") + " multiplex";
+            Report(name, rate / MPX_SAMPLE_RATE, "x real time");
+        }
+    }
+}
@@ -0,0 +1,190 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "memory_source.hpp"
+#include "mpx_encoder.hpp"
+#include "rds_encoder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#define RDS_TEST_PI 0xbeef
+#define RDS_TEST_SECONDS 2
+#define RDS_TEST_BIT_RATE 1187.5
+#define RDS_TEST_POLYNOMIAL 0x5b9
+
+struct RdsGroup
+{
+    uint16_t blocks[4];
+};
+
+static uint16_t GetSyndrome(uint32_t block)
+{
+    uint32_t remainder = (block >> 10) << 10;
+    for (int i = 25; i >= 10; i--) {
+        if (remainder & (0x01u << i)) {
+            remainder ^= RDS_TEST_POLYNOMIAL << (i - 10);
+        }
+    }
+    return (remainder & 0x3ff) ^ (block & 0x3ff);
+}
+
+// Receiver side of the subcarrier: coherent demodulation at three times the
+// pilot phase, biphase symbols integrated over both halves of every bit at
+// the offset which gives the strongest decisions, differential decoding and
+// groups found by the offset words of their four blocks.
+static std::vector<RdsGroup> DecodeRds(const std::vector<float> &composite, uint32_t increment)
+{
+    std::vector<double> integral(composite.size() + 1, 0.0);
+    for (std::size_t i = 0; i < composite.size(); i++) {
+        uint32_t phase = 3 * static_cast<uint32_t>(i) * increment;
+        integral[i + 1] = integral[i] + composite[i] * std::sin(2.0 * M_PI * phase / 4294967296.0);
+    }
+    const double period = MPX_SAMPLE_RATE / RDS_TEST_BIT_RATE;
+    auto getSum = [&](double start, double end) -> double {
+        return integral[std::lround(end)] - integral[std::lround(start)];
+    };
+    auto getDecisions = [&](double offset) -> std::vector<double> {
+        std::vector<double> decisions;
+        for (double time = offset; time + period + 1.0 < composite.size(); time += period) {
+            decisions.push_back(getSum(time, time + period / 2.0) - getSum(time + period / 2.0, time + period));
+        }
+        return decisions;
+    };
+    double best = 0.0, strength = 0.0;
+    for (double offset = 0.0; offset < period; offset += 2.0) {
+        double sum = 0.0;
+        for (double decision : getDecisions(offset)) {
+            sum += std::fabs(decision);
+        }
+        if (sum > strength) {
+            strength = sum;
+            best = offset;
+        }
+    }
+    std::vector<double> decisions = getDecisions(best);
+    std::vector<bool> bits;
+    for (std::size_t i = 1; i < decisions.size(); i++) {
+        bits.push_back((decisions[i] > 0.0) != (decisions[i - 1] > 0.0));
+    }
+
+    static const uint16_t offsetWords[4] = { 0x0fc, 0x198, 0x168, 0x1b4 };
+    std::vector<RdsGroup> groups;
+    for (std::size_t i = 0; i + 104 <= bits.size();) {
+        RdsGroup group;
+        bool valid = true;
+        for (unsigned k = 0; (k < 4) && valid; k++) {
+            uint32_t block = 0;
+            for (unsigned j = 0; j < 26; j++) {
+                block = (block << 1) | (bits[i + 26 * k + j] ? 0x01 : 0x00);
+            }
+            valid = GetSyndrome(block) == offsetWords[k];
+            group.blocks[k] = block >> 10;
+        }
+        if (valid) {
+            groups.push_back(group);
+            i += 104;
+        } else {
+            i++;
+        }
+    }
+    return groups;
+}
+
+// The subcarrier rendered under a stereo program decodes back to the program
+// service name and radio text that were set, with every group received.
+TEST(RdsDecodesFromComposite)
+{
+    std::vector<float> frames(2 * RDS_TEST_SECONDS * MPX_SAMPLE_RATE);
+    for (std::size_t i = 0; i < frames.size(); i += 2) {
+        frames[i] = 0.5f * static_cast<float>(std::sin(2.0 * M_PI * 1000.0 * i / 2 / MPX_SAMPLE_RATE));
+    }
+    MemorySource source(frames, 2, MPX_SAMPLE_RATE);
+    RdsEncoder rds(RDS_TEST_PI);
+    rds.SetProgramService("FMTX");
+    rds.SetRadioText("Hello RDS");
+    MpxEncoder encoder(MPX_SAMPLE_RATE, true, &rds);
+    encoder.SetSource(source);
+    std::vector<float> composite(RDS_TEST_SECONDS * MPX_SAMPLE_RATE);
+    bool enable = true;
+    std::mutex mtx;
+    CHECK(encoder.Read(composite.data(), composite.size(), enable, mtx) == composite.size());
+
+    uint32_t increment = static_cast<uint32_t>(std::llround(static_cast<double>(MPX_PILOT_FREQUENCY) * 4294967296.0 / MPX_SAMPLE_RATE));
+    std::vector<RdsGroup> groups = DecodeRds(composite, increment);
+    CHECK(groups.size() + 2 >= static_cast<unsigned>(RDS_TEST_SECONDS * RDS_TEST_BIT_RATE / 104));
+
+    std::string programService(RDS_PS_LENGTH, '?');
+    std::map<unsigned, char> radioText;
+    for (const RdsGroup &group : groups) {
+        CHECK(group.blocks[0] == RDS_TEST_PI);
+        unsigned segment = group.blocks[1] & 0x0f;
+        switch (group.blocks[1] >> 12) {
+            case 0x0:
+                programService[2 * (segment & 0x03)] = static_cast<char>(group.blocks[3] >> 8);
+                programService[2 * (segment & 0x03) + 1] = static_cast<char>(group.blocks[3] & 0xff);
+                break;
+            case 0x2:
+                radioText[4 * segment] = static_cast<char>(group.blocks[2] >> 8);
+                radioText[4 * segment + 1] = static_cast<char>(group.blocks[2] & 0xff);
+                radioText[4 * segment + 2] = static_cast<char>(group.blocks[3] >> 8);
+                radioText[4 * segment + 3] = static_cast<char>(group.blocks[3] & 0xff);
+                break;
+        }
+    }
+    std::string text;
+    for (const std::pair<const unsigned, char> &character : radioText) {
+        text += character.second;
+    }
+    CHECK(programService == "FMTX    ");
+    CHECK(text.substr(0, text.find('\r')) == "Hello RDS");
+}
+
+// CPU cost of the subcarrier: the share of one core spent rendering it into
+// a composite at MPX_SAMPLE_RATE.
+BENCHMARK(RdsRenderCost)
+{
+    RdsEncoder rds;
+    rds.SetProgramService("FMTX");
+    rds.SetRadioText("Hello RDS");
+    rds.SetSampleRate(MPX_SAMPLE_RATE);
+    uint32_t phase = 0, increment = static_cast<uint32_t>(std::llround(static_cast<double>(MPX_PILOT_FREQUENCY) * 4294967296.0 / MPX_SAMPLE_RATE));
+    std::vector<float> composite(MPX_BLOCK_SIZE, 0.f);
+    double rate = MPX_BLOCK_SIZE * Measure([&]() {
+        rds.Render(composite.data(), MPX_BLOCK_SIZE, phase, increment, RDS_LEVEL);
+        phase += MPX_BLOCK_SIZE * increment;
+    });
+    Report("render", rate / MPX_SAMPLE_RATE, "x real time");
+    Report("CPU", 100.0 * MPX_SAMPLE_RATE / rate, "%");
+}
@@ -0,0 +1,106 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "memory_source.hpp"
+#include "resampler.hpp"
+#include <cmath>
+
+// Source and output rates: upsampling with the shortest kernel, and
+// decimation with a 192 tap one and so the longest zero tail. Both have few
+// phases so building a resampler per length stays cheap.
+static const unsigned resamplerRates[][2] = {
+    { 22050, 44100 },
+    { 48000, 8000 }
+};
+
+// Streams ending at every remainder of the block size are drained completely:
+// the output covers the whole input plus the filter tail, and a constant
+// input comes out unchanged away from both ends. Build with SANITIZE=1 to
+// have the history buffers bounds-checked as well.
+TEST(ResamplerDrainsEveryBlockRemainder)
+{
+    for (const unsigned *rates : resamplerRates) {
+        for (unsigned remainder = 0; remainder < RESAMPLER_BLOCK_SIZE; remainder++) {
+            unsigned frames = RESAMPLER_BLOCK_SIZE + remainder;
+            MemorySource source(std::vector<float>(2 * frames, 0.5f), 2, rates[0]);
+            Resampler resampler(source, rates[1]);
+            bool enable = true;
+            std::mutex mtx;
+
+            double expected = static_cast<double>(frames) * rates[1] / rates[0];
+            std::vector<float> output(2 * (static_cast<unsigned>(expected) + RESAMPLER_MAX_TAPS));
+            unsigned produced = 0, read;
+            while ((read = resampler.Read(&output[2 * produced], std::min(static_cast<unsigned>(output.size() / 2) - produced, 333u), enable, mtx))) {
+                produced += read;
+            }
+            CHECK(std::fabs(produced - expected) <= 1.0);
+            CHECK(!resampler.Read(output.data(), 1, enable, mtx));
+            for (unsigned i = produced / 4; i < produced * 3 / 4; i++) {
+                CHECK(std::fabs(output[2 * i] - 0.5f) < 0.001f);
+                CHECK(output[2 * i] == output[2 * i + 1]);
+            }
+        }
+    }
+}
+
+// Output frames per second for common conversions to and from the transmit
+// rates, mono and stereo, fed with noise so no input is special-cased.
+BENCHMARK(ResamplerThroughput)
+{
+    static const unsigned rates[][2] = {
+        { 44100, 22050 },
+        { 48000, 22050 },
+        { 22050, 44100 },
+        { 44100, 48000 }
+    };
+    std::vector<float> noise(2 * 44100);
+    for (float &sample : noise) {
+        sample = 0.5f * GetRandomFloat();
+    }
+    std::vector<float> output(2 * RESAMPLER_BLOCK_SIZE);
+    bool enable = true;
+    std::mutex mtx;
+
+    for (const unsigned *conversion : rates) {
+        for (unsigned channels = 1; channels <= 2; channels++) {
+            MemorySource source(noise, channels, conversion[0], true);
+            Resampler resampler(source, conversion[1]);
+            double rate = RESAMPLER_BLOCK_SIZE * Measure([&]() {
+                resampler.Read(output.data(), RESAMPLER_BLOCK_SIZE, enable, mtx);
+            });
+            std::string name = std::to_string(conversion[0]) + " to " + std::to_string(conversion[1]) + " Hz " + ((channels == 1) ? "mono" : "stereo");
+            Report(name, rate / 1000000.0, "Mframes/s");
+        }
+    }
+}
@@ -0,0 +1,156 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "test.hpp"
+#include "sample.hpp"
+#include <climits>
+#include <cmath>
+#include <vector>
+
+#define SAMPLE_BENCH_FRAMES 4096
+
+// The per-frame sample object the batch conversion replaced, kept here as the
+// baseline: one heap allocation per frame, collected into a vector.
+class FrameSample
+{
+    public:
+        FrameSample(const uint8_t *data, unsigned channels, unsigned bitsPerChannel)
+            : value(0.f)
+        {
+            int sum = 0;
+            int16_t *channelValues = new int16_t[channels];
+            for (unsigned i = 0; i < channels; i++) {
+                switch (bitsPerChannel >> 3) {
+                case 2:
+                    channelValues[i] = (data[((i + 1) << 1) - 1] << 8) | data[((i + 1) << 1) - 2];
+                    break;
+                case 1:
+                    channelValues[i] = (static_cast<int16_t>(data[i]) - 0x80) * 0x100;
+                    break;
+                }
+                sum += channelValues[i];
+            }
+            value = 2 * sum / (static_cast<float>(USHRT_MAX) * channels);
+            delete[] channelValues;
+        }
+        float GetMonoValue() const { return value; }
+    private:
+        float value;
+};
+
+static std::vector<FrameSample> GetFrameSamples(const uint8_t *data, unsigned frames, unsigned channels, unsigned bits)
+{
+    unsigned bytesPerFrame = (bits >> 3) * channels;
+    std::vector<FrameSample> samples;
+    samples.reserve(frames);
+    for (unsigned i = 0; i < frames; i++) {
+        samples.push_back(FrameSample(&data[bytesPerFrame * i], channels, bits));
+    }
+    return samples;
+}
+
+// Averages interleaved channels, the downmix the frame objects include and
+// the batch conversion leaves to the divisor kernels. Sum has to hold the sum
+// of all channels of a frame.
+template <typename Sum, typename Sample>
+static void Downmix(const Sample *samples, unsigned frames, unsigned channels, Sample *mono)
+{
+    for (unsigned i = 0; i < frames; i++) {
+        Sum sum = 0;
+        for (unsigned j = 0; j < channels; j++) {
+            sum += samples[i * channels + j];
+        }
+        mono[i] = static_cast<Sample>(sum / static_cast<Sum>(channels));
+    }
+}
+
+// Mono frames per second of the batch conversion to Sample, stereo blocks
+// are downmixed too.
+template <typename Sample, typename Sum>
+static double MeasureBatch(const uint8_t *data, unsigned channels, unsigned bits)
+{
+    SampleConverter<Sample> convert = GetSampleConverter<Sample>(WAVE_FORMAT_PCM, bits);
+    std::vector<Sample> samples(SAMPLE_BENCH_FRAMES * channels), mono(SAMPLE_BENCH_FRAMES);
+    volatile Sum sink;
+    return SAMPLE_BENCH_FRAMES * Measure([&]() {
+        convert(data, SAMPLE_BENCH_FRAMES * channels, samples.data());
+        if (channels > 1) {
+            Downmix<Sum>(samples.data(), SAMPLE_BENCH_FRAMES, channels, mono.data());
+        }
+        sink = samples[0] + mono[0];
+    });
+}
+
+// The batch conversion gives the values of the per-frame objects, exactly
+// for mono and up to rounding once channels are averaged.
+TEST(BatchConversionMatchesFrameSample)
+{
+    std::vector<uint8_t> data(SAMPLE_BENCH_FRAMES * 4);
+    for (uint8_t &byte : data) {
+        byte = static_cast<uint8_t>(GetRandom());
+    }
+    std::vector<float> samples(SAMPLE_BENCH_FRAMES * 2), mono(SAMPLE_BENCH_FRAMES);
+    for (unsigned bits = 8; bits <= 16; bits += 8) {
+        for (unsigned channels = 1; channels <= 2; channels++) {
+            std::vector<FrameSample> frames = GetFrameSamples(data.data(), SAMPLE_BENCH_FRAMES, channels, bits);
+            GetSampleConverter<float>(WAVE_FORMAT_PCM, bits)(data.data(), SAMPLE_BENCH_FRAMES * channels, samples.data());
+            Downmix<float>(samples.data(), SAMPLE_BENCH_FRAMES, channels, mono.data());
+            for (unsigned i = 0; i < SAMPLE_BENCH_FRAMES; i++) {
+                CHECK((channels == 1) ? (mono[i] == frames[i].GetMonoValue()) : (std::fabs(mono[i] - frames[i].GetMonoValue()) <= 1e-6f));
+            }
+        }
+    }
+}
+
+// Mono frames per second decoded from 8 and 16-bit PCM blocks, mono and
+// stereo, by per-frame objects and by the batch conversion to float, Q15 and
+// Q31. Stereo batch rows include the downmix, so both sides do the same work.
+BENCHMARK(SampleConversionFrameRate)
+{
+    std::vector<uint8_t> data(SAMPLE_BENCH_FRAMES * 4);
+    for (uint8_t &byte : data) {
+        byte = static_cast<uint8_t>(GetRandom());
+    }
+    volatile float sink;
+
+    for (unsigned bits = 8; bits <= 16; bits += 8) {
+        for (unsigned channels = 1; channels <= 2; channels++) {
+            std::string name = std::to_string(bits) + "-bit " + ((channels == 1) ? "mono" : "stereo");
+            Report(name + ", frame objects", SAMPLE_BENCH_FRAMES * Measure([&]() {
+                sink = GetFrameSamples(data.data(), SAMPLE_BENCH_FRAMES, channels, bits).back().GetMonoValue();
+            }) / 1000000.0, "Mframes/s");
+            Report(name + ", batch float", MeasureBatch<float, float>(data.data(), channels, bits) / 1000000.0, "Mframes/s");
+            Report(name + ", batch Q15", MeasureBatch<Q15, int32_t>(data.data(), channels, bits) / 1000000.0, "Mframes/s");
+            Report(name + ", batch Q31", MeasureBatch<Q31, int64_t>(data.data(), channels, bits) / 1000000.0, "Mframes/s");
+        }
+    }
+}
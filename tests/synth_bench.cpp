@@ -0,0 +1,264 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "oscillator.hpp"
+#include "simulator.hpp"
+#include "synth.hpp"
+#include "transmitter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#define SYNTH_BENCH_PORT "none"
+#define SYNTH_BENCH_RATE 22050
+#define SYNTH_BENCH_BLOCK 256
+#define SYNTH_BENCH_FREQUENCY 440.f
+#define SYNTH_BENCH_NOTES 4
+#define SYNTH_BENCH_PREFETCH_TIME 10000
+
+// Voices a single core can render in real time, by the double precision sin()
+// per sample the wavetable oscillators replaced and by the oscillators
+// themselves. The sine table has to follow sin() closely for the comparison
+// to be a fair one.
+BENCHMARK(OscillatorVoices)
+{
+    std::vector<float> samples(SYNTH_BENCH_BLOCK, 0.f);
+    volatile float sink;
+
+    uint64_t position = 0;
+    double sinRate = SYNTH_BENCH_BLOCK * Measure([&]() {
+        for (unsigned i = 0; i < SYNTH_BENCH_BLOCK; i++) {
+            double t = static_cast<double>(position++) / SYNTH_BENCH_RATE;
+            samples[i] += static_cast<float>(0.5 * sin(SYNTH_BENCH_FREQUENCY * t * 2 * M_PI));
+        }
+        sink = samples[0];
+    });
+    Report("sin()", sinRate / SYNTH_BENCH_RATE, "voices");
+
+    for (Waveform waveform : { Waveform::Sine, Waveform::Saw }) {
+        Oscillator oscillator;
+        oscillator.SetWaveform(waveform);
+        oscillator.SetFrequency(SYNTH_BENCH_FREQUENCY, SYNTH_BENCH_RATE);
+        double rate = SYNTH_BENCH_BLOCK * Measure([&]() {
+            oscillator.Render(samples.data(), SYNTH_BENCH_BLOCK, 0.5f);
+            sink = samples[0];
+        });
+        Report((waveform == Waveform::Sine) ? "wavetable sine" : "wavetable saw", rate / SYNTH_BENCH_RATE, "voices");
+    }
+
+    Oscillator oscillator;
+    oscillator.SetFrequency(SYNTH_BENCH_FREQUENCY, SYNTH_BENCH_RATE);
+    for (unsigned i = 0; i < SYNTH_BENCH_RATE; i++) {
+        double t = static_cast<double>(i) / SYNTH_BENCH_RATE;
+        CHECK(std::fabs(oscillator.GetNextSample() - sin(SYNTH_BENCH_FREQUENCY * t * 2 * M_PI)) < 1e-4);
+    }
+}
+
+// Real-time factor of Synth::Read for a growing number of sustained voices,
+// which is the cost of the envelope and the vectorized voice mixing. Reading
+// must not allocate once the voices play.
+BENCHMARK(SynthMixer)
+{
+    std::vector<float> samples(SYNTH_BLOCK_SIZE);
+    bool enable = true;
+    std::mutex mtx;
+
+    for (unsigned voices : { 1, 4, 16, SYNTH_MAX_VOICES }) {
+        Synth synth(SYNTH_BENCH_PORT, voices);
+        for (unsigned i = 0; i < voices; i++) {
+            synth.NoteOn(36 + i, 100);
+        }
+        synth.Read(samples.data(), SYNTH_BLOCK_SIZE, enable, mtx);
+
+        double rate = SYNTH_BLOCK_SIZE * Measure([&]() {
+            synth.Read(samples.data(), SYNTH_BLOCK_SIZE, enable, mtx);
+        });
+        // Counted after the measurement, the MIDI thread has given up on the
+        // port and stopped allocating by then.
+        unsigned long long allocations = GetAllocations();
+        for (unsigned i = 0; i < 64; i++) {
+            synth.Read(samples.data(), SYNTH_BLOCK_SIZE, enable, mtx);
+        }
+        CHECK(GetAllocations() == allocations);
+        Report(std::to_string(voices) + " voices", rate / SYNTH_SAMPLE_RATE, "x real time");
+    }
+}
+
+// Time from NoteOn() to the playback of the first sample it sounds on, with a
+// renderer which reads each block just before it is played, like an output
+// with no buffering ahead of it. Notes are released and left to fade out
+// before the next one starts.
+BENCHMARK(SynthNoteLatency)
+{
+    std::vector<float> samples(SYNTH_BLOCK_SIZE);
+    bool enable = true;
+    std::mutex mtx;
+    Synth synth(SYNTH_BENCH_PORT);
+
+    std::vector<uint64_t> noteTimes;
+    std::atomic<bool> playing(true);
+    std::thread notes([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        for (unsigned i = 0; i < SYNTH_BENCH_NOTES; i++) {
+            noteTimes.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+            synth.NoteOn(69, 127);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            synth.NoteOff(69);
+            std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        }
+        playing = false;
+    });
+
+    std::vector<uint64_t> onsets;
+    auto start = std::chrono::steady_clock::now();
+    bool sounding = false;
+    for (uint64_t played = 0; playing; played += SYNTH_BLOCK_SIZE) {
+        auto deadline = start + std::chrono::microseconds(played * 1000000 / SYNTH_SAMPLE_RATE);
+        std::this_thread::sleep_until(deadline);
+        synth.Read(samples.data(), SYNTH_BLOCK_SIZE, enable, mtx);
+        for (unsigned i = 0; i < SYNTH_BLOCK_SIZE; i++) {
+            if (!sounding && (samples[i] != 0.f)) {
+                auto onset = deadline + std::chrono::microseconds(i * 1000000ull / SYNTH_SAMPLE_RATE);
+                onsets.push_back(std::chrono::duration_cast<std::chrono::microseconds>(onset.time_since_epoch()).count());
+            }
+            sounding = samples[i] != 0.f;
+        }
+    }
+    notes.join();
+
+    CHECK(onsets.size() == noteTimes.size());
+    double total = 0.0, max = 0.0;
+    for (std::size_t i = 0; i < std::min(onsets.size(), noteTimes.size()); i++) {
+        double latency = (static_cast<double>(onsets[i]) - noteTimes[i]) / 1000.0;
+        total += latency;
+        max = std::max(max, latency);
+    }
+    Report("mean", total / noteTimes.size(), "ms");
+    Report("max", max, "ms");
+}
+
+// Time from NoteOn() to the first divisor the simulated DMA sends which
+// differs from the silence before it, set up like fm_transmitter -S: live
+// buffer profile, minimal prefetch and the synth latency matching both.
+BENCHMARK(SynthRfLatency)
+{
+    SimulatedBackend backend(500.f, 4 * SYNTH_BENCH_NOTES * SYNTH_SAMPLE_RATE);
+    Transmitter transmitter(backend);
+    transmitter.SetBufferProfile(BufferProfile::Live);
+    transmitter.SetPrefetchTime(SYNTH_BENCH_PREFETCH_TIME);
+    Synth synth(SYNTH_BENCH_PORT);
+    synth.SetLatency(transmitter.GetLatency());
+
+    std::vector<uint64_t> noteTimes;
+    std::thread notes([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        for (unsigned i = 0; i < SYNTH_BENCH_NOTES; i++) {
+            noteTimes.push_back(backend.GetTime());
+            synth.NoteOn(69, 127);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            synth.NoteOff(69);
+            std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        transmitter.Stop();
+    });
+    transmitter.Transmit(synth, 100.f, 200.f, 0, false);
+    notes.join();
+
+    std::vector<DivisorWrite> writes = backend.GetDivisorWrites();
+    double total = 0.0, max = 0.0;
+    std::size_t write = 1;
+    for (uint64_t noteTime : noteTimes) {
+        while ((write < writes.size()) && (writes[write].time <= noteTime)) {
+            write++;
+        }
+        uint32_t silence = writes[write - 1].divisor;
+        while ((write < writes.size()) && (writes[write].divisor == silence)) {
+            write++;
+        }
+        CHECK(write < writes.size());
+        if (write == writes.size()) {
+            return;
+        }
+        double latency = (writes[write].time - noteTime) / 1000000.0;
+        total += latency;
+        max = std::max(max, latency);
+    }
+    Report("set latency", transmitter.GetLatency() / 1000.0, "ms");
+    Report("mean", total / noteTimes.size(), "ms");
+    Report("max", max, "ms");
+}
+
+// Note events per second the queue sustains without dropping any, while the
+// renderer reads blocks at the pace of playback. Rates double until events
+// are dropped.
+BENCHMARK(SynthEventRate)
+{
+    std::vector<float> samples(SYNTH_BLOCK_SIZE);
+    bool enable = true;
+    std::mutex mtx;
+    unsigned sustained = 0;
+
+    for (unsigned rate = 1000; rate <= 64000; rate <<= 1) {
+        Synth synth(SYNTH_BENCH_PORT);
+        std::atomic<bool> producing(true);
+        std::thread reader([&]() {
+            auto deadline = std::chrono::steady_clock::now();
+            while (producing) {
+                synth.Read(samples.data(), SYNTH_BLOCK_SIZE, enable, mtx);
+                deadline += std::chrono::microseconds(1000000ull * SYNTH_BLOCK_SIZE / SYNTH_SAMPLE_RATE);
+                std::this_thread::sleep_until(deadline);
+            }
+        });
+        auto start = std::chrono::steady_clock::now();
+        unsigned events = static_cast<unsigned>(rate * BENCHMARK_TIME);
+        for (unsigned i = 0; i < events; i += 2) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(1000000ull * i / rate));
+            synth.NoteOn(36 + (i >> 1) % 48, 100);
+            synth.NoteOff(36 + (i >> 1) % 48);
+        }
+        producing = false;
+        reader.join();
+
+        Report(std::to_string(rate) + " events/s, dropped", synth.GetDroppedEvents(), "events");
+        if (synth.GetDroppedEvents()) {
+            break;
+        }
+        sustained = rate;
+    }
+    Report("sustained", sustained, "events/s");
+}
@@ -0,0 +1,118 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "synth.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#define SYNTH_TEST_PORT "none"
+
+static unsigned GetSignChanges(const std::vector<float> &samples)
+{
+    unsigned changes = 0;
+    for (std::size_t i = 1; i < samples.size(); i++) {
+        changes += ((samples[i - 1] < 0.f) != (samples[i] < 0.f)) ? 1 : 0;
+    }
+    return changes;
+}
+
+// MIDI note 0 (8.18 Hz) sounds at its own pitch, on a fresh voice and on one
+// which played another note before going idle.
+TEST(SynthPlaysNoteZero)
+{
+    Synth synth(SYNTH_TEST_PORT, 1);
+    std::vector<float> samples(SYNTH_SAMPLE_RATE / 2);
+    bool enable = true;
+    std::mutex mtx;
+
+    for (unsigned pass = 0; pass < 2; pass++) {
+        synth.NoteOn(0, 127);
+        synth.Read(samples.data(), samples.size(), enable, mtx);
+        float peak = 0.f;
+        for (float sample : samples) {
+            peak = std::max(peak, std::fabs(sample));
+        }
+        CHECK((peak > 0.1f) && (GetSignChanges(samples) <= 10));
+
+        synth.NoteOff(0);
+        synth.NoteOn(69, 127);
+        synth.NoteOff(69);
+        for (unsigned i = 0; i < 4; i++) {
+            synth.Read(samples.data(), samples.size(), enable, mtx);
+        }
+    }
+}
+
+// A note sounds on the output sample which was playing when NoteOn() was
+// called plus the latency, no matter how far ahead of playback the samples
+// are read.
+TEST(SynthPlacesEventsOnSampleClock)
+{
+    Synth synth(SYNTH_TEST_PORT, 1);
+    synth.SetLatency(1000000);
+    std::vector<float> samples(SYNTH_SAMPLE_RATE / 2);
+    bool enable = true;
+    std::mutex mtx;
+
+    auto start = std::chrono::steady_clock::now();
+    synth.Read(samples.data(), samples.size(), enable, mtx);
+    auto started = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto before = std::chrono::steady_clock::now();
+    synth.NoteOn(69, 127);
+    auto after = std::chrono::steady_clock::now();
+
+    unsigned onset = samples.size();
+    samples.resize(SYNTH_BLOCK_SIZE);
+    bool sounding = false;
+    while (!sounding && (onset < 2 * SYNTH_SAMPLE_RATE)) {
+        synth.Read(samples.data(), SYNTH_BLOCK_SIZE, enable, mtx);
+        for (float sample : samples) {
+            if (sample != 0.f) {
+                sounding = true;
+                break;
+            }
+            onset++;
+        }
+    }
+    auto getSample = [&](std::chrono::steady_clock::duration elapsed) {
+        uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        return static_cast<unsigned>(time * SYNTH_SAMPLE_RATE / 1000000 + SYNTH_SAMPLE_RATE);
+    };
+    CHECK(sounding);
+    CHECK((onset + 1 >= getSample(before - started)) && (onset <= getSample(after - start) + 4));
+}
@@ -0,0 +1,67 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "telemetry.hpp"
+#include <algorithm>
+
+TEST(TelemetryBucketsCoverEveryValue)
+{
+    Telemetry telemetry;
+    TelemetryHistogram &histogram = telemetry.GetData().refillLatency;
+    for (unsigned bucket = 0; bucket < TELEMETRY_HISTOGRAM_SIZE - 1; bucket++) {
+        uint32_t low = Telemetry::GetBucketValue(bucket), high = Telemetry::GetBucketValue(bucket + 1);
+        CHECK((low < high) && (high - low <= std::max(low / 4, 1u)));
+        for (uint32_t value : { low, high - 1 }) {
+            Telemetry::Record(histogram, value);
+            CHECK(histogram.counts[bucket].exchange(0) == 1);
+        }
+    }
+    Telemetry::Record(histogram, UINT32_MAX);
+    CHECK(histogram.counts[TELEMETRY_HISTOGRAM_SIZE - 1].load() == 1);
+}
+
+TEST(TelemetryPercentilesFollowRecordedValues)
+{
+    Telemetry telemetry;
+    TelemetryHistogram &histogram = telemetry.GetData().timingError;
+    CHECK(!Telemetry::GetPercentile(histogram, 50));
+    for (uint32_t value = 1; value <= 1000; value++) {
+        Telemetry::Record(histogram, value);
+    }
+    CHECK(Telemetry::GetCount(histogram) == 1000);
+    for (unsigned percent : { 50, 90, 99 }) {
+        uint32_t percentile = Telemetry::GetPercentile(histogram, percent);
+        CHECK((percentile >= percent * 10) && (percentile <= percent * 10 * 5 / 4));
+    }
+}
@@ -0,0 +1,135 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+struct TestCase
+{
+    const char *name;
+    void (*function)();
+    bool benchmark;
+};
+
+static std::atomic<unsigned long long> allocations(0);
+static uint32_t randomState = 0x12345678;
+
+static std::vector<TestCase> &GetTestCases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *allocated = std::malloc(size ? size : 1);
+    if (!allocated) {
+        throw std::bad_alloc();
+    }
+    return allocated;
+}
+
+void operator delete(void *allocated) noexcept
+{
+    std::free(allocated);
+}
+
+TestRegistration::TestRegistration(const char *name, void (*function)(), bool benchmark)
+{
+    TestCase test;
+    test.name = name;
+    test.function = function;
+    test.benchmark = benchmark;
+    GetTestCases().push_back(test);
+}
+
+void Report(const std::string &name, double value, const std::string &unit)
+{
+    std::cout << "  " << name << ": " << value << " " << unit << std::endl;
+}
+
+unsigned long long GetAllocations()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+uint32_t GetRandom()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+float GetRandomFloat()
+{
+    return static_cast<float>(GetRandom() >> 8) / (1 << 23) - 1.f;
+}
+
+// Runs every check, or with -b every benchmark, optionally only those whose
+// name contains the given filter.
+int main(int argc, char **argv)
+{
+    bool benchmark = false;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-b")) {
+            benchmark = true;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    unsigned passed = 0, failed = 0;
+    for (const TestCase &test : GetTestCases()) {
+        if ((test.benchmark != benchmark) || (std::string(test.name).find(filter) == std::string::npos)) {
+            continue;
+        }
+        std::cout << test.name << std::endl;
+        try {
+            test.function();
+            passed++;
+        } catch (std::exception &catched) {
+            std::cout << "  FAILED: " << catched.what() << std::endl;
+            failed++;
+        }
+    }
+    std::cout << passed << " passed, " << failed << " failed" << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#define BENCHMARK_TIME 0.5
+
+// Minimal self-registering harness shared by the checks and benchmarks in
+// this directory. TEST bodies fail through CHECK, BENCHMARK bodies print their
+// figures through Report; the runner executes one kind or the other.
+class TestFailure : public std::runtime_error
+{
+    public:
+        TestFailure(const char *file, unsigned line, const std::string &condition)
+            : std::runtime_error(std::string(file) + ":" + std::to_string(line) + ": " + condition) { }
+};
+
+class TestRegistration
+{
+    public:
+        TestRegistration(const char *name, void (*function)(), bool benchmark);
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##Registration(#name, name, false); \
+    static void name()
+#define BENCHMARK(name) \
+    static void name(); \
+    static TestRegistration name##Registration(#name, name, true); \
+    static void name()
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            throw TestFailure(__FILE__, __LINE__, #condition); \
+        } \
+    } while (false)
+
+// Prints one benchmark figure as "name: value unit".
+void Report(const std::string &name, double value, const std::string &unit);
+// Number of global operator new calls made by this process so far.
+unsigned long long GetAllocations();
+// Fixed-seed generator, so failing random inputs are reproducible.
+uint32_t GetRandom();
+float GetRandomFloat();
+
+// Calls function until BENCHMARK_TIME seconds have passed and returns the
+// number of calls per second.
+template <typename Function>
+double Measure(Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long calls = 0;
+    double elapsed;
+    do {
+        function();
+        calls++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < BENCHMARK_TIME);
+    return calls / elapsed;
+}
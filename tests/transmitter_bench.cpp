@@ -0,0 +1,89 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "wave_file.hpp"
+#include "simulator.hpp"
+#include "transmitter.hpp"
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+#define TRANSMITTER_BENCH_RATE 22050
+#define TRANSMITTER_BENCH_SEGMENTS 4
+
+static const unsigned bufferTimes[] = { 10000, 50000, 100000, 250000, 1000000 };
+
+// Sweeps the DMA buffer time on the simulated backend, 4 segments each and a
+// prefetch buffer as long as the DMA one. Every run transmits one second of a
+// longer file and is stopped: start is the time from Transmit() to the first
+// sample sent by DMA, stop the time from Stop() to the last one. Refill CPU is
+// the refill thread's CPU time relative to the transmission time.
+BENCHMARK(DmaBufferSweep)
+{
+    char directory[] = "/tmp/fm_transmitter_benchXXXXXX";
+    CHECK(mkdtemp(directory));
+    std::string filename = std::string(directory) + "/silence.wav";
+    WriteWave(filename, std::vector<int16_t>(3 * TRANSMITTER_BENCH_RATE, 0), TRANSMITTER_BENCH_RATE);
+
+    for (unsigned bufferTime : bufferTimes) {
+        SimulatedBackend backend(500.f, 4 * TRANSMITTER_BENCH_RATE);
+        Transmitter transmitter(backend);
+        transmitter.SetBufferTime(bufferTime);
+        transmitter.SetSegments(TRANSMITTER_BENCH_SEGMENTS);
+        transmitter.SetPrefetchTime(bufferTime);
+        bool enable = true;
+        std::mutex mtx;
+        WaveReader reader(filename, enable, mtx);
+
+        uint64_t startTime = backend.GetTime(), stopTime = 0;
+        std::thread stop([&]() {
+            std::this_thread::sleep_for(std::chrono::microseconds(1000000 + bufferTime));
+            stopTime = backend.GetTime();
+            transmitter.Stop();
+        });
+        transmitter.Transmit(reader, 100.f, 200.f, 0, false);
+        stop.join();
+
+        // The first write is the carrier set up before the transmission.
+        std::vector<DivisorWrite> writes = backend.GetDivisorWrites();
+        RefillStats refill = transmitter.GetRefillStats();
+        std::string name = std::to_string(bufferTime / 1000) + " ms";
+        CHECK(writes.size() > 1);
+        Report(name + ", start", (writes[1].time - startTime) / 1000000.0, "ms");
+        Report(name + ", stop", (writes.back().time > stopTime) ? (writes.back().time - stopTime) / 1000000.0 : 0.0, "ms");
+        Report(name + ", refill p99", refill.latency99 / 1000.0, "ms");
+        Report(name + ", refill CPU", refill.duration ? 100.0 * refill.cpuTime / refill.duration : 0.0, "%");
+    }
+    CHECK(!system((std::string("rm -rf ") + directory).c_str()));
+}
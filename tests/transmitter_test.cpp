@@ -0,0 +1,170 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "wave_file.hpp"
+#include "simulator.hpp"
+#include "transmitter.hpp"
+#include "playlist.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+#define TRANSMITTER_TEST_RATE 22050
+
+// Rising ramp, so its divisors only ever go down and any replay of older
+// divisors shows up as a step back up.
+static std::vector<int16_t> GetRamp(unsigned frames)
+{
+    std::vector<int16_t> samples(frames);
+    for (unsigned i = 0; i < frames; i++) {
+        samples[i] = static_cast<int>(65535ULL * i / frames) - 32768;
+    }
+    return samples;
+}
+
+// Stopping ends the DMA chain right behind the segment being played (plus
+// the wait for the refill thread to notice) instead of letting it run
+// through the whole ring, and never replays divisors from a previous pass.
+TEST(DmaStopEndsBehindActiveSegment)
+{
+    char directory[] = "/tmp/fm_transmitter_testXXXXXX";
+    CHECK(mkdtemp(directory));
+    std::string filename = std::string(directory) + "/ramp.wav";
+    WriteWave(filename, GetRamp(3 * TRANSMITTER_TEST_RATE), TRANSMITTER_TEST_RATE);
+
+    SimulatedBackend backend(500.f, 4 * TRANSMITTER_TEST_RATE);
+    Transmitter transmitter(backend);
+    bool enable = true;
+    std::mutex mtx;
+    WaveReader reader(filename, enable, mtx);
+
+    uint64_t stopTime = 0;
+    std::thread stop([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        stopTime = backend.GetTime();
+        transmitter.Stop();
+    });
+    transmitter.Transmit(reader, 100.f, 200.f, 0, false);
+    stop.join();
+
+    // The first write is the carrier set up before the transmission.
+    std::vector<DivisorWrite> writes = backend.GetDivisorWrites();
+    unsigned late = 0, rising = 0;
+    for (std::size_t i = 1; i < writes.size(); i++) {
+        late += (writes[i].time > stopTime) ? 1 : 0;
+        rising += ((i > 1) && ((writes[i].divisor & 0xffffff) > (writes[i - 1].divisor & 0xffffff))) ? 1 : 0;
+    }
+    std::cout << "  " << writes.size() << " writes, " << late << " after stop" << std::endl;
+    CHECK(late <= TRANSMITTER_TEST_RATE / 2);
+    CHECK(!rising);
+    CHECK(!system((std::string("rm -rf ") + directory).c_str()));
+}
+
+// Simulated backend keeping the rate of every PWM pacing set up, so a
+// transmission restarted at some point shows up as a second entry.
+class PacingBackend : public SimulatedBackend
+{
+    public:
+        PacingBackend() : SimulatedBackend(500.f, 4 * TRANSMITTER_TEST_RATE) { }
+        virtual std::unique_ptr<PWMController> CreatePWMController(unsigned sampleRate)
+        {
+            sampleRates.push_back(sampleRate);
+            return SimulatedBackend::CreatePWMController(sampleRate);
+        }
+        std::vector<unsigned> sampleRates;
+};
+
+// Consecutive files are spliced into the running DMA chain: it is paced once
+// at one sample rate, and every sample of both files is sent in order with
+// nothing in between.
+TEST(PlaylistSplicesWithoutGap)
+{
+    char directory[] = "/tmp/fm_transmitter_testXXXXXX";
+    CHECK(mkdtemp(directory));
+    std::vector<std::string> filenames = { std::string(directory) + "/first.wav", std::string(directory) + "/second.wav" };
+    for (const std::string &filename : filenames) {
+        WriteWave(filename, GetRamp(TRANSMITTER_TEST_RATE), TRANSMITTER_TEST_RATE);
+    }
+
+    PacingBackend backend;
+    Transmitter transmitter(backend);
+    transmitter.SetBufferProfile(BufferProfile::Live);
+    bool enable = true;
+    std::mutex mtx;
+    Playlist playlist(filenames, false, enable, mtx);
+    transmitter.Transmit(playlist, 100.f, 200.f, 0);
+
+    // Besides the carrier, the end of the chain repeats the last divisor once.
+    // Both ramps only go down, so the splice is the one step back up.
+    std::vector<DivisorWrite> writes = backend.GetDivisorWrites();
+    unsigned rising = 0;
+    for (std::size_t i = 2; i < writes.size(); i++) {
+        rising += ((writes[i].divisor & 0xffffff) > (writes[i - 1].divisor & 0xffffff)) ? 1 : 0;
+    }
+    CHECK((backend.sampleRates.size() == 1) && (backend.sampleRates[0] == TRANSMITTER_TEST_RATE));
+    CHECK(writes.size() == 2 * TRANSMITTER_TEST_RATE + 2);
+    CHECK(rising == 1);
+    CHECK(!system((std::string("rm -rf ") + directory).c_str()));
+}
+
+// A file at another sample rate is resampled to the rate of the running
+// transmission instead of restarting it. The first file still reaches the
+// DMA untouched, and the resampled one keeps its duration.
+TEST(PlaylistResamplesWithoutRepacing)
+{
+    char directory[] = "/tmp/fm_transmitter_testXXXXXX";
+    CHECK(mkdtemp(directory));
+    std::vector<std::string> filenames = { std::string(directory) + "/first.wav", std::string(directory) + "/second.wav" };
+    WriteWave(filenames[0], GetRamp(TRANSMITTER_TEST_RATE), TRANSMITTER_TEST_RATE);
+    WriteWave(filenames[1], GetRamp(2 * TRANSMITTER_TEST_RATE), 2 * TRANSMITTER_TEST_RATE);
+
+    PacingBackend backend;
+    Transmitter transmitter(backend);
+    transmitter.SetBufferProfile(BufferProfile::Live);
+    bool enable = true;
+    std::mutex mtx;
+    Playlist playlist(filenames, false, enable, mtx);
+    transmitter.Transmit(playlist, 100.f, 200.f, 0);
+
+    std::vector<DivisorWrite> writes = backend.GetDivisorWrites();
+    unsigned rising = 0;
+    for (std::size_t i = 2; i < TRANSMITTER_TEST_RATE + 1; i++) {
+        rising += ((writes[i].divisor & 0xffffff) > (writes[i - 1].divisor & 0xffffff)) ? 1 : 0;
+    }
+    CHECK((backend.sampleRates.size() == 1) && (backend.sampleRates[0] == TRANSMITTER_TEST_RATE));
+    CHECK(std::abs(static_cast<int>(writes.size()) - (2 * TRANSMITTER_TEST_RATE + 2)) <= 1);
+    CHECK(!rising);
+    CHECK(!system((std::string("rm -rf ") + directory).c_str()));
+}
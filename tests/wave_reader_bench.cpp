@@ -0,0 +1,84 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test.hpp"
+#include "wave_reader.hpp"
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define WAVE_BENCH_FILE "acoustic_guitar_duet.wav"
+#define WAVE_BENCH_FRAMES 4096
+
+// Reads the whole data chunk in blocks of WAVE_BENCH_FRAMES, returns the
+// bytes read.
+static unsigned long long ReadWave(const std::string &filename)
+{
+    bool enable = true;
+    std::mutex mtx;
+    WaveReader reader(filename, enable, mtx);
+    unsigned long long bytes = 0;
+    unsigned frames;
+    do {
+        frames = WAVE_BENCH_FRAMES;
+        reader.GetRawSamples(frames, enable, mtx);
+        bytes += frames * reader.GetHeader().blockAlign;
+    } while (frames);
+    return bytes;
+}
+
+static void ReportThroughput(const std::string &name, const std::string &filename, std::function<void()> rewind)
+{
+    unsigned long long bytes = 0, allocations = GetAllocations(), files = 0;
+    double rate = Measure([&]() {
+        rewind();
+        bytes += ReadWave(filename);
+        files++;
+    });
+    Report(name + " throughput", rate * bytes / files / 1000000.0, "MB/s");
+    Report(name + " allocations", rate * (GetAllocations() - allocations) / files, "/s");
+}
+
+// Regular files are memory-mapped, the same file given as stdin goes through
+// read() into the reader's buffer.
+BENCHMARK(WaveReaderMappedVsRead)
+{
+    ReportThroughput("mmap", WAVE_BENCH_FILE, []() { });
+
+    int input = dup(STDIN_FILENO), file = open(WAVE_BENCH_FILE, O_RDONLY);
+    CHECK((input != -1) && (file != -1) && (dup2(file, STDIN_FILENO) != -1));
+    close(file);
+    ReportThroughput("read()", "", []() { lseek(STDIN_FILENO, 0, SEEK_SET); });
+    dup2(input, STDIN_FILENO);
+    close(input);
+}
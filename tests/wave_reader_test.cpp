@@ -0,0 +1,285 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "test.hpp"
+#include "wave_reader.hpp"
+#include <cmath>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Sub-format GUID tail shared by KSDATAFORMAT_SUBTYPE_PCM and _IEEE_FLOAT.
+static const uint8_t subFormatGuid[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 };
+
+// One encoding with samples of known value, tolerance covers the integer
+// scale (2^bits - 1, or 2^16 - 1 for 8-bit) not mapping codes to round values.
+struct WaveTestFormat
+{
+    uint16_t audioFormat;
+    uint16_t bitsPerSample;
+    std::vector<uint8_t> data;
+    std::vector<float> expected;
+    float tolerance;
+};
+
+static void Put(std::vector<uint8_t> &data, uint64_t value, unsigned size)
+{
+    for (unsigned i = 0; i < size; i++) {
+        data.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+template <typename T>
+static void PutValue(std::vector<uint8_t> &data, T value)
+{
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+static void PutChunk(std::vector<uint8_t> &file, const char *id, const std::vector<uint8_t> &data)
+{
+    file.insert(file.end(), id, id + 4);
+    Put(file, data.size(), 4);
+    file.insert(file.end(), data.begin(), data.end());
+    if (data.size() & 0x01) {
+        file.push_back(0);
+    }
+}
+
+static std::vector<uint8_t> GetFormat(uint16_t audioFormat, uint16_t channels, uint16_t bitsPerSample)
+{
+    std::vector<uint8_t> format;
+    Put(format, audioFormat, 2);
+    Put(format, channels, 2);
+    Put(format, 22050, 4);
+    Put(format, 22050 * channels * (bitsPerSample >> 3), 4);
+    Put(format, channels * (bitsPerSample >> 3), 2);
+    Put(format, bitsPerSample, 2);
+    return format;
+}
+
+static std::vector<uint8_t> GetExtensibleFormat(uint16_t subFormat, uint16_t channels, uint16_t bitsPerSample)
+{
+    std::vector<uint8_t> format = GetFormat(WAVE_FORMAT_EXTENSIBLE, channels, bitsPerSample);
+    Put(format, 22, 2);
+    Put(format, bitsPerSample, 2);
+    Put(format, (channels == 1) ? 0x04 : 0x03, 4);
+    Put(format, subFormat, 2);
+    format.insert(format.end(), subFormatGuid, subFormatGuid + sizeof(subFormatGuid));
+    return format;
+}
+
+// Wraps chunks, given as ID and contents, into a RIFF WAVE file.
+static std::vector<uint8_t> GetWave(const std::vector<std::pair<const char *, std::vector<uint8_t>>> &chunks)
+{
+    std::vector<uint8_t> body = { 'W', 'A', 'V', 'E' };
+    for (const auto &chunk : chunks) {
+        PutChunk(body, chunk.first, chunk.second);
+    }
+    std::vector<uint8_t> file = { 'R', 'I', 'F', 'F' };
+    Put(file, body.size(), 4);
+    file.insert(file.end(), body.begin(), body.end());
+    return file;
+}
+
+// Holds file contents in an anonymous memory file, which WaveReader opens and
+// maps like any regular file through its /proc/self/fd path.
+class MemoryFile
+{
+    public:
+        MemoryFile(const std::vector<uint8_t> &data)
+            : fileDescriptor(memfd_create("wave_reader_test", 0))
+        {
+            CHECK((fileDescriptor != -1) && (write(fileDescriptor, data.data(), data.size()) == static_cast<ssize_t>(data.size())));
+        }
+        ~MemoryFile()
+        {
+            close(fileDescriptor);
+        }
+        MemoryFile(const MemoryFile &) = delete;
+        MemoryFile &operator=(const MemoryFile &) = delete;
+        std::string GetFilename() const
+        {
+            return "/proc/self/fd/" + std::to_string(fileDescriptor);
+        }
+    private:
+        int fileDescriptor;
+};
+
+static std::vector<float> ReadWave(const std::vector<uint8_t> &file, WaveHeader &header)
+{
+    MemoryFile memory(file);
+    bool enable = true;
+    std::mutex mtx;
+    WaveReader reader(memory.GetFilename(), enable, mtx);
+    CHECK(reader.IsMapped());
+    header = reader.GetHeader();
+
+    std::vector<float> samples;
+    std::vector<float> block(4 * header.channels);
+    unsigned frames;
+    while ((frames = reader.Read(block.data(), 4, enable, mtx))) {
+        samples.insert(samples.end(), block.begin(), block.begin() + frames * header.channels);
+    }
+    return samples;
+}
+
+static bool IsRejected(const std::vector<uint8_t> &file)
+{
+    MemoryFile memory(file);
+    bool enable = true;
+    std::mutex mtx;
+    try {
+        WaveReader reader(memory.GetFilename(), enable, mtx);
+    } catch (std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+static std::vector<WaveTestFormat> GetTestFormats()
+{
+    std::vector<WaveTestFormat> formats = {
+        { WAVE_FORMAT_PCM, 8, { 0x80, 0xc0, 0x00, 0x40, 0xff, 0x80 }, { 0.f, 0.5f, -1.f, -0.5f, 127.f / 128, 0.f }, 1e-4f },
+        { WAVE_FORMAT_PCM, 16, { }, { 0.f, 0.5f, -1.f, -0.5f, 1.f, 0.f }, 1e-4f },
+        { WAVE_FORMAT_PCM, 24, { }, { 0.f, 0.5f, -1.f, -0.5f, 1.f, 0.f }, 1e-6f },
+        { WAVE_FORMAT_PCM, 32, { }, { 0.f, 0.5f, -1.f, -0.5f, 1.f, 0.f }, 1e-6f },
+        { WAVE_FORMAT_IEEE_FLOAT, 32, { }, { 0.25f, -0.75f, 1.f, -1.f, 0.f, 0.5f }, 0.f },
+        { WAVE_FORMAT_IEEE_FLOAT, 64, { }, { 0.125f, -0.5f, 1.f, -1.f, 0.f, 0.375f }, 0.f }
+    };
+    for (int32_t value : { 0, 0x4000, -0x8000, -0x4000, 0x7fff, 0 }) {
+        Put(formats[1].data, value, 2);
+    }
+    for (int32_t value : { 0, 0x400000, -0x800000, -0x400000, 0x7fffff, 0 }) {
+        Put(formats[2].data, value, 3);
+    }
+    for (int64_t value : { 0ll, 0x40000000ll, -0x80000000ll, -0x40000000ll, 0x7fffffffll, 0ll }) {
+        Put(formats[3].data, value, 4);
+    }
+    // Out of range float samples are clipped.
+    for (float value : { 0.25f, -0.75f, 1.5f, -2.f, 0.f, 0.5f }) {
+        PutValue(formats[4].data, value);
+    }
+    for (double value : { 0.125, -0.5, 3.0, -1.0, 0.0, 0.375 }) {
+        PutValue(formats[5].data, value);
+    }
+    return formats;
+}
+
+// Chunks before and after "fmt " are skipped, odd-sized ones with their pad
+// byte, and the samples still come out of "data".
+TEST(WaveReaderSkipsChunksAroundFormat)
+{
+    WaveTestFormat format = GetTestFormats()[1];
+    std::vector<uint8_t> list = { 'I', 'N', 'F', 'O', 'I', 'N', 'A', 'M', 3, 0, 0, 0, 'a', 'b', 0 };
+    std::vector<uint8_t> fact, junk = { 1, 2, 3 };
+    Put(fact, format.expected.size(), 4);
+
+    WaveHeader header;
+    std::vector<float> samples = ReadWave(GetWave({
+        { "LIST", list },
+        { "JUNK", junk },
+        { "fmt ", GetFormat(format.audioFormat, 2, format.bitsPerSample) },
+        { "fact", fact },
+        { "LIST", junk },
+        { "data", format.data }
+    }), header);
+    CHECK((header.audioFormat == WAVE_FORMAT_PCM) && (header.channels == 2) && (header.sampleRate == 22050) && (header.bitsPerSample == 16));
+    CHECK(header.dataSize == format.data.size());
+    CHECK(samples.size() == format.expected.size());
+    for (unsigned i = 0; i < samples.size(); i++) {
+        CHECK(std::fabs(samples[i] - format.expected[i]) <= format.tolerance);
+    }
+
+    // An odd-sized data chunk of 8-bit samples ends on its last whole frame.
+    format = GetTestFormats()[0];
+    format.data.pop_back();
+    samples = ReadWave(GetWave({ { "fmt ", GetFormat(WAVE_FORMAT_PCM, 1, 8) }, { "data", format.data } }), header);
+    CHECK((header.dataSize == 5) && (samples.size() == 5) && (std::fabs(samples[4] - format.expected[4]) <= format.tolerance));
+}
+
+// Every supported encoding, plain and as WAVE_FORMAT_EXTENSIBLE with the PCM
+// or IEEE float sub-format GUID, decodes to the known sample values.
+TEST(WaveReaderDecodesEveryFormat)
+{
+    for (const WaveTestFormat &format : GetTestFormats()) {
+        for (uint16_t channels = 1; channels <= 2; channels++) {
+            for (bool extensible : { false, true }) {
+                WaveHeader header;
+                std::vector<float> samples = ReadWave(GetWave({
+                    { "fmt ", extensible ? GetExtensibleFormat(format.audioFormat, channels, format.bitsPerSample) : GetFormat(format.audioFormat, channels, format.bitsPerSample) },
+                    { "data", format.data }
+                }), header);
+                CHECK((header.audioFormat == format.audioFormat) && (header.channels == channels) && (header.bitsPerSample == format.bitsPerSample));
+                CHECK(samples.size() == format.expected.size());
+                for (unsigned i = 0; i < samples.size(); i++) {
+                    CHECK(std::fabs(samples[i] - format.expected[i]) <= format.tolerance);
+                }
+            }
+        }
+    }
+}
+
+// Inconsistent or unsupported formats and files ending inside the headers
+// are refused when opened.
+TEST(WaveReaderRejectsMalformedFiles)
+{
+    std::vector<uint8_t> data = GetTestFormats()[1].data;
+    std::vector<uint8_t> format = GetFormat(WAVE_FORMAT_PCM, 2, 16);
+    std::vector<uint8_t> valid = GetWave({ { "fmt ", format }, { "data", data } });
+    CHECK(!IsRejected(valid));
+
+    std::vector<uint8_t> badBlockAlign = format, badByteRate = format, shortFormat = format;
+    badBlockAlign[12] = 2;
+    badByteRate[8] ^= 0x01;
+    shortFormat.resize(14);
+    CHECK(IsRejected(GetWave({ { "fmt ", badBlockAlign }, { "data", data } })));
+    CHECK(IsRejected(GetWave({ { "fmt ", badByteRate }, { "data", data } })));
+    CHECK(IsRejected(GetWave({ { "fmt ", shortFormat }, { "data", data } })));
+    CHECK(IsRejected(GetWave({ { "fmt ", GetFormat(WAVE_FORMAT_PCM, 1, 12) }, { "data", data } })));
+    CHECK(IsRejected(GetWave({ { "fmt ", GetFormat(WAVE_FORMAT_IEEE_FLOAT, 1, 16) }, { "data", data } })));
+    CHECK(IsRejected(GetWave({ { "data", data }, { "fmt ", format } })));
+
+    std::vector<uint8_t> unknownGuid = GetExtensibleFormat(WAVE_FORMAT_PCM, 2, 16);
+    unknownGuid.back() ^= 0xff;
+    CHECK(IsRejected(GetWave({ { "fmt ", unknownGuid }, { "data", data } })));
+
+    // Cut inside the RIFF header, a chunk header, the "fmt " chunk and before
+    // "data" is reached.
+    for (std::size_t size : { std::size_t(8), std::size_t(16), std::size_t(30), std::size_t(36), std::size_t(40) }) {
+        CHECK(IsRejected(std::vector<uint8_t>(valid.begin(), valid.begin() + size)));
+    }
+    std::vector<uint8_t> longSkip = GetWave({ { "fmt ", format }, { "LIST", data }, { "data", data } });
+    longSkip.resize(longSkip.size() - data.size() - 10);
+    CHECK(IsRejected(longSkip));
+}
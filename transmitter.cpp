@@ -32,370 +32,223 @@
 */
 
 #include "transmitter.hpp"
-#include "mailbox.hpp"
-#include <bcm_host.h>
+#include "divisor.hpp"
+#include "resampler.hpp"
+#include "audio_processor.hpp"
+#include "mpx_encoder.hpp"
+#include "cprofiler.hpp"
 #include <thread>
 #include <chrono>
 #include <cmath>
-#include <fcntl.h>
-#include <sys/mman.h>
-
-#define PERIPHERALS_PHYS_BASE 0x7e000000
-#define BCM2835_PERI_VIRT_BASE 0x20000000
-#define BCM2711_PERI_VIRT_BASE 0xfe000000
-
-#define BCM2835_MEM_FLAG 0x0c
-#define BCM2711_MEM_FLAG 0x04
-
-#define BCM2835_PLLD_FREQ 500
-#define BCM2711_PLLD_FREQ 750
-
-#define GPIO_BASE_OFFSET 0x00200000
-
-#define CLK0_BASE_OFFSET 0x00101070
-#define CLK1_BASE_OFFSET 0x00101078
-#define CLK_PASSWORD (0x5a << 24)
-#define CLK_CTL_SRC_PLLA 0x04
-#define CLK_CTL_SRC_PLLC 0x05
-#define CLK_CTL_SRC_PLLD 0x06
-#define CLK_CTL_ENAB (0x01 << 4)
-#define CLK_CTL_MASH(x) ((x & 0x03) << 9)
-
-#define PWMCLK_BASE_OFFSET 0x001010a0
-#define PWM_BASE_OFFSET 0x0020c000
-#define PWM_CHANNEL_RANGE 32
-#define PWM_WRITES_PER_SAMPLE 10
-#define PWM_CTL_CLRF1 (0x01 << 6)
-#define PWM_CTL_USEF1 (0x01 << 5)
-#define PWM_CTL_RPTL1 (0x01 << 2)
-#define PWM_CTL_MODE1 (0x01 << 1)
-#define PWM_CTL_PWEN1 0x01
-#define PWM_STA_BERR (0x01 << 8)
-#define PWM_STA_GAPO4 (0x01 << 7)
-#define PWM_STA_GAPO3 (0x01 << 6)
-#define PWM_STA_GAPO2 (0x01 << 5)
-#define PWM_STA_GAPO1 (0x01 << 4)
-#define PWM_STA_RERR1 (0x01 << 3)
-#define PWM_STA_WERR1 (0x01 << 2)
-#define PWM_STA_EMPT1 (0x01 << 1)
-#define PWM_STA_FULL1 0x01
-#define PWM_DMAC_ENAB (0x01 << 31)
-#define PWM_DMAC_PANIC(x) ((x & 0x0f) << 8)
-#define PWM_DMAC_DREQ(x) (x & 0x0f)
-
-#define DMA0_BASE_OFFSET 0x00007000
-#define DMA15_BASE_OFFSET 0x00e05000
-#define DMA_CS_RESET (0x01 << 31)
-#define DMA_CS_PANIC_PRIORITY(x) ((x & 0x0f) << 20)
-#define DMA_CS_PRIORITY(x) ((x & 0x0f) << 16)
-#define DMA_CS_INT (0x01 << 2)
-#define DMA_CS_END (0x01 << 1)
-#define DMA_CS_ACTIVE 0x01
-#define DMA_TI_NO_WIDE_BURST (0x01 << 26)
-#define DMA_TI_PERMAP(x) ((x & 0x0f) << 16)
-#define DMA_TI_DEST_DREQ (0x01 << 6)
-#define DMA_TI_WAIT_RESP (0x01 << 3)
+#include <algorithm>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/prctl.h>
 
 #define BUFFER_TIME 1000000
-#define PAGE_SIZE 4096
-
-struct ClockRegisters {
-    uint32_t ctl;
-    uint32_t div;
-};
-
-struct PWMRegisters {
-    uint32_t ctl;
-    uint32_t status;
-    uint32_t dmaConf;
-    uint32_t reserved0;
-    uint32_t chn1Range;
-    uint32_t chn1Data;
-    uint32_t fifoIn;
-    uint32_t reserved1;
-    uint32_t chn2Range;
-    uint32_t chn2Data;
-};
-
-struct DMAControllBlock {
-    uint32_t transferInfo;
-    uint32_t srcAddress;
-    uint32_t dstAddress;
-    uint32_t transferLen;
-    uint32_t stride;
-    uint32_t nextCbAddress;
-    uint32_t reserved0;
-    uint32_t reserved1;
-};
-
-struct DMARegisters {
-    uint32_t ctlStatus;
-    uint32_t cbAddress;
-    uint32_t transferInfo;
-    uint32_t srcAddress;
-    uint32_t dstAddress;
-    uint32_t transferLen;
-    uint32_t stride;
-    uint32_t nextCbAddress;
-    uint32_t debug;
-};
+#define MIN_BUFFER_TIME 10000
+#define PREFETCH_TIME 2000000
+#define PREFETCH_BLOCK_TIME 50000
+#define MIN_PREFETCH_BLOCK_TIME 5000
+#define DMA_SEGMENTS 4
+#define DMA_MAX_SEGMENTS 64
+#define DMA_MIN_WAIT_TIME 1000
+
+#define SPIN_WINDOW 20
+#define TIMER_SLACK 1000
+
+#define LIVE_BUFFER_TIME 100000
+#define LIVE_SEGMENTS 4
+#define LIVE_PREFETCH_TIME 200000
+#define ARCHIVE_BUFFER_TIME 4000000
+#define ARCHIVE_SEGMENTS 2
+#define ARCHIVE_PREFETCH_TIME 8000000
+
+const unsigned Transmitter::timingBucketLimits[TIMING_HISTOGRAM_SIZE - 1] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+static unsigned long long GetThreadCpuTime()
+{
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<unsigned long long>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+}
 
-class Peripherals
+// Applies real-time scheduling, CPU affinity and a tight timer slack to the
+// calling thread for the lifetime of the object and restores them afterwards.
+class TimingThread
 {
     public:
-        virtual ~Peripherals() {
-            munmap(peripherals, GetSize());
-        }
-        Peripherals(const Peripherals &) = delete;
-        Peripherals(Peripherals &&) = delete;
-        Peripherals &operator=(const Peripherals &) = delete;
-        static Peripherals &GetInstance() {
-            static Peripherals instance;
-            return instance;
-        }
-        uintptr_t GetPhysicalAddress(volatile void *object) const {
-            return PERIPHERALS_PHYS_BASE + (reinterpret_cast<uintptr_t>(object) - reinterpret_cast<uintptr_t>(peripherals));
-        }
-        uintptr_t GetVirtualAddress(uintptr_t offset) const {
-            return reinterpret_cast<uintptr_t>(peripherals) + offset;
-        }
-        static uintptr_t GetVirtualBaseAddress() {
-            return (bcm_host_get_peripheral_size() == BCM2711_PERI_VIRT_BASE) ? BCM2711_PERI_VIRT_BASE : bcm_host_get_peripheral_address();
+        TimingThread(int priority, int cpu) : timerSlack(prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0)), scheduled(false), pinned(false) {
+            thread = pthread_self();
+            if (priority) {
+                sched_param param;
+                pthread_getschedparam(thread, &policy, &param);
+                this->priority = param.sched_priority;
+                param.sched_priority = priority;
+                if (pthread_setschedparam(thread, SCHED_FIFO, &param)) {
+                    throw std::runtime_error("Cannot set real-time priority " + std::to_string(priority));
+                }
+                scheduled = true;
+            }
+            if (cpu >= 0) {
+                pthread_getaffinity_np(thread, sizeof(cpu_set_t), &affinity);
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                if (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &set)) {
+                    Restore();
+                    throw std::runtime_error("Cannot set CPU affinity to core " + std::to_string(cpu));
+                }
+                pinned = true;
+            }
+            prctl(PR_SET_TIMERSLACK, TIMER_SLACK, 0, 0, 0);
         }
-        static float GetClockFrequency() {
-            return (Peripherals::GetVirtualBaseAddress() == BCM2711_PERI_VIRT_BASE) ? BCM2711_PLLD_FREQ : BCM2835_PLLD_FREQ;
+        virtual ~TimingThread() {
+            Restore();
         }
+        TimingThread(const TimingThread &) = delete;
+        TimingThread(TimingThread &&) = delete;
+        TimingThread &operator=(const TimingThread &) = delete;
     private:
-        Peripherals() {
-            int memFd;
-            if ((memFd = open("/dev/mem", O_RDWR | O_SYNC)) < 0) {
-                throw std::runtime_error("Cannot open /dev/mem file (permission denied)");
+        void Restore() {
+            if (scheduled) {
+                sched_param param;
+                param.sched_priority = priority;
+                pthread_setschedparam(thread, policy, &param);
+                scheduled = false;
             }
-
-            peripherals = mmap(nullptr, GetSize(), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, GetVirtualBaseAddress());
-            close(memFd);
-            if (peripherals == MAP_FAILED) {
-                throw std::runtime_error("Cannot obtain access to peripherals (mmap error)");
+            if (pinned) {
+                pthread_setaffinity_np(thread, sizeof(cpu_set_t), &affinity);
+                pinned = false;
             }
-        }
-        unsigned GetSize() {
-            unsigned size = bcm_host_get_peripheral_size();
-            if (size == BCM2711_PERI_VIRT_BASE) {
-                size = 0x01000000;
+            if (timerSlack > 0) {
+                prctl(PR_SET_TIMERSLACK, timerSlack, 0, 0, 0);
             }
-            return size;
         }
 
-        void *peripherals;
-};
-
-class AllocatedMemory
-{
-    public:
-        AllocatedMemory() = delete;
-        AllocatedMemory(unsigned size) {
-            mBoxFd = mbox_open();
-            memSize = size;
-            if (memSize % PAGE_SIZE) {
-                memSize = (memSize / PAGE_SIZE + 1) * PAGE_SIZE;
-            }
-            memHandle = mem_alloc(mBoxFd, size, PAGE_SIZE, (Peripherals::GetVirtualBaseAddress() == BCM2835_PERI_VIRT_BASE) ? BCM2835_MEM_FLAG : BCM2711_MEM_FLAG);
-            if (!memHandle) {
-                mbox_close(mBoxFd);
-                memSize = 0;
-                throw std::runtime_error("Cannot allocate memory (" + std::to_string(size) + " bytes)");
-            }
-            memAddress = mem_lock(mBoxFd, memHandle);
-            memAllocated = mapmem(memAddress & ~0xc0000000, memSize);
-        }
-        virtual ~AllocatedMemory() {
-            unmapmem(memAllocated, memSize);
-            mem_unlock(mBoxFd, memHandle);
-            mem_free(mBoxFd, memHandle);
-            mbox_close(mBoxFd);
-            memSize = 0;
-        }
-        AllocatedMemory(const AllocatedMemory &) = delete;
-        AllocatedMemory(AllocatedMemory &&) = delete;
-        AllocatedMemory &operator=(const AllocatedMemory &) = delete;
-        uintptr_t GetPhysicalAddress(volatile void *object) const {
-            return (memSize) ? memAddress + (reinterpret_cast<uintptr_t>(object) - reinterpret_cast<uintptr_t>(memAllocated)) : 0x00000000;
-        }
-        uintptr_t GetBaseAddress() const {
-            return reinterpret_cast<uintptr_t>(memAllocated);
-        }
-    private:
-        unsigned memSize, memHandle;
-        uintptr_t memAddress;
-        void *memAllocated;
-        int mBoxFd;
+        pthread_t thread;
+        int policy, priority, timerSlack;
+        cpu_set_t affinity;
+        bool scheduled, pinned;
 };
 
-class Device
+Transmitter::Transmitter(Backend &backend)
+    : backend(backend), enable(false), prefetchEnd(false), prefetchCancel(false), prefetchTime(PREFETCH_TIME), bufferTime(BUFFER_TIME), segments(DMA_SEGMENTS), transmitRate(0), preEmphasis(0), stereo(false), processing(false), rds(nullptr),
+    lowWatermark(0), highWatermark(0), underruns(0), underrun(false), playlist(nullptr), stopped(false), refillSegments(0), refillSegmentSize(0), lateRefills(0), maxRefillLatency(0), minHeadroom(0), refillCpuTime(0), refillDuration(0),
+    realtimePriority(0), cpuAffinity(-1), spinWindow(SPIN_WINDOW), timingHistogram(), timingSamples(0), skippedSamples(0), maxTimingError(0), timingCpuTime(0), timingDuration(0), telemetry(nullptr)
 {
-    public:
-        Device() {
-            peripherals = &Peripherals::GetInstance();
-        }
-        Device(const Device &) = delete;
-        Device(Device &&) = delete;
-        Device &operator=(const Device &) = delete;
-    protected:
-        Peripherals *peripherals;
-};
+}
 
-class ClockDevice : public Device
-{
-    public:
-        ClockDevice() = delete;
-        ClockDevice(uintptr_t address, unsigned divisor) {
-            clock = reinterpret_cast<ClockRegisters *>(peripherals->GetVirtualAddress(address));
-            clock->ctl = CLK_PASSWORD | CLK_CTL_SRC_PLLD;
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
-            clock->div = CLK_PASSWORD | (0xffffff & divisor);
-            clock->ctl = CLK_PASSWORD | CLK_CTL_MASH(0x1) | CLK_CTL_ENAB | CLK_CTL_SRC_PLLD;        }
-        virtual ~ClockDevice() {
-            clock->ctl = CLK_PASSWORD | CLK_CTL_SRC_PLLD;
-        }
-    protected:
-        volatile ClockRegisters *clock;
-};
+Transmitter::~Transmitter() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [&]() -> bool {
+        return !enable;
+    });
+}
 
-class ClockOutput : public ClockDevice
+void Transmitter::Transmit(AudioSource &source, float frequency, float bandwidth, unsigned dmaChannel, bool preserveCarrier)
 {
-    public:
-        ClockOutput() = delete;
-#ifndef GPIO21
-        ClockOutput(unsigned divisor) : ClockDevice(CLK0_BASE_OFFSET, divisor) {
-            output = reinterpret_cast<uint32_t *>(peripherals->GetVirtualAddress(GPIO_BASE_OFFSET));
-            *output = (*output & 0xffff8fff) | (0x04 << 12);
-#else
-        ClockOutput(unsigned divisor) : ClockDevice(CLK1_BASE_OFFSET, divisor) {
-            output = reinterpret_cast<uint32_t *>(peripherals->GetVirtualAddress(GPIO_BASE_OFFSET + 0x08));
-            *output = (*output & 0xffffffc7) | (0x02 << 3);
-#endif
-        }
-        virtual ~ClockOutput() {
-#ifndef GPIO21
-            *output = (*output & 0xffff8fff) | (0x01 << 12);
-#else
-            *output = (*output & 0xffffffc7) | (0x02 << 3);
-#endif
-        }
-        void SetDivisor(unsigned divisor) {
-            clock->div = CLK_PASSWORD | (0xffffff & divisor);
+    Run(source, frequency, bandwidth, true, preserveCarrier, [&](unsigned sampleRate, unsigned clockDivisor) {
+        if (!output) {
+            output = backend.CreateClockOutput(clockDivisor);
         }
-        volatile uint32_t &GetDivisor() {
-            return clock->div;
+        if (dmaChannel != 0xff) {
+            unsigned bufferSize = static_cast<unsigned>(static_cast<unsigned long long>(sampleRate) * bufferTime / 1000000);
+            TxViaDma(sampleRate, bufferSize, dmaChannel);
+        } else {
+            TxViaCpu(sampleRate);
         }
-    private:
-        volatile uint32_t *output;
-};
+    });
+}
 
-class PWMController : public ClockDevice
+void Transmitter::Transmit(Playlist &playlist, float frequency, float bandwidth, unsigned dmaChannel)
 {
-    public:
-        PWMController() = delete;
-        PWMController(unsigned sampleRate) : ClockDevice(PWMCLK_BASE_OFFSET, static_cast<unsigned>(Peripherals::GetClockFrequency() * 1000000.f * (0x01 << 12) / (PWM_WRITES_PER_SAMPLE * PWM_CHANNEL_RANGE * sampleRate))) {
-            pwm = reinterpret_cast<PWMRegisters *>(peripherals->GetVirtualAddress(PWM_BASE_OFFSET));
-            pwm->ctl = 0x00000000;
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
-            pwm->status = PWM_STA_BERR | PWM_STA_GAPO1 | PWM_STA_RERR1 | PWM_STA_WERR1;
-            pwm->ctl = PWM_CTL_CLRF1;
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
-            pwm->chn1Range = PWM_CHANNEL_RANGE;
-            pwm->dmaConf = PWM_DMAC_ENAB | PWM_DMAC_PANIC(0x7) | PWM_DMAC_DREQ(0x7);
-            pwm->ctl = PWM_CTL_USEF1 | PWM_CTL_RPTL1 | PWM_CTL_MODE1 | PWM_CTL_PWEN1;
-        }
-        virtual ~PWMController() {
-            pwm->ctl = 0x00000000;
-        }
-        volatile uint32_t &GetFifoIn() {
-            return pwm->fifoIn;
-        }
-    private:
-        volatile PWMRegisters *pwm;
-};
+    stopped = false;
+    std::unique_ptr<AudioSource> source = playlist.Next();
+    this->playlist = &playlist;
 
-class DMAController : public Device
-{
-    public:
-        DMAController() = delete;
-        DMAController(uint32_t address, unsigned dmaChannel) {
-            dma = reinterpret_cast<DMARegisters *>(peripherals->GetVirtualAddress((dmaChannel < 15) ? DMA0_BASE_OFFSET + dmaChannel * 0x100 : DMA15_BASE_OFFSET));
-            dma->ctlStatus = DMA_CS_RESET;
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
-            dma->ctlStatus = DMA_CS_INT | DMA_CS_END;
-            dma->cbAddress = address;
-            dma->ctlStatus = DMA_CS_PANIC_PRIORITY(0xf) | DMA_CS_PRIORITY(0xf) | DMA_CS_ACTIVE;
-        }
-        virtual ~DMAController() {
-            dma->ctlStatus = DMA_CS_RESET;
-        }
-        void SetControllBlockAddress(uint32_t address) {
-            dma->cbAddress = address;
-        }
-        volatile uint32_t &GetControllBlockAddress() {
-            return dma->cbAddress;
+    auto finally = [&]() {
+        this->playlist = nullptr;
+        output.reset();
+    };
+    try {
+        if (source && !stopped) {
+            Transmit(*source, frequency, bandwidth, dmaChannel, true);
         }
-    private:
-        volatile DMARegisters *dma;
-};
-
-Transmitter::Transmitter()
-    : output(nullptr), enable(false)
-{
+    } catch (...) {
+        finally();
+        throw;
+    }
+    finally();
 }
 
-Transmitter::~Transmitter() {
-    std::unique_lock<std::mutex> lock(mtx);
-    cv.wait(lock, [&]() -> bool {
-        return !enable;
+unsigned long long Transmitter::Render(AudioSource &source, float frequency, float bandwidth, std::ostream &stream, RenderFormat format)
+{
+    unsigned long long rendered = 0;
+    Run(source, frequency, bandwidth, false, true, [&](unsigned sampleRate, unsigned clockDivisor) {
+        rendered = TxToStream(stream, format, frequency);
     });
-    if (output) {
-        delete output;
-    }
+    return rendered;
 }
 
-void Transmitter::Transmit(WaveReader &reader, float frequency, float bandwidth, unsigned dmaChannel, bool preserveCarrier)
+void Transmitter::Run(AudioSource &source, float frequency, float bandwidth, bool realtime, bool preserveCarrier, const std::function<void(unsigned, unsigned)> &tx)
 {
     {
         std::lock_guard<std::mutex> lock(mtx);
         enable = true;
     }
 
+    // Readers blocked on a stalled stdin only watch enable, so it is cleared
+    // before the prefetch thread is joined.
     auto finally = [&]() {
-        if (!preserveCarrier && output) {
-            delete output;
-            output = nullptr;
-        }
         {
             std::lock_guard<std::mutex> lock(mtx);
             enable = false;
         }
         cv.notify_all();
-    };
-    try {
-        WaveHeader header = reader.GetHeader();
-        unsigned bufferSize = static_cast<unsigned>(static_cast<unsigned long long>(header.sampleRate) * BUFFER_TIME / 1000000);
-
-        unsigned clockDivisor = static_cast<unsigned>(round(Peripherals::GetClockFrequency() * (0x01 << 12) / frequency));
-        unsigned divisorRange = clockDivisor - static_cast<unsigned>(round(Peripherals::GetClockFrequency() * (0x01 << 12) / (frequency + 0.0005f * bandwidth)));
-
-        if (!output) {
-            output = new ClockOutput(clockDivisor);
+        prefetchCancel = true;
+        if (prefetchThread.joinable()) {
+            prefetchThread.join();
         }
-
-        if (dmaChannel != 0xff) {
-            TxViaDma(reader, header.sampleRate, bufferSize, clockDivisor, divisorRange, dmaChannel);
-        } else {
-            TxViaCpu(reader, header.sampleRate, bufferSize, clockDivisor, divisorRange);
+        if (!preserveCarrier) {
+            output.reset();
         }
+    };
+    try {
+        bool multiplex = stereo || rds;
+        unsigned sampleRate = transmitRate ? transmitRate : (multiplex ? MPX_SAMPLE_RATE : source.GetSampleRate());
+        if (multiplex && (sampleRate < MPX_MIN_SAMPLE_RATE)) {
+            throw std::runtime_error("Stereo and RDS transmission require at least " + std::to_string(MPX_MIN_SAMPLE_RATE) + " Hz transmit rate");
+        }
+
+        unsigned clockDivisor = static_cast<unsigned>(round(backend.GetClockFrequency() * (0x01 << 12) / frequency));
+        unsigned divisorRange = clockDivisor - static_cast<unsigned>(round(backend.GetClockFrequency() * (0x01 << 12) / (frequency + 0.0005f * bandwidth)));
+
+        unsigned blockSize = static_cast<unsigned>(static_cast<unsigned long long>(sampleRate) * GetPrefetchBlockTime() / 1000000);
+        prefetch.Reset(std::max(static_cast<unsigned long long>(2 * blockSize), static_cast<unsigned long long>(sampleRate) * prefetchTime / 1000000));
+        prefetchEnd = false;
+        prefetchCancel = false;
+        prefetchError = nullptr;
+        divisorTable.reset();
+        lowWatermark = prefetch.GetCapacity();
+        highWatermark = 0;
+        underruns = 0;
+        underrun = false;
+        prefetchThread = std::thread(&Transmitter::PrefetchThread, this, &source, sampleRate, clockDivisor, divisorRange, realtime);
+
+        if (telemetry) {
+            telemetry->GetData().sampleRate.store(sampleRate, std::memory_order_relaxed);
+        }
+        tx(sampleRate, clockDivisor);
     } catch (...) {
         finally();
         throw;
     }
     finally();
+    if (prefetchError) {
+        std::rethrow_exception(prefetchError);
+    }
 }
 
 void Transmitter::Stop()
@@ -403,198 +256,735 @@ void Transmitter::Stop()
     std::unique_lock<std::mutex> lock(mtx);
     enable = false;
     lock.unlock();
+    stopped = true;
+    prefetchCancel = true;
     cv.notify_all();
 }
 
-void Transmitter::TxViaDma(WaveReader &reader, unsigned sampleRate, unsigned bufferSize, unsigned clockDivisor, unsigned divisorRange, unsigned dmaChannel)
+void Transmitter::SetPrefetchTime(unsigned time)
+{
+    prefetchTime = time;
+}
+
+void Transmitter::SetBufferTime(unsigned time)
+{
+    bufferTime = time;
+}
+
+void Transmitter::SetSegments(unsigned segments)
+{
+    this->segments = segments;
+}
+
+void Transmitter::SetBufferProfile(BufferProfile profile)
+{
+    switch (profile) {
+        case BufferProfile::Live:
+            bufferTime = LIVE_BUFFER_TIME;
+            segments = LIVE_SEGMENTS;
+            prefetchTime = LIVE_PREFETCH_TIME;
+            break;
+        case BufferProfile::Balanced:
+            bufferTime = BUFFER_TIME;
+            segments = DMA_SEGMENTS;
+            prefetchTime = PREFETCH_TIME;
+            break;
+        case BufferProfile::Archive:
+            bufferTime = ARCHIVE_BUFFER_TIME;
+            segments = ARCHIVE_SEGMENTS;
+            prefetchTime = ARCHIVE_PREFETCH_TIME;
+            break;
+    }
+}
+
+unsigned Transmitter::GetBufferTime() const
+{
+    return bufferTime;
+}
+
+unsigned Transmitter::GetSegments() const
+{
+    return segments;
+}
+
+unsigned Transmitter::GetPrefetchTime() const
+{
+    return prefetchTime;
+}
+
+void Transmitter::SetTransmitRate(unsigned rate)
+{
+    if (rate && ((rate < 8000) || (rate > 192000))) {
+        throw std::runtime_error("Transmit rate must be between 8000 and 192000 Hz");
+    }
+    transmitRate = rate;
+}
+
+unsigned Transmitter::GetTransmitRate() const
+{
+    return transmitRate;
+}
+
+// A sample read from its source waits behind at most a full prefetch buffer
+// (two blocks or more) and then the whole DMA buffer.
+unsigned Transmitter::GetLatency() const
+{
+    return bufferTime + std::max(prefetchTime, 2 * GetPrefetchBlockTime());
+}
+
+// Sources are read in blocks of at most half the prefetch time, so a short
+// prefetch buffer still holds two of them. Waits on the buffer scale with the
+// block, a live source then fills the DMA buffer without idling.
+unsigned Transmitter::GetPrefetchBlockTime() const
+{
+    return std::max(std::min(static_cast<unsigned>(PREFETCH_BLOCK_TIME), prefetchTime / 2), static_cast<unsigned>(MIN_PREFETCH_BLOCK_TIME));
+}
+
+void Transmitter::SetStereo(bool stereo)
+{
+    this->stereo = stereo;
+}
+
+bool Transmitter::IsStereo() const
+{
+    return stereo;
+}
+
+void Transmitter::SetProcessing(bool processing)
+{
+    this->processing = processing;
+}
+
+bool Transmitter::IsProcessing() const
+{
+    return processing;
+}
+
+void Transmitter::SetPreEmphasis(unsigned time)
+{
+    if ((time != 0) && (time != 50) && (time != 75)) {
+        throw std::runtime_error("Pre-emphasis must be 0, 50 or 75 us");
+    }
+    preEmphasis = time;
+}
+
+unsigned Transmitter::GetPreEmphasis() const
+{
+    return preEmphasis;
+}
+
+void Transmitter::SetRealtimePriority(int priority)
+{
+    realtimePriority = priority;
+}
+
+void Transmitter::SetCpuAffinity(int cpu)
+{
+    cpuAffinity = cpu;
+}
+
+void Transmitter::SetSpinWindow(unsigned time)
+{
+    spinWindow = time;
+}
+
+void Transmitter::SetTelemetry(Telemetry *telemetry)
+{
+    this->telemetry = telemetry;
+}
+
+void Transmitter::SetRds(RdsEncoder *rds)
+{
+    this->rds = rds;
+}
+
+void Transmitter::SetCacheDirectory(const std::string &directory)
+{
+    cacheDirectory = directory;
+}
+
+PrefetchStats Transmitter::GetPrefetchStats() const
+{
+    PrefetchStats stats;
+    stats.capacity = prefetch.GetCapacity();
+    stats.depth = prefetch.GetSize();
+    stats.lowWatermark = lowWatermark.load(std::memory_order_relaxed);
+    stats.highWatermark = highWatermark.load(std::memory_order_relaxed);
+    stats.underruns = underruns.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Transmitter::TxViaDma(unsigned sampleRate, unsigned bufferSize, unsigned dmaChannel)
 {
     if (dmaChannel > 15) {
         throw std::runtime_error("DMA channel number out of range (0 - 15)");
     }
+    if ((segments < 2) || (segments > DMA_MAX_SEGMENTS)) {
+        throw std::runtime_error("DMA segment count out of range (2 - " + std::to_string(DMA_MAX_SEGMENTS) + ")");
+    }
+    if ((bufferTime < MIN_BUFFER_TIME) || (bufferSize < segments)) {
+        throw std::runtime_error("Buffer time too short (" + std::to_string(MIN_BUFFER_TIME / 1000) + " ms minimum)");
+    }
 
-    AllocatedMemory allocated(sizeof(uint32_t) * bufferSize + sizeof(DMAControllBlock) * (2 * bufferSize) + sizeof(uint32_t));
-
-    std::vector<Sample> samples = reader.GetSamples(bufferSize, enable, mtx);
-    if (samples.empty()) {
-        return;
+    // The ring is split into segments, each followed by a status
+    // control block copying the segment's sequence number into a status word.
+    // A segment may be refilled once the status word shows its previous
+    // sequence number, so no control block address polling is needed.
+    unsigned segmentSize = bufferSize / segments;
+    unsigned segmentCbs = 2 * segmentSize + 1;
+    bufferSize = segmentSize * segments;
+
+    std::size_t memorySize = sizeof(DMAControllBlock) * segmentCbs * segments + sizeof(uint32_t) * (bufferSize + segments + 2);
+    std::size_t memoryLimit = backend.GetMemoryLimit();
+    if (memoryLimit && (memorySize > memoryLimit)) {
+        throw std::runtime_error("DMA buffer needs " + std::to_string(memorySize) + " bytes, only " + std::to_string(memoryLimit) +
+            " bytes of VideoCore memory available, reduce buffer time");
     }
+    std::unique_ptr<AllocatedMemory> allocated = backend.AllocateMemory(memorySize);
 
-    bool eof = false;
-    if (samples.size() < bufferSize) {
-        bufferSize = samples.size();
-        eof = true;
+    volatile DMAControllBlock *dmaCb = reinterpret_cast<DMAControllBlock *>(allocated->GetBaseAddress());
+    volatile uint32_t *clkDiv = reinterpret_cast<uint32_t *>(reinterpret_cast<uintptr_t>(dmaCb) + sizeof(DMAControllBlock) * segmentCbs * segments);
+    volatile uint32_t *sequence = &clkDiv[bufferSize];
+    volatile uint32_t *status = &sequence[segments];
+    volatile uint32_t *pwmFifoData = &status[1];
+
+    for (std::atomic<uint32_t> &count : refillLatency.counts) {
+        count.store(0, std::memory_order_relaxed);
     }
+    refillSegments = segments;
+    refillSegmentSize = segmentSize;
+    lateRefills = 0;
+    maxRefillLatency = 0;
+    refillCpuTime = 0;
+    refillDuration = 0;
+    minHeadroom = static_cast<long long>(bufferSize) * 1000000 / sampleRate;
 
-    PWMController pwm(sampleRate);
-    Peripherals &peripherals = Peripherals::GetInstance();
+    std::unique_ptr<PWMController> pwm = backend.CreatePWMController(sampleRate);
 
     unsigned cbOffset = 0;
-
-    volatile DMAControllBlock *dmaCb = reinterpret_cast<DMAControllBlock *>(allocated.GetBaseAddress());
-    volatile uint32_t *clkDiv = reinterpret_cast<uint32_t *>(reinterpret_cast<uintptr_t>(dmaCb) + 2 * sizeof(DMAControllBlock) * bufferSize);
-    volatile uint32_t *pwmFifoData = reinterpret_cast<uint32_t *>(reinterpret_cast<uintptr_t>(clkDiv) + sizeof(uint32_t) * bufferSize);
-    for (unsigned i = 0; i < bufferSize; i++) {
-        float value = samples[i].GetMonoValue();
-        clkDiv[i] = CLK_PASSWORD | (0xffffff & (clockDivisor - static_cast<int32_t>(round(value * divisorRange))));
-        dmaCb[cbOffset].transferInfo = DMA_TI_NO_WIDE_BURST | DMA_TI_WAIT_RESP;;
-        dmaCb[cbOffset].srcAddress = allocated.GetPhysicalAddress(&clkDiv[i]);
-        dmaCb[cbOffset].dstAddress = peripherals.GetPhysicalAddress(&output->GetDivisor());
+    for (unsigned segment = 0; segment < segments; segment++) {
+        for (unsigned i = 0; i < segmentSize; i++) {
+            dmaCb[cbOffset].transferInfo = DMA_TI_NO_WIDE_BURST | DMA_TI_WAIT_RESP;
+            dmaCb[cbOffset].srcAddress = allocated->GetPhysicalAddress(&clkDiv[segment * segmentSize + i]);
+            dmaCb[cbOffset].dstAddress = output->GetDivisorAddress();
+            dmaCb[cbOffset].transferLen = sizeof(uint32_t);
+            dmaCb[cbOffset].stride = 0;
+            dmaCb[cbOffset].nextCbAddress = allocated->GetPhysicalAddress(&dmaCb[cbOffset + 1]);
+            cbOffset++;
+
+            dmaCb[cbOffset].transferInfo = DMA_TI_NO_WIDE_BURST | DMA_TI_PERMAP(0x5) | DMA_TI_DEST_DREQ | DMA_TI_WAIT_RESP;
+            dmaCb[cbOffset].srcAddress = allocated->GetPhysicalAddress(pwmFifoData);
+            dmaCb[cbOffset].dstAddress = pwm->GetFifoInAddress();
+            dmaCb[cbOffset].transferLen = sizeof(uint32_t) * PWM_WRITES_PER_SAMPLE;
+            dmaCb[cbOffset].stride = 0;
+            dmaCb[cbOffset].nextCbAddress = allocated->GetPhysicalAddress(&dmaCb[cbOffset + 1]);
+            cbOffset++;
+        }
+        dmaCb[cbOffset].transferInfo = DMA_TI_NO_WIDE_BURST | DMA_TI_WAIT_RESP;
+        dmaCb[cbOffset].srcAddress = allocated->GetPhysicalAddress(&sequence[segment]);
+        dmaCb[cbOffset].dstAddress = allocated->GetPhysicalAddress(status);
         dmaCb[cbOffset].transferLen = sizeof(uint32_t);
         dmaCb[cbOffset].stride = 0;
-        dmaCb[cbOffset].nextCbAddress = allocated.GetPhysicalAddress(&dmaCb[cbOffset + 1]);
-        cbOffset++;
-
-        dmaCb[cbOffset].transferInfo = DMA_TI_NO_WIDE_BURST | DMA_TI_PERMAP(0x5) | DMA_TI_DEST_DREQ | DMA_TI_WAIT_RESP;
-        dmaCb[cbOffset].srcAddress = allocated.GetPhysicalAddress(pwmFifoData);
-        dmaCb[cbOffset].dstAddress = peripherals.GetPhysicalAddress(&pwm.GetFifoIn());
-        dmaCb[cbOffset].transferLen = sizeof(uint32_t) * PWM_WRITES_PER_SAMPLE;
-        dmaCb[cbOffset].stride = 0;
-        dmaCb[cbOffset].nextCbAddress = allocated.GetPhysicalAddress((i < bufferSize - 1) ? &dmaCb[cbOffset + 1] : dmaCb);
+        dmaCb[cbOffset].nextCbAddress = allocated->GetPhysicalAddress((segment < segments - 1) ? &dmaCb[cbOffset + 1] : dmaCb);
         cbOffset++;
     }
     *pwmFifoData = 0x00000000;
+    *status = 0xffffffff;
+
+    TrentCode::setThreadName("dma refill");
+
+    uint32_t last = 0x00000000;
+    auto fill = [&](unsigned segment, bool started) -> unsigned {
+        unsigned filled = 0;
+        while ((filled < segmentSize) && !prefetchCancel && !IsPrefetchDrained()) {
+            uint32_t *divisors = const_cast<uint32_t *>(&clkDiv[segment * segmentSize + filled]);
+            std::size_t popped = started ? PopDivisors(divisors, segmentSize - filled) : prefetch.Pop(divisors, segmentSize - filled);
+            if (!popped) {
+                std::this_thread::sleep_for(std::chrono::microseconds(GetPrefetchBlockTime() / 10));
+            }
+            filled += popped;
+        }
+        if (filled) {
+            last = clkDiv[segment * segmentSize + filled - 1];
+        }
+        if (telemetry) {
+            Telemetry::Add(telemetry->GetData().samples, filled);
+        }
+        return filled;
+    };
+    // Ends the chain right after the last filled sample of a segment which the
+    // DMA has not entered yet, the terminating block repeats the last divisor.
+    auto terminate = [&](unsigned segment, unsigned filled) {
+        if (filled < segmentSize) {
+            clkDiv[segment * segmentSize + filled] = last;
+        }
+        dmaCb[segment * segmentCbs + 2 * filled].nextCbAddress = 0x00000000;
+    };
 
-    DMAController dma(allocated.GetPhysicalAddress(dmaCb), dmaChannel);
+    uint32_t next = 0;
+    bool eof = false;
+    while (next < segments) {
+        sequence[next] = next;
+        unsigned filled = fill(next, false);
+        if (filled < segmentSize) {
+            if (prefetchCancel || (!next && !filled)) {
+                return;
+            }
+            terminate(next, filled);
+            eof = true;
+            break;
+        }
+        next++;
+    }
 
-    std::this_thread::sleep_for(std::chrono::microseconds(BUFFER_TIME / 10));
+    std::unique_ptr<DMAController> dma = backend.CreateDMAController(allocated->GetPhysicalAddress(dmaCb), dmaChannel);
 
+    auto getPosition = [&]() -> unsigned {
+        unsigned index = (dma->GetControllBlockAddress() - allocated->GetPhysicalAddress(dmaCb)) / sizeof(DMAControllBlock);
+        return ((index / segmentCbs) * segmentSize + (index % segmentCbs) / 2) % bufferSize;
+    };
+    // When stopped early the chain ends at the start of the segment after the
+    // one being played. The next segment to refill is not a safe end: after a
+    // late refill the DMA may already be inside it, playing divisors from the
+    // previous pass, and would go on for another lap. The DMA can move on
+    // while the chain is being ended, so this repeats until it is seen in the
+    // same segment afterwards.
     auto finally = [&]() {
-        dmaCb[(cbOffset < 2 * bufferSize) ? cbOffset : 0].nextCbAddress = 0x00000000;
-        while (dma.GetControllBlockAddress() != 0x00000000) {
+        if (!eof && (dma->GetControllBlockAddress() != 0x00000000)) {
+            unsigned active, current = getPosition() / segmentSize;
+            do {
+                active = current;
+                last = clkDiv[active * segmentSize + segmentSize - 1];
+                terminate((active + 1) % segments, 0);
+                current = getPosition() / segmentSize;
+            } while (current != active);
+        }
+        while (dma->GetControllBlockAddress() != 0x00000000) {
             std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
-        samples.clear();
+    };
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long cpuStart = GetThreadCpuTime();
+    auto measure = [&]() {
+        refillCpuTime = GetThreadCpuTime() - cpuStart;
+        refillDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
     };
     try {
-        while (!eof) {
-            {
-                std::lock_guard<std::mutex> lock(mtx);
-                if (!enable) {
-                    break;
-                }
+        while (!eof && !prefetchCancel) {
+            unsigned segment = next % segments;
+            if (static_cast<int32_t>(*status - (next - segments)) < 0) {
+                unsigned remaining = ((segment + 1) * segmentSize + bufferSize - getPosition()) % bufferSize;
+                std::this_thread::sleep_for(std::chrono::microseconds(std::max(static_cast<unsigned long long>(remaining) * 1000000 / sampleRate, static_cast<unsigned long long>(DMA_MIN_WAIT_TIME))));
+                continue;
             }
-            samples = reader.GetSamples(bufferSize, enable, mtx);
-            if (!samples.size()) {
+            CPROF_NAMED("refill");
+            sequence[segment] = next;
+            unsigned filled = fill(segment, true);
+            if (filled < segmentSize) {
+                terminate(segment, filled);
+                eof = true;
                 break;
             }
-            cbOffset = 0;
-            eof = samples.size() < bufferSize;
-            for (std::size_t i = 0; i < samples.size(); i++) {
-                float value = samples[i].GetMonoValue();
-                while (i == ((dma.GetControllBlockAddress() - allocated.GetPhysicalAddress(dmaCb)) / (2 * sizeof(DMAControllBlock)))) {
-                    std::this_thread::sleep_for(std::chrono::microseconds(BUFFER_TIME / 10));
+
+            unsigned position = getPosition();
+            unsigned elapsed = (position + 2 * bufferSize - (segment + 1) * segmentSize) % bufferSize;
+            long long headroom = (segment * segmentSize + bufferSize - position) % bufferSize;
+            if (static_cast<int32_t>(*status - (next - 1)) >= 0) {
+                headroom = -static_cast<long long>((position + bufferSize - segment * segmentSize) % bufferSize);
+                lateRefills++;
+            }
+            unsigned latency = static_cast<unsigned long long>(elapsed) * 1000000 / sampleRate;
+            Telemetry::Record(refillLatency, latency);
+            maxRefillLatency = std::max(maxRefillLatency, latency);
+            minHeadroom = std::min(minHeadroom, headroom * 1000000 / sampleRate);
+            if (telemetry) {
+                TelemetryData &data = telemetry->GetData();
+                Telemetry::Add(data.refills, 1);
+                Telemetry::Record(data.refillLatency, latency);
+                if (headroom < 0) {
+                    Telemetry::Add(data.lateRefills, 1);
+                    Telemetry::Add(data.duplicatedSamples, -headroom);
+                } else {
+                    Telemetry::Record(data.refillHeadroom, headroom);
                 }
-                clkDiv[i] = CLK_PASSWORD | (0xffffff & (clockDivisor - static_cast<int>(round(value * divisorRange))));
-                cbOffset += 2;
             }
+            next++;
         }
     } catch (...) {
+        measure();
         finally();
         throw;
     }
+    measure();
     finally();
 }
 
-void Transmitter::TxViaCpu(WaveReader &reader, unsigned sampleRate, unsigned bufferSize, unsigned clockDivisor, unsigned divisorRange)
+void Transmitter::TxViaCpu(unsigned sampleRate)
 {
-    std::vector<Sample> samples;
-    unsigned sampleOffset = 0;
+    while ((prefetch.GetSize() < prefetch.GetCapacity() / 2) && !prefetchEnd && !prefetchCancel) {
+        std::this_thread::sleep_for(std::chrono::microseconds(GetPrefetchBlockTime() / 10));
+    }
 
-    bool eof = false, stop = false, start = true;
+    TimingThread timing(realtimePriority, cpuAffinity);
+    TrentCode::setThreadName("cpu tx");
+    std::fill(timingHistogram, timingHistogram + TIMING_HISTOGRAM_SIZE, 0);
+    timingSamples = 0;
+    skippedSamples = 0;
+    maxTimingError = 0;
+
+    std::chrono::nanoseconds spin(static_cast<unsigned long long>(spinWindow) * 1000);
+    auto start = std::chrono::steady_clock::now();
+    // Whole seconds and the remainder are converted separately, so neither
+    // the sample count nor the elapsed time is ever multiplied into overflow
+    // however long the transmission runs.
+    auto getDeadline = [&](unsigned long long sample) -> std::chrono::steady_clock::time_point {
+        return start + std::chrono::seconds(sample / sampleRate) + std::chrono::nanoseconds((sample % sampleRate) * 1000000000 / sampleRate);
+    };
+    auto getSample = [&](std::chrono::steady_clock::time_point time) -> unsigned long long {
+        std::chrono::seconds seconds = std::chrono::duration_cast<std::chrono::seconds>(time - start);
+        return seconds.count() * sampleRate + std::chrono::duration_cast<std::chrono::nanoseconds>(time - start - seconds).count() * sampleRate / 1000000000;
+    };
+    unsigned long long cpuStart = GetThreadCpuTime(), offset = 0;
+    uint32_t divisor;
 
-    txThread = std::thread(&Transmitter::CpuTxThread, this, sampleRate, clockDivisor, divisorRange, &sampleOffset, &samples, &stop);
+    while (!prefetchCancel) {
+        if (!PopDivisors(&divisor, 1)) {
+            if (IsPrefetchDrained()) {
+                break;
+            }
+            CPROF_NAMED("underrun");
+            std::this_thread::sleep_for(std::chrono::microseconds(GetPrefetchBlockTime() / 10));
+            start = std::chrono::steady_clock::now() - (getDeadline(offset) - start);
+            continue;
+        }
+
+        // Sleep until the spin window before the deadline, then busy-wait
+        // the rest, which keeps the CPU mostly idle between samples while
+        // avoiding the wake-up latency of the scheduler at the deadline itself.
+        auto deadline = getDeadline(offset);
+        if (deadline - std::chrono::steady_clock::now() > spin) {
+            std::chrono::nanoseconds wake = (deadline - spin).time_since_epoch();
+            timespec time;
+            time.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(wake).count();
+            time.tv_nsec = (wake - std::chrono::seconds(time.tv_sec)).count();
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr);
+        }
+        auto now = std::chrono::steady_clock::now();
+        while (now < deadline) {
+            now = std::chrono::steady_clock::now();
+        }
+        output->SetDivisor(divisor);
+
+        unsigned error = std::chrono::duration_cast<std::chrono::microseconds>(now - deadline).count();
+        unsigned bucket = 0;
+        while ((bucket < TIMING_HISTOGRAM_SIZE - 1) && (error >= timingBucketLimits[bucket])) {
+            bucket++;
+        }
+        timingHistogram[bucket]++;
+        if (telemetry) {
+            Telemetry::Add(telemetry->GetData().samples, 1);
+            Telemetry::Record(telemetry->GetData().timingError, error);
+        }
+        maxTimingError = std::max(maxTimingError, error);
+        timingSamples++;
+
+        unsigned long long current = getSample(now);
+        while ((++offset < current) && prefetch.Pop(&divisor, 1)) {
+            skippedSamples++;
+            if (telemetry) {
+                Telemetry::Add(telemetry->GetData().droppedSamples, 1);
+            }
+        }
+    }
+    timingCpuTime = GetThreadCpuTime() - cpuStart;
+    timingDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
 
-    auto finally = [&]() {
-        {
-            std::lock_guard<std::mutex> lock(mtx);
-            stop = true;
+unsigned long long Transmitter::TxToStream(std::ostream &stream, RenderFormat format, float frequency)
+{
+    std::vector<uint32_t> divisors(prefetch.GetCapacity() / 2);
+    std::vector<float> offsets((format == RenderFormat::Frequency) ? divisors.size() : 0);
+    double clockFrequency = backend.GetClockFrequency() * 1000000.0 * (0x01 << 12);
+    unsigned long long rendered = 0;
+
+    while (!prefetchCancel) {
+        std::size_t popped = prefetch.Pop(divisors.data(), divisors.size());
+        if (!popped) {
+            if (IsPrefetchDrained()) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
         }
-        cv.notify_all();
-        txThread.join();
-        samples.clear();
-    };
+        if (format == RenderFormat::Frequency) {
+            for (std::size_t i = 0; i < popped; i++) {
+                offsets[i] = static_cast<float>(clockFrequency / (divisors[i] & 0xffffff) - frequency * 1000000.0);
+            }
+            stream.write(reinterpret_cast<const char *>(offsets.data()), sizeof(float) * popped);
+        } else {
+            stream.write(reinterpret_cast<const char *>(divisors.data()), sizeof(uint32_t) * popped);
+        }
+        if (!stream) {
+            throw std::runtime_error("Cannot write rendered samples");
+        }
+        rendered += popped;
+    }
+    stream.flush();
+    return rendered;
+}
+
+static inline unsigned ReadFrames(AudioSource &source, float *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    return source.Read(samples, frames, enable, mtx);
+}
+
+static inline unsigned ReadFrames(AudioSource &source, Q15 *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    return source.ReadFixed(samples, frames, enable, mtx);
+}
+
+static inline unsigned ReadFrames(AudioSource &source, Q31 *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    return source.ReadFixed(samples, frames, enable, mtx);
+}
+
+void Transmitter::PrefetchThread(AudioSource *source, unsigned sampleRate, unsigned clockDivisor, unsigned divisorRange, bool realtime)
+{
+    std::unique_ptr<AudioSource> next;
+    std::unique_ptr<AudioProcessor> processor;
+    std::unique_ptr<MpxEncoder> encoder;
+    TrentCode::setThreadName("reader");
 
     try {
-        while (!eof) {
-            std::unique_lock<std::mutex> lock(mtx);
-            if (!start) {
-                cv.wait(lock, [&]() -> bool {
-                    return samples.empty() || !enable || stop;
-                });
-            }
-            if (!enable) {
-               break;
+        // One processor and multiplex encoder serve the whole session, so the
+        // limiter, pilot and RDS stay continuous across spliced files.
+        if (processing) {
+            processor.reset(new AudioProcessor(sampleRate, preEmphasis));
+        }
+        if (stereo || rds) {
+            encoder.reset(new MpxEncoder(sampleRate, stereo, rds));
+        }
+        while (!prefetchCancel) {
+            std::unique_ptr<DivisorCache> cache;
+            // Composite streams are not cached, they are several times larger
+            // than the source and cheap to regenerate compared to reading them.
+            // Processed audio depends on the previous file, so it is not either.
+            if (!cacheDirectory.empty() && !processor && !encoder && source->IsCacheable()) {
+                cache.reset(new DivisorCache(cacheDirectory, source->GetName(), sampleRate, clockDivisor, divisorRange, GetCachePipeline(source, sampleRate)));
             }
-            if (stop) {
-                throw std::runtime_error("Transmitter thread has unexpectedly exited");
+            if (!PrefetchSource(source, sampleRate, processor.get(), encoder.get(), cache.get(), clockDivisor, divisorRange, realtime) || !playlist) {
+                break;
             }
-            if (samples.empty()) {
-                if (!reader.SetSampleOffset(sampleOffset + (start ? 0 : bufferSize))) {
-                    break;
-                }
-                lock.unlock();
-                samples = reader.GetSamples(bufferSize, enable, mtx);
-                lock.lock();
-                if (samples.empty()) {
-                    break;
-                }
-                eof = samples.size() < bufferSize;
-                lock.unlock();
-                cv.notify_all();
-            } else {
-                lock.unlock();
+            // Following files are resampled to the transmit rate if needed and
+            // spliced right behind the previous one, so DMA pacing never changes.
+            next = playlist->Next();
+            if (!next) {
+                break;
             }
-            start = false;
+            source = next.get();
         }
     } catch (...) {
-        finally();
-        throw;
+        prefetchError = std::current_exception();
     }
-    finally();
+    prefetchEnd = true;
 }
 
-void Transmitter::CpuTxThread(unsigned sampleRate, unsigned clockDivisor, unsigned divisorRange, unsigned *sampleOffset, std::vector<Sample> *samples, bool *stop)
+// Every stage changing the divisors of a file goes into the cache key, also
+// those whose output is not cached today.
+uint32_t Transmitter::GetCachePipeline(AudioSource *source, unsigned sampleRate) const
 {
-    try {
-        auto playbackStart = std::chrono::system_clock::now();
-        std::chrono::system_clock::time_point current, start;
+    uint32_t pipeline = (source->GetSampleRate() != sampleRate) ? DIVISOR_CACHE_RESAMPLED : 0;
+    if (processing) {
+        pipeline |= DIVISOR_CACHE_PROCESSED | (preEmphasis << DIVISOR_CACHE_EMPHASIS_SHIFT);
+    }
+    return pipeline | (stereo ? DIVISOR_CACHE_STEREO : 0) | (rds ? DIVISOR_CACHE_RDS : 0);
+}
 
-        while (true) {
-            std::vector<Sample> loadedSamples;
+bool Transmitter::PrefetchSource(AudioSource *source, unsigned sampleRate, AudioProcessor *processor, MpxEncoder *encoder, DivisorCache *cache, unsigned clockDivisor, unsigned divisorRange, bool realtime)
+{
+    if (cache && cache->IsHit()) {
+        return PrefetchCached(cache, realtime);
+    }
 
-            std::unique_lock<std::mutex> lock(mtx);
-            cv.wait(lock, [&]() -> bool {
-                return !samples->empty() || *stop;
-            });
-            if (*stop) {
-                break;
+    // Multiplex sources are always filtered to the audio bandwidth while
+    // being brought to the composite rate.
+    std::unique_ptr<Resampler> resampler;
+    if (encoder || (source->GetSampleRate() != sampleRate)) {
+        resampler.reset(new Resampler(*source, sampleRate, encoder ? MPX_AUDIO_CUTOFF : 0));
+        source = resampler.get();
+    }
+    if (processor) {
+        processor->SetSource(*source);
+        source = processor;
+    }
+    if (encoder) {
+        encoder->SetSource(*source);
+        source = encoder;
+    }
+
+    // Mono 8 and 16-bit PCM without resampling, processing or multiplex
+    // stages goes from the file straight to divisors through a table, built
+    // once per transmission for the carrier setting.
+    if (!resampler && !processor && !encoder && source->GetRawBits()) {
+        if (!divisorTable || (divisorTable->GetBits() != source->GetRawBits())) {
+            divisorTable.reset(new DivisorTable(source->GetRawBits(), clockDivisor, divisorRange));
+        }
+        return PrefetchRaw(source, sampleRate, cache, realtime);
+    }
+#ifdef FIXED_POINT
+    // Without resampling, processing or multiplex stages the samples stay
+    // fixed-point from the decoder to the divisors.
+    if (!resampler && !processor && !encoder && source->IsFixedPoint()) {
+        return PrefetchFrames<FixedSample>(source, sampleRate, cache, clockDivisor, divisorRange, realtime);
+    }
+#endif
+    return PrefetchFrames<float>(source, sampleRate, cache, clockDivisor, divisorRange, realtime);
+}
+
+template <typename Read, typename Convert>
+bool Transmitter::PrefetchBlocks(unsigned sampleRate, DivisorCache *cache, bool realtime, Read read, Convert convert)
+{
+    unsigned blockSize = static_cast<unsigned>(static_cast<unsigned long long>(sampleRate) * GetPrefetchBlockTime() / 1000000);
+    std::vector<uint32_t> divisors(blockSize);
+
+    while (!prefetchCancel) {
+        if (prefetch.GetCapacity() - prefetch.GetSize() < blockSize) {
+            WaitForSpace(realtime);
+            continue;
+        }
+        CPROF_NAMED("block");
+        unsigned quantity;
+        {
+            CPROF_NAMED("read");
+            auto start = std::chrono::steady_clock::now();
+            quantity = read(blockSize);
+            if (telemetry) {
+                Telemetry::Add(telemetry->GetData().readerStallTime, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+            }
+        }
+        {
+            CPROF_NAMED("convert");
+            convert(divisors.data(), quantity);
+        }
+        prefetch.Push(divisors.data(), quantity);
+        if (cache) {
+            CPROF_NAMED("cache append");
+            cache->Append(divisors.data(), quantity);
+        }
+        if (quantity < blockSize) {
+            if (cache) {
+                cache->Commit();
             }
-            start = current = std::chrono::system_clock::now();
-            *sampleOffset = std::chrono::duration_cast<std::chrono::microseconds>(current - playbackStart).count() * sampleRate / 1000000;
-            loadedSamples = std::move(*samples);
-            lock.unlock();
-            cv.notify_all();
+            return true;
+        }
+    }
+    return false;
+}
 
-            unsigned offset = 0;
+template <typename Sample>
+bool Transmitter::PrefetchFrames(AudioSource *source, unsigned sampleRate, DivisorCache *cache, unsigned clockDivisor, unsigned divisorRange, bool realtime)
+{
+    unsigned channels = source->GetChannels();
+    std::vector<Sample> samples(static_cast<unsigned long long>(sampleRate) * GetPrefetchBlockTime() / 1000000 * channels);
+    return PrefetchBlocks(sampleRate, cache, realtime, [&](unsigned frames) {
+        return ReadFrames(*source, samples.data(), frames, enable, mtx);
+    }, [&](uint32_t *divisors, unsigned quantity) {
+        ConvertToDivisors(samples.data(), quantity, channels, clockDivisor, divisorRange, divisors);
+    });
+}
 
-            while (true) {
-                if (offset >= loadedSamples.size()) {
-                    break;
-                }
-                unsigned prevOffset = offset;
-                float value = loadedSamples[offset].GetMonoValue();
-                output->SetDivisor(clockDivisor - static_cast<int>(round(value * divisorRange)));
-                while (offset == prevOffset) {
-                    std::this_thread::yield(); // asm("nop");
-                    current = std::chrono::system_clock::now();
-                    offset = std::chrono::duration_cast<std::chrono::microseconds>(current - start).count() * sampleRate / 1000000;
-                }
+bool Transmitter::PrefetchRaw(AudioSource *source, unsigned sampleRate, DivisorCache *cache, bool realtime)
+{
+    const uint8_t *data = nullptr;
+    return PrefetchBlocks(sampleRate, cache, realtime, [&](unsigned frames) {
+        data = source->GetRawSamples(frames, enable, mtx);
+        return frames;
+    }, [&](uint32_t *divisors, unsigned quantity) {
+        divisorTable->Convert(data, quantity, divisors);
+    });
+}
+
+bool Transmitter::PrefetchCached(DivisorCache *cache, bool realtime)
+{
+    const uint32_t *divisors = cache->GetDivisors();
+    std::size_t offset = 0, size = cache->GetSize();
+    while (!prefetchCancel && (offset < size)) {
+        std::size_t pushed = prefetch.Push(&divisors[offset], size - offset);
+        if (!pushed) {
+            WaitForSpace(realtime);
+        }
+        offset += pushed;
+    }
+    return offset == size;
+}
+
+void Transmitter::WaitForSpace(bool realtime)
+{
+    if (realtime) {
+        std::this_thread::sleep_for(std::chrono::microseconds(GetPrefetchBlockTime() / 2));
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+std::size_t Transmitter::PopDivisors(uint32_t *divisors, std::size_t count)
+{
+    unsigned depth = prefetch.GetSize();
+    if (!prefetchEnd && (depth < lowWatermark.load(std::memory_order_relaxed))) {
+        lowWatermark.store(depth, std::memory_order_relaxed);
+    }
+    if (depth > highWatermark.load(std::memory_order_relaxed)) {
+        highWatermark.store(depth, std::memory_order_relaxed);
+    }
+
+    std::size_t popped = prefetch.Pop(divisors, count);
+    if (!popped && count && !prefetchEnd) {
+        if (!underrun) {
+            underruns.fetch_add(1, std::memory_order_relaxed);
+            if (telemetry) {
+                Telemetry::Add(telemetry->GetData().underruns, 1);
             }
         }
-    } catch (...) {
-        std::unique_lock<std::mutex> lock(mtx);
-        *stop = true;
-        lock.unlock();
-        cv.notify_all();
+        underrun = true;
+    } else if (popped) {
+        underrun = false;
     }
+    return popped;
+}
+
+RefillStats Transmitter::GetRefillStats() const
+{
+    RefillStats stats;
+    // Percentiles are the upper end of the histogram bucket they fall in,
+    // capped at the exact maximum.
+    stats.segments = refillSegments;
+    stats.segmentSize = refillSegmentSize;
+    stats.refills = Telemetry::GetCount(refillLatency);
+    stats.lateRefills = lateRefills;
+    stats.latency50 = std::min(Telemetry::GetPercentile(refillLatency, 50), maxRefillLatency);
+    stats.latency90 = std::min(Telemetry::GetPercentile(refillLatency, 90), maxRefillLatency);
+    stats.latency99 = std::min(Telemetry::GetPercentile(refillLatency, 99), maxRefillLatency);
+    stats.latencyMax = maxRefillLatency;
+    stats.minHeadroom = stats.refills ? minHeadroom : 0;
+    stats.cpuTime = refillCpuTime;
+    stats.duration = refillDuration;
+    return stats;
+}
+
+TimingStats Transmitter::GetTimingStats() const
+{
+    TimingStats stats;
+    std::copy(timingBucketLimits, timingBucketLimits + TIMING_HISTOGRAM_SIZE - 1, stats.limits);
+    std::copy(timingHistogram, timingHistogram + TIMING_HISTOGRAM_SIZE, stats.histogram);
+    stats.samples = timingSamples;
+    stats.skipped = skippedSamples;
+    stats.maxError = maxTimingError;
+    stats.cpuTime = timingCpuTime;
+    stats.duration = timingDuration;
+    return stats;
+}
+
+bool Transmitter::IsPrefetchDrained() const
+{
+    return prefetchEnd && !prefetch.GetSize();
 }
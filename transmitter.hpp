@@ -33,30 +33,155 @@
 
 #pragma once
 
-#include "wave_reader.hpp"
+#include "audio_source.hpp"
+#include "audio_processor.hpp"
+#include "mpx_encoder.hpp"
+#include "rds_encoder.hpp"
+#include "playlist.hpp"
+#include "ring_buffer.hpp"
+#include "peripherals.hpp"
+#include "divisor.hpp"
+#include "divisor_cache.hpp"
+#include "telemetry.hpp"
 #include <condition_variable>
+#include <exception>
+#include <functional>
+#include <ostream>
 #include <thread>
 
-class ClockOutput;
+enum class BufferProfile
+{
+    Live,
+    Balanced,
+    Archive
+};
+
+enum class RenderFormat
+{
+    Divisor,
+    Frequency
+};
+
+struct PrefetchStats
+{
+    unsigned capacity;
+    unsigned depth;
+    unsigned lowWatermark;
+    unsigned highWatermark;
+    unsigned underruns;
+};
+
+struct RefillStats
+{
+    unsigned segments;
+    unsigned segmentSize;
+    unsigned refills;
+    unsigned lateRefills;
+    unsigned latency50, latency90, latency99, latencyMax;
+    long long minHeadroom;
+    unsigned long long cpuTime, duration;
+};
+
+#define TIMING_HISTOGRAM_SIZE 11
+
+// Deviation of CPU divisor writes from their deadlines: histogram[i] counts
+// errors below limits[i] microseconds (and not below limits[i - 1]), the
+// last bucket counts everything above.
+struct TimingStats
+{
+    unsigned limits[TIMING_HISTOGRAM_SIZE - 1];
+    unsigned long long histogram[TIMING_HISTOGRAM_SIZE];
+    unsigned long long samples, skipped;
+    unsigned maxError;
+    unsigned long long cpuTime, duration;
+};
 
 class Transmitter
 {
     public:
-        Transmitter();
+        Transmitter(Backend &backend);
         virtual ~Transmitter();
         Transmitter(const Transmitter &) = delete;
         Transmitter(Transmitter &&) = delete;
         Transmitter &operator=(const Transmitter &) = delete;
-        void Transmit(WaveReader &reader, float frequency, float bandwidth, unsigned dmaChannel, bool preserveCarrier);
+        void Transmit(AudioSource &source, float frequency, float bandwidth, unsigned dmaChannel, bool preserveCarrier);
+        void Transmit(Playlist &playlist, float frequency, float bandwidth, unsigned dmaChannel);
+        unsigned long long Render(AudioSource &source, float frequency, float bandwidth, std::ostream &stream, RenderFormat format);
         void Stop();
+        void SetPrefetchTime(unsigned time);
+        void SetBufferTime(unsigned time);
+        void SetSegments(unsigned segments);
+        void SetBufferProfile(BufferProfile profile);
+        unsigned GetBufferTime() const;
+        unsigned GetSegments() const;
+        unsigned GetPrefetchTime() const;
+        void SetTransmitRate(unsigned rate);
+        unsigned GetTransmitRate() const;
+        // Longest time (microseconds) from reading a sample to sending it.
+        unsigned GetLatency() const;
+        void SetStereo(bool stereo);
+        bool IsStereo() const;
+        void SetProcessing(bool processing);
+        bool IsProcessing() const;
+        void SetPreEmphasis(unsigned time);
+        unsigned GetPreEmphasis() const;
+        void SetCacheDirectory(const std::string &directory);
+        void SetRealtimePriority(int priority);
+        void SetCpuAffinity(int cpu);
+        void SetSpinWindow(unsigned time);
+        void SetTelemetry(Telemetry *telemetry);
+        void SetRds(RdsEncoder *rds);
+        PrefetchStats GetPrefetchStats() const;
+        RefillStats GetRefillStats() const;
+        TimingStats GetTimingStats() const;
     private:
-        void TxViaCpu(WaveReader &reader, unsigned sampleRate, unsigned bufferSize, unsigned clockDivisor, unsigned divisorRange);
-        void TxViaDma(WaveReader &reader, unsigned sampleRate, unsigned bufferSize, unsigned clockDivisor, unsigned divisorRange, unsigned dmaChannel);
-        void CpuTxThread(unsigned sampleRate, unsigned clockDivisor, unsigned divisorRange, unsigned *sampleOffset, std::vector<Sample> *samples, bool *stop);
+        void Run(AudioSource &source, float frequency, float bandwidth, bool realtime, bool preserveCarrier, const std::function<void(unsigned, unsigned)> &tx);
+        void TxViaCpu(unsigned sampleRate);
+        void TxViaDma(unsigned sampleRate, unsigned bufferSize, unsigned dmaChannel);
+        unsigned long long TxToStream(std::ostream &stream, RenderFormat format, float frequency);
+        void PrefetchThread(AudioSource *source, unsigned sampleRate, unsigned clockDivisor, unsigned divisorRange, bool realtime);
+        uint32_t GetCachePipeline(AudioSource *source, unsigned sampleRate) const;
+        bool PrefetchSource(AudioSource *source, unsigned sampleRate, AudioProcessor *processor, MpxEncoder *encoder, DivisorCache *cache, unsigned clockDivisor, unsigned divisorRange, bool realtime);
+        template <typename Read, typename Convert>
+        bool PrefetchBlocks(unsigned sampleRate, DivisorCache *cache, bool realtime, Read read, Convert convert);
+        template <typename Sample>
+        bool PrefetchFrames(AudioSource *source, unsigned sampleRate, DivisorCache *cache, unsigned clockDivisor, unsigned divisorRange, bool realtime);
+        bool PrefetchRaw(AudioSource *source, unsigned sampleRate, DivisorCache *cache, bool realtime);
+        bool PrefetchCached(DivisorCache *cache, bool realtime);
+        void WaitForSpace(bool realtime);
+        unsigned GetPrefetchBlockTime() const;
+        std::size_t PopDivisors(uint32_t *divisors, std::size_t count);
+        bool IsPrefetchDrained() const;
 
         std::condition_variable cv;
-        std::thread txThread;
-        ClockOutput *output;
+        std::thread prefetchThread;
+        Backend &backend;
+        std::unique_ptr<ClockOutput> output;
         std::mutex mtx;
         bool enable;
+        RingBuffer<uint32_t> prefetch;
+        std::atomic<bool> prefetchEnd, prefetchCancel;
+        std::exception_ptr prefetchError;
+        unsigned prefetchTime, bufferTime, segments, transmitRate, preEmphasis;
+        bool stereo, processing;
+        RdsEncoder *rds;
+        std::unique_ptr<DivisorTable> divisorTable;
+        std::string cacheDirectory;
+        std::atomic<unsigned> lowWatermark, highWatermark, underruns;
+        bool underrun;
+        Playlist *playlist;
+        std::atomic<bool> stopped;
+        TelemetryHistogram refillLatency;
+        unsigned refillSegments, refillSegmentSize, lateRefills;
+        uint32_t maxRefillLatency;
+        long long minHeadroom;
+        unsigned long long refillCpuTime, refillDuration;
+        int realtimePriority, cpuAffinity;
+        unsigned spinWindow;
+        static const unsigned timingBucketLimits[TIMING_HISTOGRAM_SIZE - 1];
+        unsigned long long timingHistogram[TIMING_HISTOGRAM_SIZE];
+        unsigned long long timingSamples, skippedSamples;
+        unsigned maxTimingError;
+        unsigned long long timingCpuTime, timingDuration;
+        Telemetry *telemetry;
 };
@@ -0,0 +1,110 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "voice.hpp"
+#include <algorithm>
+#include <cmath>
+
+Envelope::Envelope()
+    : stage(Stage::Idle), level(0.f)
+{
+    SetParameters(ENVELOPE_ATTACK, ENVELOPE_DECAY, ENVELOPE_SUSTAIN, ENVELOPE_RELEASE, ENVELOPE_SAMPLE_RATE);
+}
+
+void Envelope::SetParameters(float attack, float decay, float sustain, float release, unsigned sampleRate)
+{
+    auto getStep = [&](float time) -> float {
+        return 1.f / std::max(time * sampleRate, 1.f);
+    };
+    this->sustain = std::min(std::max(sustain, 0.f), 1.f);
+    attackStep = getStep(attack);
+    decayStep = getStep(decay);
+    releaseStep = getStep(release);
+}
+
+void Envelope::NoteOn()
+{
+    stage = Stage::Attack;
+}
+
+void Envelope::NoteOff()
+{
+    if (stage != Stage::Idle) {
+        stage = Stage::Release;
+    }
+}
+
+void Envelope::Render(float *levels, unsigned count)
+{
+    // Every stage is a linear ramp towards a target, so each one is written
+    // as a single run which the compiler can vectorize.
+    unsigned offset = 0;
+    while (offset < count) {
+        float step, target;
+        switch (stage) {
+            case Stage::Attack:
+                step = attackStep;
+                target = 1.f;
+                break;
+            case Stage::Decay:
+                step = -decayStep;
+                target = sustain;
+                break;
+            case Stage::Release:
+                step = -releaseStep;
+                target = 0.f;
+                break;
+            default:
+                level = (stage == Stage::Sustain) ? sustain : 0.f;
+                std::fill(levels + offset, levels + count, level);
+                return;
+        }
+        float remaining = (target - level) / step;
+        unsigned length = (remaining > 0.f) ? static_cast<unsigned>(std::ceil(remaining)) : 0;
+        unsigned run = std::min(length, count - offset);
+        float start = level;
+        for (unsigned i = 0; i < run; i++) {
+            levels[offset + i] = start + step * (i + 1);
+        }
+        offset += run;
+        if (run < length) {
+            level = start + step * run;
+            break;
+        }
+        if (run) {
+            levels[offset - 1] = target;
+        }
+        level = target;
+        stage = (stage == Stage::Attack) ? Stage::Decay : ((stage == Stage::Decay) ? Stage::Sustain : Stage::Idle);
+    }
+}
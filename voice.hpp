@@ -0,0 +1,75 @@
+/*
+    FM Transmitter - use Raspberry Pi as FM transmitter
+
+    Copyright (c) 2021, Marcin Kondej
+    All rights reserved.
+
+    See https://github.com/markondej/fm_transmitter
+
+    Redistribution and use in source and binary forms, with or without modification, are
+    permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors may be
+    used to endorse or promote products derived from this software without specific
+    prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+    OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+    SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+    TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+    BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+    WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "oscillator.hpp"
+#include <cstdint>
+
+#define ENVELOPE_ATTACK 0.005f
+#define ENVELOPE_DECAY 0.1f
+#define ENVELOPE_SUSTAIN 0.8f
+#define ENVELOPE_RELEASE 0.2f
+#define ENVELOPE_SAMPLE_RATE 22050
+
+// Linear ADSR envelope. Attack, decay and release times are given for a full
+// scale (0 - 1) transition, so a release started below full level is shorter.
+class Envelope
+{
+    public:
+        enum class Stage { Idle, Attack, Decay, Sustain, Release };
+        Envelope();
+        void SetParameters(float attack, float decay, float sustain, float release, unsigned sampleRate);
+        void NoteOn();
+        void NoteOff();
+        // Writes count levels, holds the sustain level and drops to 0 once idle.
+        void Render(float *levels, unsigned count);
+        Stage GetStage() const { return stage; }
+        float GetLevel() const { return level; }
+    private:
+        Stage stage;
+        float level, sustain, attackStep, decayStep, releaseStep;
+};
+
+// Note of a voice which has not sounded yet or has gone idle, MIDI note 0 is a
+// valid note.
+#define VOICE_NO_NOTE -1
+
+struct Voice
+{
+    Oscillator oscillator;
+    Envelope envelope;
+    int note;
+    float velocity;
+    uint64_t started;
+};
@@ -32,41 +32,29 @@
 */
 
 #include "wave_reader.hpp"
+#include <algorithm>
 #include <stdexcept>
 #include <cstring>
 #include <thread>
 #include <chrono>
 #include <unistd.h>
 #include <fcntl.h>
-#include <climits>
-
-Sample::Sample(uint8_t *data, unsigned channels, unsigned bitsPerChannel)
-    : value(0.f)
-{
-    int sum = 0;
-    int16_t *channelValues = new int16_t[channels];
-    for (unsigned i = 0; i < channels; i++) {
-        switch (bitsPerChannel >> 3) {
-        case 2:
-            channelValues[i] = (data[((i + 1) << 1) - 1] << 8) | data[((i + 1) << 1) - 2];
-            break;
-        case 1:
-            channelValues[i] = (static_cast<int16_t>(data[i]) - 0x80) << 8;
-            break;
-        }
-        sum += channelValues[i];
-    }
-    value = 2 * sum / (static_cast<float>(USHRT_MAX) * channels);
-    delete[] channelValues;
-}
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-float Sample::GetMonoValue() const
+// Tail of the KSDATAFORMAT_SUBTYPE_* GUIDs, following the 16-bit format code.
+static const uint8_t subFormatGuid[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 };
+
+template <typename T>
+static T GetValue(const uint8_t *data)
 {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
     return value;
 }
 
 WaveReader::WaveReader(const std::string &filename, bool &enable, std::mutex &mtx) :
-    filename(filename), headerOffset(0), currentDataOffset(0)
+    filename(filename), converter(nullptr), q15Converter(nullptr), q31Converter(nullptr), currentDataOffset(0), mappedFile(nullptr), mappedSize(0), mappedOffset(0)
 {
     if (!filename.empty()) {
         fileDescriptor = open(filename.c_str(), O_RDONLY);
@@ -79,46 +67,69 @@ WaveReader::WaveReader(const std::string &filename, bool &enable, std::mutex &mt
         throw std::runtime_error(std::string("Cannot open ") + GetFilename() + std::string(", file does not exist"));
     }
 
-    try {
-        ReadData(sizeof(WaveHeader::chunkID) + sizeof(WaveHeader::chunkSize) + sizeof(WaveHeader::format), true, enable, mtx);
-        if ((std::string(reinterpret_cast<char *>(header.chunkID), 4) != std::string("RIFF")) || (std::string(reinterpret_cast<char *>(header.format), 4) != std::string("WAVE"))) {
-            throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", WAVE file expected"));
-        }
-
-        ReadData(sizeof(WaveHeader::subchunk1ID) + sizeof(WaveHeader::subchunk1Size), true, enable, mtx);
-        unsigned subchunk1MinSize = sizeof(WaveHeader::audioFormat) + sizeof(WaveHeader::channels) +
-            sizeof(WaveHeader::sampleRate) + sizeof(WaveHeader::byteRate) + sizeof(WaveHeader::blockAlign) +
-            sizeof(WaveHeader::bitsPerSample);
-        if ((std::string(reinterpret_cast<char *>(header.subchunk1ID), 4) != std::string("fmt ")) || (header.subchunk1Size < subchunk1MinSize)) {
-            throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", data corrupted"));
+    struct stat fileStat;
+    if ((fileDescriptor != STDIN_FILENO) && !fstat(fileDescriptor, &fileStat) && S_ISREG(fileStat.st_mode) && (fileStat.st_size > 0)) {
+        void *mapped = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, fileStat.st_size, MADV_SEQUENTIAL);
+            mappedFile = reinterpret_cast<uint8_t *>(mapped);
+            mappedSize = fileStat.st_size;
         }
+    }
 
-        ReadData(header.subchunk1Size, true, enable, mtx);
-        if ((header.audioFormat != WAVE_FORMAT_PCM) ||
-            (header.byteRate != (header.bitsPerSample >> 3) * header.channels * header.sampleRate) ||
-            (header.blockAlign != (header.bitsPerSample >> 3) * header.channels) ||
-            (((header.bitsPerSample >> 3) != 1) && ((header.bitsPerSample >> 3) != 2))) {
-            throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", unsupported WAVE format"));
+    try {
+        const uint8_t *riff = ReadHeader(12, enable, mtx);
+        if (std::memcmp(riff, "RIFF", 4) || std::memcmp(&riff[8], "WAVE", 4)) {
+            throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", WAVE file expected"));
         }
 
-        ReadData(sizeof(WaveHeader::subchunk2ID) + sizeof(WaveHeader::subchunk2Size), true, enable, mtx);
-        if (std::string(reinterpret_cast<char *>(header.subchunk2ID), 4) != std::string("data")) {
-            throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", data corrupted"));
+        // Walk the chunk list up to "data", chunks other than "fmt " (LIST,
+        // fact, cue, bext, JUNK...) are skipped, odd sizes are padded.
+        while (true) {
+            const uint8_t *chunk = ReadHeader(8, enable, mtx);
+            std::string chunkID(reinterpret_cast<const char *>(chunk), 4);
+            uint32_t chunkSize = GetValue<uint32_t>(&chunk[4]);
+            if (chunkID == "data") {
+                if (!converter) {
+                    throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", data corrupted"));
+                }
+                header.dataSize = chunkSize;
+                break;
+            }
+            if (chunkID == "fmt ") {
+                if (chunkSize > WAVE_SKIP_SIZE) {
+                    throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", data corrupted"));
+                }
+                ReadFormat(ReadHeader(chunkSize, enable, mtx), chunkSize);
+            } else {
+                SkipHeader(chunkSize, enable, mtx);
+            }
+            if (chunkSize & 0x01) {
+                SkipHeader(1, enable, mtx);
+            }
         }
     } catch (...) {
+        if (mappedFile) {
+            munmap(mappedFile, mappedSize);
+        }
         if (fileDescriptor != STDIN_FILENO) {
             close(fileDescriptor);
         }
         throw;
     }
 
-    if (fileDescriptor != STDIN_FILENO) {
+    if (mappedFile) {
+        dataOffset = mappedOffset;
+    } else if (fileDescriptor != STDIN_FILENO) {
         dataOffset = lseek(fileDescriptor, 0, SEEK_CUR);
     }
 }
 
 WaveReader::~WaveReader()
 {
+    if (mappedFile) {
+        munmap(mappedFile, mappedSize);
+    }
     if (fileDescriptor != STDIN_FILENO) {
         close(fileDescriptor);
     }
@@ -134,31 +145,73 @@ const WaveHeader &WaveReader::GetHeader() const
     return header;
 }
 
-std::vector<Sample> WaveReader::GetSamples(unsigned quantity, bool &enable, std::mutex &mtx) {
-    unsigned bytesPerSample = (header.bitsPerSample >> 3) * header.channels;
+std::string WaveReader::GetName() const
+{
+    return GetFilename();
+}
+
+unsigned WaveReader::GetSampleRate() const
+{
+    return header.sampleRate;
+}
+
+unsigned WaveReader::GetChannels() const
+{
+    return header.channels;
+}
+
+template <typename Sample>
+unsigned WaveReader::ReadSamples(Sample *samples, unsigned frames, SampleConverter<Sample> convert, bool &enable, std::mutex &mtx)
+{
+    const uint8_t *data = GetRawSamples(frames, enable, mtx);
+    convert(data, frames * header.channels, samples);
+    return frames;
+}
+
+unsigned WaveReader::Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    return ReadSamples(samples, frames, converter, enable, mtx);
+}
+
+unsigned WaveReader::ReadFixed(Q15 *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    return ReadSamples(samples, frames, q15Converter, enable, mtx);
+}
+
+unsigned WaveReader::ReadFixed(Q31 *samples, unsigned frames, bool &enable, std::mutex &mtx)
+{
+    return ReadSamples(samples, frames, q31Converter, enable, mtx);
+}
+
+unsigned WaveReader::GetRawBits() const
+{
+    if ((header.audioFormat != WAVE_FORMAT_PCM) || (header.channels != 1) || ((header.bitsPerSample != 8) && (header.bitsPerSample != 16))) {
+        return 0;
+    }
+    return header.bitsPerSample;
+}
+
+const uint8_t *WaveReader::GetRawSamples(unsigned &quantity, bool &enable, std::mutex &mtx) {
+    unsigned bytesPerSample = header.blockAlign;
     unsigned bytesToRead = quantity * bytesPerSample;
-    unsigned bytesLeft = header.subchunk2Size - currentDataOffset;
+    unsigned bytesLeft = header.dataSize - currentDataOffset;
     if (bytesToRead > bytesLeft) {
         bytesToRead = bytesLeft - bytesLeft % bytesPerSample;
-        quantity = bytesToRead / bytesPerSample;
-    }
-
-    std::vector<uint8_t> data = std::move(ReadData(bytesToRead, false, enable, mtx));
-    if (data.size() < bytesToRead) {
-        quantity = data.size() / bytesPerSample;
     }
 
-    std::vector<Sample> samples;
-    samples.reserve(quantity);
-    for (unsigned i = 0; i < quantity; i++) {
-        samples.push_back(Sample(&data[bytesPerSample * i], header.channels, header.bitsPerSample));
-    }
-    return samples;
+    const uint8_t *data = ReadData(bytesToRead, false, enable, mtx);
+    quantity = bytesToRead / bytesPerSample;
+    return data;
 }
 
 bool WaveReader::SetSampleOffset(unsigned offset) {
+    if (mappedFile) {
+        currentDataOffset = offset * header.blockAlign;
+        mappedOffset = dataOffset + currentDataOffset;
+        return mappedOffset <= mappedSize;
+    }
     if (fileDescriptor != STDIN_FILENO) {
-        currentDataOffset = offset * (header.bitsPerSample >> 3) * header.channels;
+        currentDataOffset = offset * header.blockAlign;
         if (lseek(fileDescriptor, dataOffset + currentDataOffset, SEEK_SET) == -1) {
             return false;
         }
@@ -166,11 +219,88 @@ bool WaveReader::SetSampleOffset(unsigned offset) {
     return true;
 }
 
-std::vector<uint8_t> WaveReader::ReadData(unsigned bytesToRead, bool headerBytes, bool &enable, std::mutex &mtx)
+bool WaveReader::IsMapped() const
+{
+    return mappedFile != nullptr;
+}
+
+bool WaveReader::IsCacheable() const
+{
+    return IsMapped();
+}
+
+bool WaveReader::IsFixedPoint() const
+{
+    return true;
+}
+
+void WaveReader::ReadFormat(const uint8_t *data, uint32_t size)
+{
+    if (size < 16) {
+        throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", data corrupted"));
+    }
+    header.audioFormat = GetValue<uint16_t>(data);
+    header.channels = GetValue<uint16_t>(&data[2]);
+    header.sampleRate = GetValue<uint32_t>(&data[4]);
+    header.byteRate = GetValue<uint32_t>(&data[8]);
+    header.blockAlign = GetValue<uint16_t>(&data[12]);
+    header.bitsPerSample = GetValue<uint16_t>(&data[14]);
+
+    // Extensible files carry the real format code at the start of the
+    // sub-format GUID, samples are left-justified in bitsPerSample containers.
+    if (header.audioFormat == WAVE_FORMAT_EXTENSIBLE) {
+        if ((size < 40) || (GetValue<uint16_t>(&data[16]) < 22) || std::memcmp(&data[26], subFormatGuid, sizeof(subFormatGuid))) {
+            throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", unsupported WAVE format"));
+        }
+        header.audioFormat = GetValue<uint16_t>(&data[24]);
+    }
+
+    converter = GetSampleConverter<float>(header.audioFormat, header.bitsPerSample);
+    q15Converter = GetSampleConverter<Q15>(header.audioFormat, header.bitsPerSample);
+    q31Converter = GetSampleConverter<Q31>(header.audioFormat, header.bitsPerSample);
+    if (!converter || !header.channels || !header.sampleRate ||
+        (header.blockAlign != (header.bitsPerSample >> 3) * header.channels) ||
+        (header.byteRate != header.blockAlign * header.sampleRate)) {
+        throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", unsupported WAVE format"));
+    }
+}
+
+const uint8_t *WaveReader::ReadHeader(unsigned bytesToRead, bool &enable, std::mutex &mtx)
+{
+    return ReadData(bytesToRead, true, enable, mtx);
+}
+
+void WaveReader::SkipHeader(uint32_t bytesToSkip, bool &enable, std::mutex &mtx)
+{
+    while (bytesToSkip) {
+        unsigned bytesToRead = std::min(bytesToSkip, static_cast<uint32_t>(WAVE_SKIP_SIZE));
+        ReadData(bytesToRead, true, enable, mtx);
+        bytesToSkip -= bytesToRead;
+    }
+}
+
+const uint8_t *WaveReader::ReadData(unsigned &bytesToRead, bool headerBytes, bool &enable, std::mutex &mtx)
 {
+    if (mappedFile) {
+        std::size_t bytesLeft = (mappedOffset < mappedSize) ? mappedSize - mappedOffset : 0;
+        if (bytesToRead > bytesLeft) {
+            if (headerBytes) {
+                throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", data corrupted"));
+            }
+            bytesToRead = bytesLeft;
+        }
+        const uint8_t *data = &mappedFile[mappedOffset];
+        mappedOffset += bytesToRead;
+        if (!headerBytes) {
+            currentDataOffset += bytesToRead;
+        }
+        return data;
+    }
+
     unsigned bytesRead = 0;
-    std::vector<uint8_t> data;
-    data.resize(bytesToRead);
+    if (buffer.size() < bytesToRead) {
+        buffer.resize(bytesToRead);
+    }
     timeval timeout = {
         .tv_sec = 1,
     };
@@ -182,7 +312,7 @@ std::vector<uint8_t> WaveReader::ReadData(unsigned bytesToRead, bool headerBytes
                 break;
             }
         }
-        int bytes = read(fileDescriptor, &data[bytesRead], bytesToRead - bytesRead);
+        int bytes = read(fileDescriptor, &buffer[bytesRead], bytesToRead - bytesRead);
         if (((bytes == -1) && ((fileDescriptor != STDIN_FILENO) || (errno != EAGAIN))) ||
             ((static_cast<unsigned>(bytes) < bytesToRead) && headerBytes && (fileDescriptor != STDIN_FILENO))) {
             throw std::runtime_error(std::string("Error while opening ") + GetFilename() + std::string(", data corrupted"));
@@ -192,7 +322,6 @@ std::vector<uint8_t> WaveReader::ReadData(unsigned bytesToRead, bool headerBytes
         }
         if (bytesRead < bytesToRead) {
             if (fileDescriptor != STDIN_FILENO) {
-                data.resize(bytesRead);
                 break;
             } else {
                 FD_ZERO(&fds);
@@ -212,17 +341,10 @@ std::vector<uint8_t> WaveReader::ReadData(unsigned bytesToRead, bool headerBytes
                 throw std::runtime_error("Cannot obtain header, program interrupted");
             }
         }
-        std::memcpy(&(reinterpret_cast<uint8_t *>(&header))[headerOffset], data.data(), bytesRead);
-        headerOffset += bytesRead;
     } else {
-        {
-            std::lock_guard<std::mutex> lock(mtx);
-            if (!enable) {
-                data.resize(bytesRead);
-            }
-        }
         currentDataOffset += bytesRead;
     }
 
-    return data;
+    bytesToRead = bytesRead;
+    return buffer.data();
 }
@@ -33,40 +33,30 @@
 
 #pragma once
 
+#include "audio_source.hpp"
+#include "sample.hpp"
 #include <cstdint>
 #include <string>
 #include <vector>
 #include <mutex>
 
-#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+#define WAVE_SKIP_SIZE 65536
 
+// Stream format gathered from the "fmt " chunk, audioFormat is the sub-format
+// of WAVE_FORMAT_EXTENSIBLE files. dataSize is the "data" chunk length.
 struct WaveHeader
 {
-    uint8_t chunkID[4];
-    uint32_t chunkSize;
-    uint8_t format[4];
-    uint8_t subchunk1ID[4];
-    uint32_t subchunk1Size;
     uint16_t audioFormat;
     uint16_t channels;
     uint32_t sampleRate;
     uint32_t byteRate;
     uint16_t blockAlign;
     uint16_t bitsPerSample;
-    uint8_t subchunk2ID[4];
-    uint32_t subchunk2Size;
+    uint32_t dataSize;
 };
 
-class Sample
-{
-public:
-    Sample(uint8_t *data, unsigned channels, unsigned bitsPerChannel);
-    float GetMonoValue() const;
-protected:
-    float value;
-};
-
-class WaveReader
+class WaveReader : public AudioSource
 {
     public:
         WaveReader(const std::string &filename, bool &enable, std::mutex &mtx);
@@ -76,13 +66,34 @@ class WaveReader
         WaveReader &operator=(const WaveReader &) = delete;
         std::string GetFilename() const;
         const WaveHeader &GetHeader() const;
-        std::vector<Sample> GetSamples(unsigned quantity, bool &enable, std::mutex &mtx);
+        std::string GetName() const;
+        unsigned GetSampleRate() const;
+        unsigned GetChannels() const;
+        unsigned Read(float *samples, unsigned frames, bool &enable, std::mutex &mtx);
+        bool IsCacheable() const;
+        bool IsFixedPoint() const;
+        unsigned ReadFixed(Q15 *samples, unsigned frames, bool &enable, std::mutex &mtx);
+        unsigned ReadFixed(Q31 *samples, unsigned frames, bool &enable, std::mutex &mtx);
+        unsigned GetRawBits() const;
+        const uint8_t *GetRawSamples(unsigned &quantity, bool &enable, std::mutex &mtx);
         bool SetSampleOffset(unsigned offset);
+        bool IsMapped() const;
     private:
-        std::vector<uint8_t> ReadData(unsigned bytesToRead, bool headerBytes, bool &enable, std::mutex &mtx);
+        template <typename Sample>
+        unsigned ReadSamples(Sample *samples, unsigned frames, SampleConverter<Sample> convert, bool &enable, std::mutex &mtx);
+        void ReadFormat(const uint8_t *data, uint32_t size);
+        const uint8_t *ReadHeader(unsigned bytesToRead, bool &enable, std::mutex &mtx);
+        void SkipHeader(uint32_t bytesToSkip, bool &enable, std::mutex &mtx);
+        const uint8_t *ReadData(unsigned &bytesToRead, bool headerBytes, bool &enable, std::mutex &mtx);
 
         std::string filename;
         WaveHeader header;
-        unsigned dataOffset, headerOffset, currentDataOffset;
+        SampleConverter<float> converter;
+        SampleConverter<Q15> q15Converter;
+        SampleConverter<Q31> q31Converter;
+        unsigned dataOffset, currentDataOffset;
         int fileDescriptor;
+        uint8_t *mappedFile;
+        std::size_t mappedSize, mappedOffset;
+        std::vector<uint8_t> buffer;
 };